@@ -20,6 +20,7 @@ set(CMAKE_EXPORT_COMPILE_COMMANDS ON)
 option(DTK_DISABLE_LIBXDG "Disable libxdg" OFF)
 option(DTK_DISABLE_LIBRSVG "Disable librsvg" OFF)
 option(DTK_DISABLE_EX_IMAGE_FORMAT "Disable libraw and freeimage" OFF)
+option(DTK_BUILD_BENCHMARK "Build the benchmarks, it requires BUILD_TESTING" OFF)
 
 set(CMAKE_CXX_STANDARD 17)
 
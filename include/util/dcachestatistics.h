@@ -0,0 +1,39 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#ifndef DCACHESTATISTICS_H
+#define DCACHESTATISTICS_H
+
+#include <dtkgui_global.h>
+
+#include <QList>
+#include <QString>
+
+DGUI_BEGIN_NAMESPACE
+
+namespace DCacheStatistics
+{
+    struct Cache {
+        QString name;
+        qint64 hits = 0;
+        qint64 misses = 0;
+        qint64 evictions = 0;
+        // -1 if it's unknown
+        qint64 entries = -1;
+        qint64 bytes = -1;
+        qint64 maxBytes = -1;
+        qint64 maxEntries = -1;
+    };
+
+    QList<Cache> caches();
+    Cache cache(const QString &name);
+    QByteArray toJson();
+    void reset();
+
+    bool registerDBusObject();
+}
+
+DGUI_END_NAMESPACE
+
+#endif // DCACHESTATISTICS_H
@@ -19,8 +19,10 @@ DGUI_BEGIN_NAMESPACE
 typedef void* DDciIconMatchResult;
 
 class DDciIconImagePrivate;
+class DDciIconImagePlayerPrivate;
 class DDciIconImage {
     friend class DDciIcon;
+    friend class DDciIconImagePlayerPrivate;
 public:
     DDciIconImage() = default;
     DDciIconImage(const DDciIconImage &other);
@@ -59,6 +61,7 @@ public:
 protected:
     DDciIconImage(const QSharedPointer<DDciIconImagePrivate> &dd)
         : d(dd) {}
+    DDciIconImage clone() const;
 
     QSharedPointer<DDciIconImagePrivate> d;
 };
@@ -116,6 +119,11 @@ public:
     QPixmap pixmap(qreal devicePixelRatio, int iconSize, DDciIconMatchResult result,
                    const DDciIconPalette &palette = DDciIconPalette()) const;
 
+    QImage toImage(qreal devicePixelRatio, int iconSize, Theme theme, Mode mode = Normal,
+                   const DDciIconPalette &palette = DDciIconPalette()) const;
+    QImage toImage(qreal devicePixelRatio, int iconSize, DDciIconMatchResult result,
+                   const DDciIconPalette &palette = DDciIconPalette()) const;
+
     void paint(QPainter *painter, const QRect &rect, qreal devicePixelRatio, Theme theme, Mode mode = Normal,
                Qt::Alignment alignment = Qt::AlignCenter, const DDciIconPalette &palette = DDciIconPalette()) const;
     void paint(QPainter *painter, const QRect &rect, qreal devicePixelRatio, DDciIconMatchResult result,
@@ -34,7 +34,8 @@ public:
         InvertedOrder = 4,
         IgnoreLastImageLoop = 8,
         AllowNonLastImageLoop = 16,
-        ClearCacheOnStop = 32
+        ClearCacheOnStop = 32,
+        PreDecode = 64
     };
     Q_DECLARE_FLAGS(Flags, Flag)
 
@@ -52,6 +53,9 @@ public:
     int loopCount() const;
     void abortLoop();
 
+    void setPreDecodeFrameCount(int count);
+    int preDecodeFrameCount() const;
+
     QImage readImage();
     State state() const;
 
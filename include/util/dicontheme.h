@@ -47,6 +47,9 @@ namespace DIconTheme
     QStringList dciThemeSearchPaths();
     void setDciThemeSearchPaths(const QStringList &path);
 
+    void prefetch(const QStringList &iconNames, const QList<QSize> &sizes,
+                  const QList<qreal> &devicePixelRatios = {}, Options options = Options());
+
     bool isBuiltinIcon(const QIcon &icon);
     bool isXdgIcon(const QIcon &icon);
 }
@@ -29,6 +29,7 @@ public:
     QImage thumbnail(const QSize &size, Qt::AspectRatioMode mode);
     QString imageFormat() const;
     QSize imageSize();
+    void readImageAsync(const QSize &previewSize = QSize());
     QHash<QString, QString> findAllMetaData();
     void clearCache();
 
@@ -70,6 +71,12 @@ public:
     static QImage flipHorizontal(const QImage &img);
     static QImage flipVertical(const QImage &img);
 
+Q_SIGNALS:
+    void imageSizeReady(const QSize &size);
+    void previewImageReady(const QImage &preview);
+    void imageLoaded(const QImage &image);
+    void loadImageFailed(const QString &errorString);
+
 private:
     D_DECLARE_PRIVATE(DImageHandler)
     Q_DISABLE_COPY(DImageHandler)
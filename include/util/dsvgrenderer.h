@@ -10,6 +10,7 @@
 
 #include <QObject>
 #include <QRectF>
+#include <QStringList>
 
 QT_BEGIN_NAMESPACE
 class QPainter;
@@ -39,6 +40,8 @@ public:
     bool elementExists(const QString &id) const;
 
     QImage toImage(const QSize sz, const QString &elementId = QString()) const;
+    QList<QImage> toImages(const QList<QSize> &sizes, const QString &elementId = QString()) const;
+    QList<QImage> toImages(const QSize sz, const QStringList &elementIds) const;
 
 public Q_SLOTS:
     bool load(const QString &filename);
@@ -41,6 +41,7 @@ public:
     QString createThumbnail(const QFileInfo &info, Size size);
     typedef std::function<void(const QString &)> CallBack;
     void appendToProduceQueue(const QFileInfo &info, Size size, CallBack callback = 0);
+    void appendToProduceQueue(const QFileInfo &info, Size size, CallBack callback, int priority);
     void removeInProduceQueue(const QFileInfo &info, Size size);
 
     QString errorString() const;
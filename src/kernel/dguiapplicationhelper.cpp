@@ -4,6 +4,8 @@
 
 #include "dguiapplicationhelper.h"
 #include "private/dguiapplicationhelper_p.h"
+#include "private/dthemechangetransaction_p.h"
+#include "private/dtrace_p.h"
 #include "dplatformhandle.h"
 
 #include <DFontManager>
@@ -11,6 +13,7 @@
 #include <DSGApplication>
 
 #include <QHash>
+#include <QMutex>
 #include <QColor>
 #include <QPalette>
 #include <QWindow>
@@ -29,6 +32,8 @@
 #include <DPathBuf>
 #include <QTimer>
 
+#include <array>
+
 #ifdef Q_OS_WIN
 #include <qt_windows.h>
 #endif
@@ -337,19 +342,20 @@ DPlatformTheme *DGuiApplicationHelperPrivate::initWindow(QWindow *window) const
     window->setProperty(WINDOW_THEME_KEY, QVariant::fromValue(theme));
     theme->setParent(window); // 跟随窗口销毁
 
-    auto onWindowThemeChanged = [window, this] {
+    auto onWindowThemeChanged = [window, this] (DThemeChangeTransaction::Change change) {
         // 如果程序自定义了调色板, 则没有必要再关心窗口自身平台主题的变化
         // 需要注意的是, 这里的信号和事件可能会与 notifyAppThemeChanged 中的重复
         // 但是不能因此而移除这里的通知, 当窗口自身所对应的平台主题发生变化时, 这里
-        // 的通知机制就有了用武之地.
+        // 的通知机制就有了用武之地. 同一次主题切换中每个窗口只会收到一次 ThemeChange.
         if (Q_LIKELY(!isCustomPalette())) {
-            qGuiApp->postEvent(window, new QEvent(QEvent::ThemeChange));
+            if (auto transaction = DThemeChangeTransaction::instance())
+                transaction->addChange(change, window);
         }
     };
 
-    window->connect(theme, &DPlatformTheme::themeNameChanged, window, onWindowThemeChanged);
-    window->connect(theme, &DPlatformTheme::activeColorChanged, window, onWindowThemeChanged);
-    window->connect(theme, &DPlatformTheme::paletteChanged, window, onWindowThemeChanged);
+    window->connect(theme, &DPlatformTheme::themeNameChanged, window, std::bind(onWindowThemeChanged, DThemeChangeTransaction::ThemeNameChange));
+    window->connect(theme, &DPlatformTheme::activeColorChanged, window, std::bind(onWindowThemeChanged, DThemeChangeTransaction::ActiveColorChange));
+    window->connect(theme, &DPlatformTheme::paletteChanged, window, std::bind(onWindowThemeChanged, DThemeChangeTransaction::PaletteChange));
 
     return theme;
 }
@@ -363,27 +369,39 @@ void DGuiApplicationHelperPrivate::_q_initApplicationTheme(bool notifyChange)
     }
 
     QGuiApplication *app = qGuiApp;
-    auto onAppThemeChanged = [this] {
-        // 只有当程序未自定义调色板时才需要关心DPlatformTheme中themeName和palette的改变
-        if (!isCustomPalette())
-            notifyAppThemeChanged();
-    };
-    // 监听与程序主题相关的改变
-    QObject::connect(appTheme, &DPlatformTheme::themeNameChanged, app, onAppThemeChanged);
-    QObject::connect(appTheme, &DPlatformTheme::paletteChanged, app, onAppThemeChanged);
-    QTimer *timer = new QTimer(app);
-    timer->setInterval(100);
-    timer->setSingleShot(true);
-    QObject::connect(timer, &QTimer::timeout, timer, [this] {
-        if (!appPalette)
-            notifyAppThemeChanged();
-    });
-    QObject::connect(appTheme, &DPlatformTheme::activeColorChanged, app, [timer]{
-            timer->start();
-    });
-    QObject::connect(appTheme, &DPlatformTheme::darkActiveColorChanged, app, [timer] {
-            timer->start();
-    });
+    if (auto transaction = DThemeChangeTransaction::instance()) {
+        // 一次主题切换中的所有变化合并为一次通知, 程序只会重绘一次
+        QPointer<DGuiApplicationHelper> helper(q_func());
+        transaction->setCommitter([this, helper] (DThemeChangeTransaction::Changes changes, const QList<QWindow *> &windows) {
+            if (!helper)
+                return;
+
+            // 只有当程序未自定义调色板时才需要关心DPlatformTheme中themeName和palette的改变
+            // 活动色只在程序未固定调色板时需要关心
+            const bool themeChanged = (changes & (DThemeChangeTransaction::ThemeNameChange
+                                                  | DThemeChangeTransaction::PaletteChange)) && !isCustomPalette();
+            const bool activeColorChanged = (changes & DThemeChangeTransaction::ActiveColorChange) && !appPalette;
+            if (themeChanged || activeColorChanged)
+                notifyAppThemeChanged();
+
+            for (QWindow *window : windows)
+                qGuiApp->postEvent(window, new QEvent(QEvent::ThemeChange));
+        });
+
+        // 监听与程序主题相关的改变
+        QObject::connect(appTheme, &DPlatformTheme::themeNameChanged, app, [transaction] {
+            transaction->addChange(DThemeChangeTransaction::ThemeNameChange);
+        });
+        QObject::connect(appTheme, &DPlatformTheme::paletteChanged, app, [transaction] {
+            transaction->addChange(DThemeChangeTransaction::PaletteChange);
+        });
+        QObject::connect(appTheme, &DPlatformTheme::activeColorChanged, app, [transaction] {
+            transaction->addChange(DThemeChangeTransaction::ActiveColorChange);
+        });
+        QObject::connect(appTheme, &DPlatformTheme::darkActiveColorChanged, app, [transaction] {
+            transaction->addChange(DThemeChangeTransaction::ActiveColorChange);
+        });
+    }
 
     // appTheme在此之前可能由systemTheme所代替被使用，此时在创建appTheme
     // 并初始化之后，应当发送信号通知程序主题的改变
@@ -395,8 +413,11 @@ void DGuiApplicationHelperPrivate::_q_initApplicationTheme(bool notifyChange)
 void DGuiApplicationHelperPrivate::notifyAppThemeChanged()
 {
     D_Q(DGuiApplicationHelper);
+    D_TRACE_SCOPE("DGuiApplicationHelper::notifyAppThemeChanged", "theme");
     notifyAppThemeChangedByEvent();
     QMetaObject::invokeMethod(q, [q] () {
+        // 记录程序响应调色板变化 (重新生成调色板, 重绘) 的耗时
+        D_TRACE_SCOPE("DGuiApplicationHelper::applicationPaletteChanged", "theme");
         // 通知主题类型发生变化, 此处可能存在误报的行为, 不过不应该对此做额外的约束
         // 此信号的行为应当等价于 applicationPaletteChanged
         Q_EMIT q->themeTypeChanged(q->themeType());
@@ -661,6 +682,31 @@ static inline QColor adjustRGBColor(const QColor &base, qint8 redFloat, qint8 gr
     return base;
 }
 
+static void adjustImageRGBColor(QImage &image, qint8 redFloat, qint8 greenFloat,
+                                qint8 blueFloat, qint8 alphaFloat)
+{
+    Q_ASSERT(image.format() == QImage::Format_ARGB32);
+
+    uchar red[256], green[256], blue[256], alpha[256];
+    for (int i = 0; i < 256; ++i) {
+        red[i] = static_cast<uchar>(qBound(0, adjustColorValue(i, redFloat), 255));
+        green[i] = static_cast<uchar>(qBound(0, adjustColorValue(i, greenFloat), 255));
+        blue[i] = static_cast<uchar>(qBound(0, adjustColorValue(i, blueFloat), 255));
+        alpha[i] = static_cast<uchar>(qBound(0, adjustColorValue(i, alphaFloat), 255));
+    }
+
+    for (int y = 0; y < image.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < image.width(); ++x) {
+            const QRgb pixel = line[x];
+            if (qAlpha(pixel) == 0)
+                continue;
+
+            line[x] = qRgba(red[qRed(pixel)], green[qGreen(pixel)], blue[qBlue(pixel)], alpha[qAlpha(pixel)]);
+        }
+    }
+}
+
 /*!
   \brief 调整颜色.
 
@@ -718,19 +764,35 @@ QImage DGuiApplicationHelper::adjustColor(const QImage &base, qint8 hueFloat, qi
             && !greenFloat && !blueFloat && !alphaFloat)
         return base;
 
-    QImage dest = base;
-    for (int y = 0; y < dest.height(); ++y) {
-        const QRgb *rgb = reinterpret_cast<const QRgb *>(base.scanLine(y));
-        for (int x = 0; x < dest.width(); ++x) {
-            QColor base = QColor::fromRgba(rgb[x]);
-            if (base.alpha() == 0)
-                continue;
-            QColor color = adjustColor(base, hueFloat, saturationFloat, lightnessFloat,
-                                       redFloat, greenFloat, blueFloat, alphaFloat);
-            dest.setPixel(x, y, color.rgba());
+    const QImage::Format format = base.format();
+    QImage dest = base.convertToFormat(QImage::Format_ARGB32);
+
+    if (!hueFloat && !saturationFloat && !lightnessFloat) {
+        // Only the RGB and alpha channels are adjusted, each of them is independent.
+        adjustImageRGBColor(dest, redFloat, greenFloat, blueFloat, alphaFloat);
+    } else {
+        // Images mostly have few distinct colors, remember the recent results.
+        // The fully transparent pixels are skipped, so 0 is never a valid key.
+        std::array<QPair<QRgb, QRgb>, 1024> cache {};
+        for (int y = 0; y < dest.height(); ++y) {
+            QRgb *line = reinterpret_cast<QRgb *>(dest.scanLine(y));
+            for (int x = 0; x < dest.width(); ++x) {
+                const QRgb pixel = line[x];
+                if (qAlpha(pixel) == 0)
+                    continue;
+
+                auto &entry = cache[(pixel * 2654435761u) >> 22];
+                if (entry.first != pixel) {
+                    const QColor color = adjustColor(QColor::fromRgba(pixel), hueFloat, saturationFloat, lightnessFloat,
+                                                     redFloat, greenFloat, blueFloat, alphaFloat);
+                    entry = qMakePair(pixel, color.rgba());
+                }
+                line[x] = entry.second;
+            }
         }
     }
-    return dest;
+
+    return format == QImage::Format_ARGB32 ? dest : dest.convertToFormat(format);
 }
 
 /*!
@@ -833,63 +895,19 @@ static QColor dark_dpalette[DPalette::NColorTypes] {
     QColor(255, 255, 255, 0.1 * 255)    //ObviousBackground
 };
 
-/*!
-  \brief 根据主题获取标准调色板.
-
-  \param type 主题枚举值
-  \return 调色板
- */
-DPalette DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::ColorType type)
+// 标准调色板只与颜色类型及 ColorCompositing, UseInactiveColorGroup 两个属性有关,
+// 每种组合只计算一次. 由标准调色板和活动色派生的调色板也会被缓存, 切换活动色时
+// 只需要查表, 不需要重新进行颜色空间的转换.
+static DPalette createStandardPalette(DGuiApplicationHelper::ColorType type, bool allowCompositingColor)
 {
-    static const DPalette *light_palette = nullptr, *dark_palette = nullptr;
-    static const DPalette *alpha_light_palette = nullptr, *alpha_dark_palette = nullptr;
-    const bool allowCompositingColor = DGuiApplicationHelper::testAttribute(ColorCompositing);
-
-    if (type == LightType) {
-        if (Q_UNLIKELY(allowCompositingColor)) {
-            if (Q_LIKELY(alpha_light_palette)) {
-                return *alpha_light_palette;
-            }
-        }
-
-        if (Q_LIKELY(light_palette)) {
-            return *light_palette;
-        }
-    } else if (type == DarkType) {
-        if (Q_UNLIKELY(allowCompositingColor)) {
-            if (Q_LIKELY(alpha_dark_palette)) {
-                return *alpha_dark_palette;
-            }
-        }
-
-        if (Q_LIKELY(dark_palette)) {
-            return *dark_palette;
-        }
-    } else {
-        return DPalette();
-    }
-
-    DPalette *pa;
+    DPalette palette;
+    DPalette *pa = &palette;
     const QColor *qcolor_list, *dcolor_list;
 
-    if (type == DarkType) {
-        pa = new DPalette();
-
-        if (allowCompositingColor)
-            alpha_dark_palette = pa;
-        else
-            dark_palette = pa;
-
+    if (type == DGuiApplicationHelper::DarkType) {
         qcolor_list = dark_qpalette;
         dcolor_list = dark_dpalette;
     } else {
-        pa = new DPalette();
-
-        if (allowCompositingColor)
-            alpha_light_palette = pa;
-        else
-            light_palette = pa;
-
         qcolor_list = light_qpalette;
         dcolor_list = light_dpalette;
     }
@@ -907,24 +925,24 @@ DPalette DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::ColorType
         if (allowCompositingColor) {
             switch (role) {
             case QPalette::Window:
-                color = type == LightType ? adjustColor(color, 0, 0, 0, 0, 0, 0, -20) : adjustColor(color, 0, 0, -10, 0, 0, 0, -20);
+                color = type == DGuiApplicationHelper::LightType ? DGuiApplicationHelper::adjustColor(color, 0, 0, 0, 0, 0, 0, -20) : DGuiApplicationHelper::adjustColor(color, 0, 0, -10, 0, 0, 0, -20);
                 break;
             case QPalette::Base:
-                color = adjustColor(color, 0, 0, 0, 0, 0, 0, -20);
+                color = DGuiApplicationHelper::adjustColor(color, 0, 0, 0, 0, 0, 0, -20);
                 break;
             case QPalette::WindowText:
             case QPalette::Text:
-                color = adjustColor(color, 0, 0, type == LightType ? -20 : +20, 0, 0, 0, -20);
+                color = DGuiApplicationHelper::adjustColor(color, 0, 0, type == DGuiApplicationHelper::LightType ? -20 : +20, 0, 0, 0, -20);
                 break;
             case QPalette::ButtonText:
-                color = type == LightType ? adjustColor(color, 0, 0, -20, 0, 0, 0, -20) : adjustColor(color, 0, 0, +20, 0, 0, 0, 0);
+                color = type == DGuiApplicationHelper::LightType ? DGuiApplicationHelper::adjustColor(color, 0, 0, -20, 0, 0, 0, -20) : DGuiApplicationHelper::adjustColor(color, 0, 0, +20, 0, 0, 0, 0);
                 break;
             case QPalette::Button:
             case QPalette::Light:
             case QPalette::Mid:
             case QPalette::Midlight:
             case QPalette::Dark:
-                color = adjustColor(color, 0, 0, -20, 0, 0, 0, -40);
+                color = DGuiApplicationHelper::adjustColor(color, 0, 0, -20, 0, 0, 0, -40);
                 break;
             default:
                 break;
@@ -932,7 +950,7 @@ DPalette DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::ColorType
         }
 
         pa->setColor(DPalette::Active, role, color);
-        generatePaletteColor(*pa, role, type);
+        DGuiApplicationHelper::generatePaletteColor(*pa, role, type);
     }
 
     for (int i = 0; i < DPalette::NColorTypes; ++i) {
@@ -943,13 +961,13 @@ DPalette DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::ColorType
         if (allowCompositingColor) {
             switch (role) {
             case DPalette::ItemBackground:
-                color = adjustColor(color, 0, 0, 100, 0, 0, 0, type == LightType ? -80 : -90);
+                color = DGuiApplicationHelper::adjustColor(color, 0, 0, 100, 0, 0, 0, type == DGuiApplicationHelper::LightType ? -80 : -90);
                 break;
             case DPalette::TextTitle:
-                color = adjustColor(color, 0, 0, -20, 0, 0, 0, -20);
+                color = DGuiApplicationHelper::adjustColor(color, 0, 0, -20, 0, 0, 0, -20);
                 break;
             case DPalette::TextTips:
-                color = type == LightType ? adjustColor(color, 0, 0, -40, 0, 0, 0, -40) : adjustColor(color, 0, 0, +40, 0, 0, 0, -50);
+                color = type == DGuiApplicationHelper::LightType ? DGuiApplicationHelper::adjustColor(color, 0, 0, -40, 0, 0, 0, -40) : DGuiApplicationHelper::adjustColor(color, 0, 0, +40, 0, 0, 0, -50);
                 break;
             default:
                 break;
@@ -957,10 +975,79 @@ DPalette DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::ColorType
         }
 
         pa->setColor(DPalette::Active, role, color);
-        generatePaletteColor(*pa, role, type);
+        DGuiApplicationHelper::generatePaletteColor(*pa, role, type);
+    }
+
+    return palette;
+}
+
+// 按 (主题类型, ColorCompositing, UseInactiveColorGroup) 缓存标准调色板, 只计算一次
+class DStandardPaletteCache
+{
+public:
+    // 派生调色板的数量上限, 活动色的种类一般很少
+    enum { MaxDerivedPalettes = 64 };
+
+    static inline int variant(DGuiApplicationHelper::ColorType type)
+    {
+        return (type == DGuiApplicationHelper::DarkType ? 1 : 0)
+                | (DGuiApplicationHelper::testAttribute(DGuiApplicationHelper::ColorCompositing) ? 2 : 0)
+                | (DGuiApplicationHelper::testAttribute(DGuiApplicationHelper::UseInactiveColorGroup) ? 4 : 0);
+    }
+
+    DPalette palette(DGuiApplicationHelper::ColorType type)
+    {
+        const int index = variant(type);
+        QMutexLocker locker(&mutex);
+        if (Q_UNLIKELY(!standardValid[index])) {
+            standard[index] = createStandardPalette(type, index & 2);
+            standardValid[index] = true;
+        }
+        return standard[index];
     }
 
-    return *const_cast<const DPalette*>(pa);
+    // 标准调色板的 Highlight 替换为 activeColor 后的调色板
+    DPalette derivedPalette(DGuiApplicationHelper::ColorType type, const QColor &activeColor)
+    {
+        const QPair<int, quint64> key(variant(type), activeColor.rgba64());
+        {
+            QMutexLocker locker(&mutex);
+            auto it = derived.constFind(key);
+            if (it != derived.constEnd())
+                return it.value();
+        }
+
+        DPalette pa = palette(type);
+        pa.setColor(QPalette::Normal, QPalette::Highlight, activeColor);
+        DGuiApplicationHelper::generatePaletteColor(pa, QPalette::Highlight, type);
+
+        QMutexLocker locker(&mutex);
+        if (derived.size() >= MaxDerivedPalettes)
+            derived.clear();
+        derived.insert(key, pa);
+        return pa;
+    }
+
+private:
+    QMutex mutex;
+    DPalette standard[8];
+    bool standardValid[8] = {};
+    QHash<QPair<int, quint64>, DPalette> derived;
+};
+Q_GLOBAL_STATIC(DStandardPaletteCache, _standardPalettes)
+
+/*!
+  \brief 根据主题获取标准调色板.
+
+  \param type 主题枚举值
+  \return 调色板
+ */
+DPalette DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::ColorType type)
+{
+    if (type != LightType && type != DarkType)
+        return DPalette();
+
+    return _standardPalettes->palette(type);
 }
 
 template<typename M>
@@ -1095,6 +1182,7 @@ static inline QColor getActiveColor(const DPlatformTheme *theme, DGuiApplication
  */
 DPalette DGuiApplicationHelper::fetchPalette(const DPlatformTheme *theme)
 {
+    D_TRACE_SCOPE("DGuiApplicationHelper::fetchPalette", "theme");
     DPalette base_palette;
     const QByteArray theme_name = theme->themeName();
     ColorType type = LightType;
@@ -1108,6 +1196,10 @@ DPalette DGuiApplicationHelper::fetchPalette(const DPlatformTheme *theme)
     base_palette = theme->fetchPalette(standardPalette(type), &ok);
     const QColor &active_color = getActiveColor(theme, type);
 
+    // 平台主题未提供调色板时, 结果只由标准调色板和活动色决定
+    if (!ok && active_color.isValid())
+        return _standardPalettes->derivedPalette(type, active_color);
+
     if (active_color.isValid()) {
         base_palette.setColor(QPalette::Normal, QPalette::Highlight, active_color);
 
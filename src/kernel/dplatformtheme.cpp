@@ -13,6 +13,7 @@
 #include "plugins/platform/treeland/dtreelandplatforminterface.h"
 #endif
 #include "private/dplatforminterface_p.h"
+#include "private/dthemechangetransaction_p.h"
 #include "orgdeepindtkpreference.hpp"
 
 #include <QVariant>
@@ -69,9 +70,15 @@ void DPlatformThemePrivate::notifyPaletteChanged()
         notifyPaletteChangeTimer = new QTimer(q);
         q->connect(notifyPaletteChangeTimer, &QTimer::timeout, q, [q, this] {
             Q_EMIT q->paletteChanged(*palette);
+            // 调色板的变化已经加入主题变化事务, 允许其提交
+            if (auto transaction = DThemeChangeTransaction::instance())
+                transaction->release(q);
         });
     }
 
+    // 延迟通知期间持有主题变化事务, 使同一次主题切换中的其它变化等待调色板一起提交
+    if (auto transaction = DThemeChangeTransaction::instance())
+        transaction->hold(q);
     notifyPaletteChangeTimer->start(300);
 }
 
@@ -170,6 +177,8 @@ DPlatformTheme::~DPlatformTheme()
 {
     D_D(DPlatformTheme);
 
+    if (auto transaction = DThemeChangeTransaction::instance())
+        transaction->release(this);
     if (d->palette) {
         delete d->palette;
     }
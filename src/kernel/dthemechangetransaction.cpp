@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "private/dthemechangetransaction_p.h"
+#include "private/dtrace_p.h"
+
+DGUI_BEGIN_NAMESPACE
+
+// 一帧的时间, 在此时间内的主题变化会被合并
+static constexpr int FrameInterval = 16;
+// 仅有活动色变化时的防抖时间, 避免拖动取色时频繁刷新
+static constexpr int ActiveColorInterval = 100;
+
+Q_GLOBAL_STATIC(DThemeChangeTransaction, _themeChangeTransaction)
+
+DThemeChangeTransaction::DThemeChangeTransaction()
+{
+    m_timer.setSingleShot(true);
+    QObject::connect(&m_timer, &QTimer::timeout, [this] {
+        commit();
+    });
+}
+
+DThemeChangeTransaction *DThemeChangeTransaction::instance()
+{
+    return _themeChangeTransaction.isDestroyed() ? nullptr : _themeChangeTransaction();
+}
+
+DThemeChangeTransaction::Committer DThemeChangeTransaction::committer() const
+{
+    return m_committer;
+}
+
+void DThemeChangeTransaction::setCommitter(const Committer &committer)
+{
+    m_committer = committer;
+}
+
+void DThemeChangeTransaction::addChange(Change change, QWindow *window)
+{
+    m_changes |= change;
+    if (window && !m_windows.contains(window))
+        m_windows.append(window);
+
+    if (m_changes == ActiveColorChange && m_windows.isEmpty()) {
+        m_timer.start(ActiveColorInterval);
+    } else if (!m_timer.isActive() || m_timer.remainingTime() > FrameInterval) {
+        m_timer.start(FrameInterval);
+    }
+}
+
+void DThemeChangeTransaction::hold(const QObject *holder)
+{
+    m_holders.insert(holder);
+}
+
+void DThemeChangeTransaction::release(const QObject *holder)
+{
+    if (!m_holders.remove(holder))
+        return;
+
+    // 事务在持有期间已经到期, 尽快提交
+    if (m_holders.isEmpty() && isPending() && !m_timer.isActive())
+        m_timer.start(0);
+}
+
+bool DThemeChangeTransaction::isPending() const
+{
+    return m_changes || !m_windows.isEmpty();
+}
+
+void DThemeChangeTransaction::commit()
+{
+    // 等待调色板的变化, 由 release 再次提交
+    if (!m_holders.isEmpty())
+        return;
+
+    const Changes changes = m_changes;
+    QList<QWindow *> windows;
+    windows.reserve(m_windows.size());
+    for (const auto &window : std::as_const(m_windows)) {
+        if (window)
+            windows.append(window);
+    }
+
+    m_changes = Changes();
+    m_windows.clear();
+
+    if (m_committer && (changes || !windows.isEmpty())) {
+        D_TRACE_SCOPE("DThemeChangeTransaction::commit", "theme");
+        m_committer(changes, windows);
+    }
+}
+
+DGUI_END_NAMESPACE
@@ -0,0 +1,258 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "dtrace_p.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QMutex>
+#include <QSaveFile>
+#include <QSharedPointer>
+#include <QThread>
+#include <QVector>
+
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+DGUI_BEGIN_NAMESPACE
+
+Q_LOGGING_CATEGORY(dgTrace, "dtk.gui.trace", QtInfoMsg)
+
+#define TRACE_FILE_ENV "D_DTK_TRACE_FILE"
+// 每个线程最多记录的事件数量, 超出后的事件被丢弃
+#define MAX_THREAD_EVENTS 200000
+
+struct DTraceEvent
+{
+    const char *name;
+    // 计数器的 category 为空
+    const char *category;
+    // 计数器的数据名
+    const char *series;
+    qint64 timestamp;
+    // 区间的耗时或计数器的值
+    qint64 value;
+    QString detail;
+};
+
+class DTraceThreadBuffer
+{
+public:
+    void append(DTraceEvent &&event)
+    {
+        QMutexLocker locker(&mutex);
+        if (events.size() >= MAX_THREAD_EVENTS) {
+            ++dropped;
+            return;
+        }
+        events.append(std::move(event));
+    }
+
+    QMutex mutex;
+    qint64 threadId = 0;
+    QString threadName;
+    QVector<DTraceEvent> events;
+    qint64 dropped = 0;
+};
+
+class DTraceData
+{
+public:
+    QMutex mutex;
+    // 线程退出后其记录的事件仍然保留, 直到导出
+    QList<QSharedPointer<DTraceThreadBuffer>> buffers;
+    QString file;
+};
+Q_GLOBAL_STATIC(DTraceData, _traceData)
+
+QAtomicInteger<int> DTrace::enabledState(-1);
+
+static qint64 currentThreadId()
+{
+#ifdef Q_OS_LINUX
+    // 与 perf, Perfetto 等工具记录的线程号一致
+    return static_cast<qint64>(syscall(SYS_gettid));
+#else
+    return static_cast<qint64>(reinterpret_cast<quintptr>(QThread::currentThreadId()));
+#endif
+}
+
+static DTraceThreadBuffer *threadBuffer()
+{
+    thread_local QSharedPointer<DTraceThreadBuffer> buffer;
+    if (Q_LIKELY(buffer))
+        return buffer.data();
+
+    if (_traceData.isDestroyed())
+        return nullptr;
+
+    buffer.reset(new DTraceThreadBuffer);
+    buffer->threadId = currentThreadId();
+    QThread *thread = QThread::currentThread();
+    buffer->threadName = thread->objectName();
+    if (buffer->threadName.isEmpty()) {
+        buffer->threadName = (qApp && thread == qApp->thread())
+                ? QStringLiteral("main") : QStringLiteral("thread %1").arg(buffer->threadId);
+    }
+
+    QMutexLocker locker(&_traceData->mutex);
+    _traceData->buffers.append(buffer);
+    return buffer.data();
+}
+
+static void writeTraceOnExit()
+{
+    const QString file = DTrace::traceFile();
+    if (file.isEmpty())
+        return;
+
+    if (DTrace::writeChromeTrace(file)) {
+        qCInfo(dgTrace) << "The trace is written to" << file;
+    } else {
+        qCWarning(dgTrace) << "Failed to write the trace to" << file;
+    }
+}
+
+bool DTrace::initialize()
+{
+    QString file = qEnvironmentVariable(TRACE_FILE_ENV);
+    if (file.isEmpty() && dgTrace().isDebugEnabled()) {
+        file = QDir::temp().filePath(QStringLiteral("dtkgui-trace-%1.json")
+                                     .arg(QCoreApplication::applicationPid()));
+    }
+
+    const bool enabled = !file.isEmpty();
+    if (enabledState.testAndSetOrdered(-1, enabled ? 1 : 0) && enabled) {
+        {
+            QMutexLocker locker(&_traceData->mutex);
+            _traceData->file = file;
+        }
+        qAddPostRoutine(writeTraceOnExit);
+    }
+
+    return enabledState.loadAcquire() > 0;
+}
+
+void DTrace::setEnabled(bool enabled)
+{
+    enabledState.storeRelease(enabled ? 1 : 0);
+}
+
+void DTrace::addSpan(const char *name, const char *category, qint64 start, qint64 end, const QString &detail)
+{
+    if (DTraceThreadBuffer *buffer = threadBuffer())
+        buffer->append({name, category, nullptr, start, end - start, detail});
+}
+
+void DTrace::addCounter(const char *name, const char *series, qint64 value)
+{
+    if (DTraceThreadBuffer *buffer = threadBuffer())
+        buffer->append({name, nullptr, series, now(), value, QString()});
+}
+
+static inline double toMicroseconds(qint64 ns)
+{
+    return ns / 1000.0;
+}
+
+QByteArray DTrace::toChromeTraceJson()
+{
+    const qint64 pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+    qint64 dropped = 0;
+
+    QJsonObject processName;
+    processName.insert("name", "process_name");
+    processName.insert("ph", "M");
+    processName.insert("pid", pid);
+    processName.insert("args", QJsonObject {{"name", QCoreApplication::applicationName()}});
+    events.append(processName);
+
+    QList<QSharedPointer<DTraceThreadBuffer>> buffers;
+    if (!_traceData.isDestroyed()) {
+        QMutexLocker locker(&_traceData->mutex);
+        buffers = _traceData->buffers;
+    }
+
+    for (const auto &buffer : std::as_const(buffers)) {
+        QMutexLocker locker(&buffer->mutex);
+        dropped += buffer->dropped;
+
+        QJsonObject threadName;
+        threadName.insert("name", "thread_name");
+        threadName.insert("ph", "M");
+        threadName.insert("pid", pid);
+        threadName.insert("tid", buffer->threadId);
+        threadName.insert("args", QJsonObject {{"name", buffer->threadName}});
+        events.append(threadName);
+
+        for (const DTraceEvent &event : std::as_const(buffer->events)) {
+            QJsonObject object;
+            object.insert("name", QLatin1String(event.name));
+            object.insert("pid", pid);
+            object.insert("tid", buffer->threadId);
+            object.insert("ts", toMicroseconds(event.timestamp));
+
+            if (event.category) {
+                object.insert("cat", QLatin1String(event.category));
+                object.insert("ph", "X");
+                object.insert("dur", toMicroseconds(event.value));
+                if (!event.detail.isEmpty())
+                    object.insert("args", QJsonObject {{"detail", event.detail}});
+            } else {
+                object.insert("ph", "C");
+                object.insert("args", QJsonObject {{QLatin1String(event.series), event.value}});
+            }
+
+            events.append(object);
+        }
+    }
+
+    QJsonObject root;
+    root.insert("traceEvents", events);
+    root.insert("displayTimeUnit", "ms");
+    root.insert("otherData", QJsonObject {{"clock", "CLOCK_MONOTONIC"}, {"droppedEvents", dropped}});
+
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+bool DTrace::writeChromeTrace(const QString &fileName)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    file.write(toChromeTraceJson());
+    return file.commit();
+}
+
+QString DTrace::traceFile()
+{
+    if (_traceData.isDestroyed())
+        return QString();
+
+    QMutexLocker locker(&_traceData->mutex);
+    return _traceData->file;
+}
+
+void DTrace::clear()
+{
+    if (_traceData.isDestroyed())
+        return;
+
+    QMutexLocker locker(&_traceData->mutex);
+    for (const auto &buffer : std::as_const(_traceData->buffers)) {
+        QMutexLocker bufferLocker(&buffer->mutex);
+        buffer->events.clear();
+        buffer->dropped = 0;
+    }
+}
+
+DGUI_END_NAMESPACE
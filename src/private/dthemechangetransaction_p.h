@@ -0,0 +1,65 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#ifndef DTHEMECHANGETRANSACTION_P_H
+#define DTHEMECHANGETRANSACTION_P_H
+
+#include <dtkgui_global.h>
+
+#include <QPointer>
+#include <QSet>
+#include <QTimer>
+#include <QWindow>
+
+#include <functional>
+
+DGUI_BEGIN_NAMESPACE
+
+/*!
+ @private
+ 将一次主题切换中 DPlatformTheme 的各种属性变化（主题名、调色板、活动色）合并为一个事务,
+ 在一帧内收集到的变化只提交一次, 程序只会收到一次 applicationPaletteChanged 并重绘一次.
+ DPlatformTheme 延迟发送 paletteChanged 期间会持有事务, 调色板的变化会与其它变化一起提交.
+ */
+class DThemeChangeTransaction
+{
+public:
+    enum Change {
+        ThemeNameChange = 0x01,
+        PaletteChange = 0x02,
+        ActiveColorChange = 0x04
+    };
+    Q_DECLARE_FLAGS(Changes, Change)
+
+    // windows 为本次事务中主题发生变化的窗口
+    using Committer = std::function<void(Changes changes, const QList<QWindow *> &windows)>;
+
+    DThemeChangeTransaction();
+
+    static DThemeChangeTransaction *instance();
+
+    Committer committer() const;
+    void setCommitter(const Committer &committer);
+
+    // window 不为空时表示窗口自身的主题发生了变化
+    void addChange(Change change, QWindow *window = nullptr);
+    void hold(const QObject *holder);
+    void release(const QObject *holder);
+    bool isPending() const;
+
+private:
+    void commit();
+
+    QTimer m_timer;
+    Changes m_changes;
+    QList<QPointer<QWindow>> m_windows;
+    QSet<const QObject *> m_holders;
+    Committer m_committer;
+};
+
+DGUI_END_NAMESPACE
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(DTK_GUI_NAMESPACE::DThemeChangeTransaction::Changes)
+
+#endif // DTHEMECHANGETRANSACTION_P_H
@@ -0,0 +1,86 @@
+// SPDX-FileCopyrightText: 2022 - 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#ifndef DTHUMBNAILPROVIDER_P_H
+#define DTHUMBNAILPROVIDER_P_H
+
+#include <DObjectPrivate>
+
+#include "dthumbnailprovider.h"
+
+#include <QMimeDatabase>
+#include <QMutex>
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <QSharedPointer>
+
+#include <queue>
+
+DGUI_BEGIN_NAMESPACE
+
+class DThumbnailProviderPrivate : public DTK_CORE_NAMESPACE::DObjectPrivate
+{
+public:
+    explicit DThumbnailProviderPrivate(DThumbnailProvider *qq);
+
+    void init();
+
+    QString sizeToFilePath(DThumbnailProvider::Size size) const;
+    static bool hasThumbnailMimeType(const QString &mime);
+
+    QThreadStorage<QString> errorString;
+    // MAX
+    qint64 defaultSizeLimit = INT64_MAX;
+    QHash<QMimeType, qint64> sizeLimitHash;
+    QMimeDatabase mimeDatabase;
+
+    using ProduceKey = QPair<QString, DThumbnailProvider::Size>;
+    struct ProduceInfo
+    {
+        QFileInfo fileInfo;
+        DThumbnailProvider::Size size;
+        int priority = 0;
+        QList<DThumbnailProvider::CallBack> callbacks;
+    };
+    using ProduceInfoPointer = QSharedPointer<ProduceInfo>;
+
+    // The queue is not updated when a request is removed or its priority is raised,
+    // the outdated items are dropped when they are taken.
+    struct QueueItem
+    {
+        int priority;
+        quint64 sequence;
+        ProduceInfoPointer info;
+
+        bool operator<(const QueueItem &other) const {
+            if (priority != other.priority)
+                return priority < other.priority;
+            // First in, first out for the same priority.
+            return sequence > other.sequence;
+        }
+    };
+
+    void appendToProduceQueue(const QFileInfo &info, DThumbnailProvider::Size size,
+                              DThumbnailProvider::CallBack callback, int priority);
+    void startWorkers();
+    ProduceInfoPointer takeProduceInfo();
+    void processProduceQueue();
+
+    std::priority_queue<QueueItem> produceQueue;
+    QHash<ProduceKey, ProduceInfoPointer> pendingProduceInfos;
+    QHash<ProduceKey, ProduceInfoPointer> runningProduceInfos;
+    quint64 produceSequence = 0;
+
+    QThreadPool threadPool;
+    int activeWorkers = 0;
+    bool running = true;
+
+    mutable QMutex mutex;
+
+    D_DECLARE_PUBLIC(DThumbnailProvider)
+};
+
+DGUI_END_NAMESPACE
+
+#endif // DTHUMBNAILPROVIDER_P_H
@@ -0,0 +1,125 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#ifndef DTRACE_P_H
+#define DTRACE_P_H
+
+#include <dtkgui_global.h>
+
+#include <QAtomicInteger>
+#include <QString>
+
+#include <chrono>
+
+DGUI_BEGIN_NAMESPACE
+
+/*!
+ @private
+ dtkgui 内部热点路径的跟踪, 记录耗时区间和缓存命中/未命中计数, 导出为 Chrome trace event
+ 格式的 JSON, 可以直接在 chrome://tracing 或 Perfetto (ui.perfetto.dev) 中打开.
+
+ 设置环境变量 D_DTK_TRACE_FILE 为输出文件, 或者启用日志分类 "dtk.gui.trace" 的 debug 级别
+ (QT_LOGGING_RULES="dtk.gui.trace.debug=true", 输出到临时目录) 时开启, 程序退出时写入文件.
+ 未开启时每个跟踪点只有一次原子变量的读取.
+
+ 时间戳使用 CLOCK_MONOTONIC, 与其它使用同一时钟的跟踪数据可以对齐显示.
+ */
+class DTrace
+{
+public:
+    static inline bool isEnabled()
+    {
+        const int state = enabledState.loadAcquire();
+        return state > 0 || (state < 0 && initialize());
+    }
+    static void setEnabled(bool enabled);
+
+    static inline qint64 now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // name 和 category 必须是静态字符串
+    static void addSpan(const char *name, const char *category, qint64 start, qint64 end,
+                        const QString &detail = QString());
+    // series 为同一计数器中的不同数据, 如缓存的 "hits" 和 "misses"
+    static void addCounter(const char *name, const char *series, qint64 value);
+
+    static QByteArray toChromeTraceJson();
+    static bool writeChromeTrace(const QString &fileName);
+    static QString traceFile();
+    static void clear();
+
+private:
+    static bool initialize();
+
+    // -1: 未初始化, 0: 关闭, 1: 开启
+    static QAtomicInteger<int> enabledState;
+};
+
+// 作用域内的耗时区间
+class DTraceScope
+{
+public:
+    inline explicit DTraceScope(const char *name, const char *category = "dtkgui")
+        : m_name(name)
+        , m_category(category)
+        , m_start(DTrace::isEnabled() ? DTrace::now() : 0)
+    {
+    }
+
+    // detail 会显示在区间的参数中, 如图标名
+    inline DTraceScope(const char *name, const char *category, const QString &detail)
+        : DTraceScope(name, category)
+    {
+        if (m_start)
+            m_detail = detail;
+    }
+
+    inline ~DTraceScope()
+    {
+        if (m_start)
+            DTrace::addSpan(m_name, m_category, m_start, DTrace::now(), m_detail);
+    }
+
+private:
+    Q_DISABLE_COPY(DTraceScope)
+
+    const char *m_name;
+    const char *m_category;
+    const qint64 m_start;
+    QString m_detail;
+};
+
+// 进程内累加的计数器, 如缓存的命中和未命中次数, 每次变化都会记录到跟踪中
+class DTraceCounter
+{
+public:
+    explicit DTraceCounter(const char *name)
+        : m_name(name)
+    {
+    }
+
+    inline void add(qint64 delta = 1)
+    {
+        if (DTrace::isEnabled())
+            DTrace::addCounter(m_name, "value", m_value.fetchAndAddRelaxed(delta) + delta);
+    }
+
+private:
+    const char *m_name;
+    QAtomicInteger<qint64> m_value;
+};
+
+#define D_TRACE_CONCAT_IMPL(a, b) a##b
+#define D_TRACE_CONCAT(a, b) D_TRACE_CONCAT_IMPL(a, b)
+#define D_TRACE_SCOPE(name, ...) \
+    DTK_GUI_NAMESPACE::DTraceScope D_TRACE_CONCAT(_d_traceScope, __LINE__)(name, ##__VA_ARGS__)
+#define D_TRACE_COUNTER(var, name) \
+    static DTK_GUI_NAMESPACE::DTraceCounter var(name)
+
+DGUI_END_NAMESPACE
+
+#endif // DTRACE_P_H
@@ -0,0 +1,224 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "dcachestatistics.h"
+#include "private/dcachestatisticscounter_p.h"
+
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusError>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLoggingCategory>
+#include <QMap>
+#include <QMutex>
+#include <QPointer>
+
+DGUI_BEGIN_NAMESPACE
+
+#ifdef QT_DEBUG
+Q_LOGGING_CATEGORY(dgCacheStatistics, "dtk.gui.cachestatistics")
+#else
+Q_LOGGING_CATEGORY(dgCacheStatistics, "dtk.gui.cachestatistics", QtInfoMsg)
+#endif
+
+#define DBUS_ENV "D_DTK_CACHE_STATISTICS_DBUS"
+#define DBUS_PATH "/org/deepin/dtk/gui/CacheStatistics"
+#define DBUS_INTERFACE "org.deepin.dtk.gui.CacheStatistics"
+
+class DCacheStatisticsRegistry
+{
+public:
+    void add(DCacheStatisticsCounter *counter)
+    {
+        QMutexLocker locker(&mutex);
+        counters.append(counter);
+    }
+
+    void remove(DCacheStatisticsCounter *counter)
+    {
+        QMutexLocker locker(&mutex);
+        counters.removeOne(counter);
+    }
+
+    QList<DCacheStatistics::Cache> caches()
+    {
+        // The counters of a name are summed, the result is sorted by the name.
+        QMap<QString, DCacheStatistics::Cache> result;
+
+        QMutexLocker locker(&mutex);
+        for (DCacheStatisticsCounter *counter : std::as_const(counters)) {
+            DCacheStatistics::Cache current;
+            if (counter->m_probe) {
+                counter->m_probe(&current);
+            } else {
+                current.bytes = counter->m_bytes.loadAcquire();
+                current.entries = counter->m_entries.loadAcquire();
+            }
+
+            const QString name = QString::fromLatin1(counter->m_name);
+            auto it = result.find(name);
+            if (it == result.end()) {
+                it = result.insert(name, DCacheStatistics::Cache());
+                it->name = name;
+            }
+
+            it->hits += counter->m_hits.loadAcquire();
+            it->misses += counter->m_misses.loadAcquire();
+            it->evictions += counter->m_evictions.loadAcquire();
+            it->entries = sum(it->entries, current.entries);
+            it->bytes = sum(it->bytes, current.bytes);
+            it->maxBytes = sum(it->maxBytes, current.maxBytes);
+            it->maxEntries = sum(it->maxEntries, current.maxEntries);
+        }
+
+        return result.values();
+    }
+
+    void reset()
+    {
+        QMutexLocker locker(&mutex);
+        for (DCacheStatisticsCounter *counter : std::as_const(counters)) {
+            counter->m_hits.storeRelease(0);
+            counter->m_misses.storeRelease(0);
+            counter->m_evictions.storeRelease(0);
+        }
+    }
+
+private:
+    static inline qint64 sum(qint64 a, qint64 b)
+    {
+        if (a < 0)
+            return b;
+        return b < 0 ? a : a + b;
+    }
+
+    QMutex mutex;
+    QList<DCacheStatisticsCounter *> counters;
+};
+Q_GLOBAL_STATIC(DCacheStatisticsRegistry, _registry)
+
+DCacheStatisticsCounter::DCacheStatisticsCounter(const char *name, const Probe &probe)
+    : m_name(name)
+    , m_probe(probe)
+{
+    if (!_registry.isDestroyed())
+        _registry->add(this);
+}
+
+DCacheStatisticsCounter::~DCacheStatisticsCounter()
+{
+    if (!_registry.isDestroyed())
+        _registry->remove(this);
+}
+
+class DCacheStatisticsInterface : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", DBUS_INTERFACE)
+public:
+    explicit DCacheStatisticsInterface(QObject *parent = nullptr)
+        : QObject(parent) {}
+
+public Q_SLOTS:
+    QString Dump() const
+    {
+        return QString::fromUtf8(DCacheStatistics::toJson());
+    }
+
+    void Reset()
+    {
+        DCacheStatistics::reset();
+    }
+};
+
+QList<DCacheStatistics::Cache> DCacheStatistics::caches()
+{
+    if (_registry.isDestroyed())
+        return {};
+
+    return _registry->caches();
+}
+
+DCacheStatistics::Cache DCacheStatistics::cache(const QString &name)
+{
+    const QList<Cache> list = caches();
+    for (const Cache &cache : list) {
+        if (cache.name == name)
+            return cache;
+    }
+
+    Cache cache;
+    cache.name = name;
+    return cache;
+}
+
+QByteArray DCacheStatistics::toJson()
+{
+    QJsonArray array;
+    const QList<Cache> list = caches();
+    for (const Cache &cache : list) {
+        QJsonObject object;
+        object.insert("name", cache.name);
+        object.insert("hits", cache.hits);
+        object.insert("misses", cache.misses);
+        object.insert("evictions", cache.evictions);
+        object.insert("entries", cache.entries);
+        object.insert("bytes", cache.bytes);
+        object.insert("maxBytes", cache.maxBytes);
+        object.insert("maxEntries", cache.maxEntries);
+        const qint64 lookups = cache.hits + cache.misses;
+        object.insert("hitRate", lookups > 0 ? double(cache.hits) / lookups : 0.0);
+        array.append(object);
+    }
+
+    QJsonObject root;
+    root.insert("pid", QCoreApplication::applicationPid());
+    root.insert("application", QCoreApplication::applicationName());
+    root.insert("caches", array);
+
+    return QJsonDocument(root).toJson(QJsonDocument::Indented);
+}
+
+void DCacheStatistics::reset()
+{
+    if (!_registry.isDestroyed())
+        _registry->reset();
+}
+
+bool DCacheStatistics::registerDBusObject()
+{
+    static QPointer<DCacheStatisticsInterface> dbusObject;
+    if (dbusObject)
+        return true;
+
+    if (!qApp) {
+        qCWarning(dgCacheStatistics) << "The D-Bus object can't be registered before the application is created";
+        return false;
+    }
+
+    QDBusConnection connection = QDBusConnection::sessionBus();
+    auto object = new DCacheStatisticsInterface(qApp);
+    if (!connection.registerObject(DBUS_PATH, DBUS_INTERFACE, object, QDBusConnection::ExportAllSlots)) {
+        qCWarning(dgCacheStatistics) << "Failed to register the D-Bus object:" << connection.lastError().message();
+        delete object;
+        return false;
+    }
+
+    dbusObject = object;
+    qCInfo(dgCacheStatistics) << "The cache statistics are exported at" << connection.baseService() << DBUS_PATH;
+    return true;
+}
+
+static void registerDBusObjectByEnv()
+{
+    if (qEnvironmentVariableIsSet(DBUS_ENV))
+        DCacheStatistics::registerDBusObject();
+}
+Q_COREAPP_STARTUP_FUNCTION(registerDBusObjectByEnv)
+
+DGUI_END_NAMESPACE
+
+#include "dcachestatistics.moc"
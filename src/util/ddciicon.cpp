@@ -5,6 +5,9 @@
 #include "ddciicon.h"
 #include "dguiapplicationhelper.h"
 #include "dicontheme.h"
+#include "private/diconcachekey_p.h"
+#include "private/dcachestatisticscounter_p.h"
+#include "dtrace_p.h"
 
 #include <DObjectPrivate>
 #include <DDciFile>
@@ -17,6 +20,11 @@
 #include <QImageReader>
 #include <QtMath>
 #include <QDir>
+#include <QCache>
+#include <QMutex>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
 
 DCORE_USE_NAMESPACE
 DGUI_BEGIN_NAMESPACE
@@ -33,6 +41,9 @@ DGUI_BEGIN_NAMESPACE
 struct DDciIconEntry {
     struct ScalableLayer {
         int imagePixelRatio = 0;
+        // Same for the (file, entry, image pixel ratio) in any DDciIcon loaded from the same
+        // file version, used as the key of the decoded layers and the rasterised images.
+        quint64 cacheSerial = 0;
         struct Layer {
             int prior = 0;
             DDciIconPalette::PaletteRole role = DDciIconPalette::NoPalette;
@@ -58,6 +69,9 @@ struct DDciIconEntry {
     DDciIcon::Mode mode = DDciIcon::Normal;
     DDciIcon::Theme theme = DDciIcon::Light;
     QVector<ScalableLayer> scalableLayers;
+    // The index of the scalable layer for qCeil(devicePixelRatio), the last one
+    // is used for all of the greater ratios, see findScalableLayer.
+    QVector<int> scalableLayerIndexes;
     inline bool isNull() const { return scalableLayers.isEmpty(); }
 };
 
@@ -65,6 +79,13 @@ struct EntryNode {
     int iconSize = 0;
     qint16 maxPaddings = 0;
     QVector<DDciIconEntry *> entries;
+    // The entries and the maxPaddings are parsed from dirPath on the first use,
+    // see DDciIconPrivate::ensureNodeLoaded.
+    QString dirPath;
+    QAtomicInt loaded;
+    // The matched entries indexed by [theme][mode][DontFallbackMode], built
+    // with the entries, so matching an entry doesn't scan them.
+    DDciIconEntry *matchedEntries[2][4][2] = {};
 };
 using EntryNodeList = QVector<EntryNode>;
 
@@ -223,6 +244,7 @@ void alpha8ImageDeleter(void *image) {
 
 static QImage readImageData(QImageReader &reader, qreal pixmapScale, bool isAlpha8Format)
 {
+    D_TRACE_SCOPE("DDciIcon::readImageData", "decode");
     QImage image;
 
     if (reader.canRead()) {
@@ -253,22 +275,107 @@ static QImage readImageData(QImageReader &reader, qreal pixmapScale, bool isAlph
     return image;
 }
 
+// A .dci file mapped in memory, it's shared by all DDciIcon loaded from the same
+// file in the process. The DDciFile is parsed on the mapping, and the data of the
+// layers refers to the mapping (DDciFile::dataRef), so the encoded bytes are never
+// copied to the heap. The mapping must outlive the DDciFile and the layers, the
+// objects which use the layers keep a reference to it.
+class DDciIconMappedFile
+{
+public:
+    ~DDciIconMappedFile()
+    {
+        dciFile.reset();
+        if (data)
+            file.unmap(data);
+    }
+
+    static QSharedPointer<const DDciIconMappedFile> open(const QString &fileName);
+
+    QFile file;
+    uchar *data = nullptr;
+    qint64 size = 0;
+    QDateTime lastModified;
+    QSharedPointer<const DDciFile> dciFile;
+};
+
+class DDciIconMappedFiles
+{
+public:
+    QMutex mutex;
+    QHash<QString, QWeakPointer<const DDciIconMappedFile>> files;
+    int pruneThreshold = 256;
+};
+Q_GLOBAL_STATIC(DDciIconMappedFiles, _mappedFiles)
+
+// Returns null if the file can't be mapped, e.g. a compressed resource file.
+QSharedPointer<const DDciIconMappedFile> DDciIconMappedFile::open(const QString &fileName)
+{
+    static const bool disabled = qEnvironmentVariableIsSet("D_DTK_DCI_DISABLE_MMAP");
+    if (disabled)
+        return nullptr;
+
+    const QFileInfo info(fileName);
+    if (!info.isFile())
+        return nullptr;
+    const QString path = info.absoluteFilePath();
+
+    QMutexLocker locker(&_mappedFiles->mutex);
+    if (auto mapped = _mappedFiles->files.value(path).toStrongRef()) {
+        // The file is replaced, the icons loaded before still use the old mapping.
+        if (mapped->size == info.size() && mapped->lastModified == info.lastModified())
+            return mapped;
+    }
+
+    QSharedPointer<DDciIconMappedFile> mapped(new DDciIconMappedFile);
+    mapped->file.setFileName(path);
+    if (!mapped->file.open(QIODevice::ReadOnly))
+        return nullptr;
+    mapped->size = mapped->file.size();
+    mapped->lastModified = info.lastModified();
+    mapped->data = mapped->size > 0 ? mapped->file.map(0, mapped->size) : nullptr;
+    if (!mapped->data)
+        return nullptr;
+    // Can be closed after mapping, the mapping is valid until unmap.
+    mapped->file.close();
+    mapped->dciFile.reset(new DDciFile(QByteArray::fromRawData(reinterpret_cast<const char *>(mapped->data),
+                                                               static_cast<int>(mapped->size))));
+
+    if (_mappedFiles->files.size() >= _mappedFiles->pruneThreshold) {
+        for (auto it = _mappedFiles->files.begin(); it != _mappedFiles->files.end();) {
+            if (it.value().isNull())
+                it = _mappedFiles->files.erase(it);
+            else
+                ++it;
+        }
+        _mappedFiles->pruneThreshold = qMax(256, _mappedFiles->files.size() * 2);
+    }
+    _mappedFiles->files.insert(path, mapped);
+
+    return mapped;
+}
+
 class DDciIconImagePrivate
 {
 public:
     DDciIconImagePrivate(const DDciIconImagePrivate &other)
-        : imageSize(other.imageSize)
+        : mappedFile(other.mappedFile)
+        , imageSize(other.imageSize)
         , devicePixelRatio(other.devicePixelRatio)
         , imageScale(other.imageScale)
+        , cacheSerial(other.cacheSerial)
         , layers(other.layers)
     {
 
     }
-    DDciIconImagePrivate(qreal imageSize, qreal devicePixelRatio, qreal imageScale,
+    DDciIconImagePrivate(const QSharedPointer<const DDciIconMappedFile> &mappedFile,
+                         qreal imageSize, qreal devicePixelRatio, qreal imageScale,
                          const DDciIconEntry::ScalableLayer &sLayer)
-        : imageSize(imageSize)
+        : mappedFile(mappedFile)
+        , imageSize(imageSize)
         , devicePixelRatio(devicePixelRatio)
         , imageScale(imageScale)
+        , cacheSerial(sLayer.cacheSerial)
         , layers(sLayer.layers)
     {
     }
@@ -285,9 +392,12 @@ public:
         init();
     }
 
+    // keeps the data of the layers valid if they refer to the mapped file
+    const QSharedPointer<const DDciIconMappedFile> mappedFile;
     const qreal imageSize;
     const qreal devicePixelRatio;
     const qreal imageScale;
+    const quint64 cacheSerial;
 
     const QVector<DDciIconEntry::ScalableLayer::Layer> layers;
 
@@ -373,21 +483,26 @@ public:
 
     DDciIconPrivate(const DDciIconPrivate &other)
         : QSharedData(other)
+        , mappedFile(other.mappedFile)
         , dciFile(other.dciFile)
+        , fileAtom(other.fileAtom)
     {
     }
 
     ~DDciIconPrivate();
 
-    DDciIconEntry *loadIcon(const QString &parentDir, const QString &imageDir);
+    DDciIconEntry *loadIcon(const QString &parentDir, const QString &imageDir) const;
     void loadIconList();
     void ensureLoaded();
+    void ensureNodeLoaded(const EntryNode &node) const;
+    int findIconsByLowerBoundSize(int size, bool regardPaddingsAsSize) const;
+    int findValidNode(int index) const;
 
     DDciIconEntry *tryMatchIcon(int iconSize, DDciIcon::Theme theme, DDciIcon::Mode mode, DDciIcon::IconMatchedFlags flags = DDciIcon::None) const;
     static void paint(QPainter *painter, const QRectF &rect, Qt::Alignment alignment,
                       const QVector<DDciIconEntry::ScalableLayer::Layer> &layers,
                       QVector<DDciIconImagePrivate::ReaderData *> *layerReaders,
-                      const DDciIconPalette &palette, qreal pixmapScale);
+                      const DDciIconPalette &palette, qreal pixmapScale, quint64 cacheSerial = 0);
     static void paint(QPainter *painter, const QRect &rect, qreal devicePixelRatio, Qt::Alignment alignment,
                       const DDciIconEntry *entry, const DDciIconPalette &palette, qreal pixmapScale);
     inline static bool hasPalette(const QVector<DDciIconEntry::ScalableLayer::Layer> &layers) {
@@ -401,8 +516,17 @@ public:
         return entry && !entry->isNull();
     }
 
+    // null if the file isn't mapped, it's destroyed after the dciFile and the icons
+    QSharedPointer<const DDciIconMappedFile> mappedFile;
     QSharedPointer<const DDciFile> dciFile;
+    // The atom of the file path, last modified time and size, 0 if the icon isn't
+    // loaded from a file.
+    quint32 fileAtom = 0;
+    // Only the sizes are listed in loading, the entries of a size are parsed when the
+    // size is matched. The list is never changed after loading, the nodes are loaded
+    // with the mutex locked, so a DDciIcon can be used in multiple threads.
     EntryNodeList icons;
+    mutable QMutex nodeMutex;
 };
 
 // In Qt 6, registration of comparators, and QDebug and QDataStream streaming operators is
@@ -477,22 +601,162 @@ static QImage readImageData(const QByteArray &data, const QByteArray &format, qr
     return readImageData(reader, pixmapScale, isAlpha8Format);
 }
 
-static int findIconsByLowerBoundSize(const EntryNodeList &list, const int size, bool regardPaddingsAsSize)
+struct DDciIconLayerCacheKey {
+    quint64 serial;
+    int layerIndex;
+    qreal pixmapScale;
+};
+
+static inline bool operator==(const DDciIconLayerCacheKey &k1, const DDciIconLayerCacheKey &k2)
+{
+    return k1.serial == k2.serial && k1.layerIndex == k2.layerIndex
+            && k1.pixmapScale == k2.pixmapScale;
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+static inline size_t qHash(const DDciIconLayerCacheKey &key, size_t seed = 0)
+#else
+static inline uint qHash(const DDciIconLayerCacheKey &key, uint seed = 0)
+#endif
+{
+    return ::qHash(key.serial, seed) ^ (::qHash(key.pixmapScale) * 31 + key.layerIndex);
+}
+
+// The rasterised image of a scalable layer is identified by its serial, the DDciIcon
+// loaded again from the same file version shares the images, a replaced file never
+// matches them. The palette is compared as a whole, its hash in the icon key may collide.
+struct DDciIconImageCacheKey {
+    DIconCacheKey key;
+    DDciIconPalette palette;
+};
+
+static inline bool operator==(const DDciIconImageCacheKey &k1, const DDciIconImageCacheKey &k2)
+{
+    return k1.key == k2.key && k1.palette == k2.palette;
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+static inline size_t qHash(const DDciIconImageCacheKey &key, size_t seed = 0)
+#else
+static inline uint qHash(const DDciIconImageCacheKey &key, uint seed = 0)
+#endif
+{
+    return qHash(key.key, seed);
+}
+
+// Process wide cache of the images, bounded by bytes, it's used in any thread.
+// The limit is in kilobytes and can be changed by the environment variable.
+template<typename Key>
+class DDciIconImageCache
+{
+public:
+    DDciIconImageCache(const char *name, const char *limitEnv)
+        : statistics(name, [this](DCacheStatistics::Cache *statistics) {
+            QMutexLocker locker(&mutex);
+            statistics->bytes = cache.totalCost();
+            statistics->entries = cache.size();
+            statistics->maxBytes = cache.maxCost();
+        })
+    {
+        bool ok = false;
+        int limit = qEnvironmentVariableIntValue(limitEnv, &ok);
+        if (!ok || limit < 0)
+            limit = 10240;
+        cache.setMaxCost(limit * 1024);
+    }
+
+    bool find(const Key &key, QImage *image)
+    {
+        QMutexLocker locker(&mutex);
+        const QImage *cached = cache.object(key);
+        if (!cached) {
+            statistics.miss();
+            return false;
+        }
+        statistics.hit();
+        *image = *cached;
+        return true;
+    }
+
+    void insert(const Key &key, const QImage &image)
+    {
+        QMutexLocker locker(&mutex);
+        const int size = cache.size();
+        const bool replaced = cache.contains(key);
+        cache.insert(key, new QImage(image), static_cast<int>(image.sizeInBytes()));
+        statistics.countInsertion(size, replaced, cache.size());
+    }
+
+private:
+    QMutex mutex;
+    QCache<Key, QImage> cache;
+    // Declared last, it's unregistered before the cache is destroyed.
+    DCacheStatisticsCounter statistics;
+};
+
+// The decoded layers, the stored images are already scaled and premultiplied, the
+// palette is filled on them without decoding the layer again.
+using DDciIconLayerCache = DDciIconImageCache<DDciIconLayerCacheKey>;
+Q_GLOBAL_STATIC_WITH_ARGS(DDciIconLayerCache, _layerCache, ("dciicon.layer", "D_DTK_DCI_LAYER_CACHE_LIMIT"))
+
+// The rasterised images of DDciIcon::toImage.
+using DDciIconRasterCache = DDciIconImageCache<DDciIconImageCacheKey>;
+Q_GLOBAL_STATIC_WITH_ARGS(DDciIconRasterCache, _imageCache, ("dciicon.image", "D_DTK_DCI_IMAGE_CACHE_LIMIT"))
+
+static inline quint32 fileIdentityAtom(const QString &path, const QDateTime &lastModified, qint64 size)
+{
+    return DIconNameAtoms::atom(path + QLatin1Char('\n') + QString::number(lastModified.toMSecsSinceEpoch())
+                                + QLatin1Char('\n') + QString::number(size));
+}
+
+// The serials of the icons not loaded from a file, the high bit never appears in the
+// serials packed with the atoms.
+static inline quint64 nextLayerCacheSerial()
+{
+    static QAtomicInteger<quint64> serial(0);
+    return (quint64(1) << 63) | ++serial;
+}
+
+int DDciIconPrivate::findIconsByLowerBoundSize(const int size, bool regardPaddingsAsSize) const
 {
     const auto compFun1 = [] (const EntryNode &n1, const EntryNode &n2) {
         return n1.iconSize < n2.iconSize;
     };
-    const auto compFun2 = [] (const EntryNode &n1, const EntryNode &n2) {
+    // The paddings are known after the node is loaded, only the nodes visited
+    // by the binary search are loaded.
+    const auto compFun2 = [this] (const EntryNode &n1, const EntryNode &n2) {
+        ensureNodeLoaded(n1);
         return n1.iconSize + n1.maxPaddings < n2.iconSize + n2.maxPaddings;
     };
     EntryNode target;
     target.iconSize = size;
     target.maxPaddings = 0;
-    auto neighbor = std::lower_bound(list.cbegin(), list.cend(), target,
-                                     regardPaddingsAsSize ? compFun2 : compFun1);
+    auto neighbor = regardPaddingsAsSize
+            ? std::lower_bound(icons.cbegin(), icons.cend(), target, compFun2)
+            : std::lower_bound(icons.cbegin(), icons.cend(), target, compFun1);
+
+    if (neighbor != icons.cend())
+        return static_cast<int>(neighbor - icons.constBegin());
+    return -1;
+}
+
+// A size directory may have no valid entry, it's known after the node is loaded.
+// Prefers the node at the index or the greater sizes, then the smaller sizes,
+// returns -1 if no node has an entry.
+int DDciIconPrivate::findValidNode(int index) const
+{
+    for (int i = index; i < icons.size(); ++i) {
+        ensureNodeLoaded(icons.at(i));
+        if (!icons.at(i).entries.isEmpty())
+            return i;
+    }
+
+    for (int i = qMin(index, int(icons.size())) - 1; i >= 0; --i) {
+        ensureNodeLoaded(icons.at(i));
+        if (!icons.at(i).entries.isEmpty())
+            return i;
+    }
 
-    if (neighbor != list.cend())
-        return static_cast<int>(neighbor - list.constBegin());
     return -1;
 }
 
@@ -533,7 +797,7 @@ static inline QVector<QStringView> fromQStringList(const QStringList &list)
     return views;
 }
 
-DDciIconEntry *DDciIconPrivate::loadIcon(const QString &parentDir, const QString &imageDir)
+DDciIconEntry *DDciIconPrivate::loadIcon(const QString &parentDir, const QString &imageDir) const
 {
     // Mode-Theme
     auto props = imageDir.split(QLatin1Char('.'));
@@ -561,6 +825,8 @@ DDciIconEntry *DDciIconPrivate::loadIcon(const QString &parentDir, const QString
         DDciIconEntry::ScalableLayer scaleIcon;
         scaleIcon.imagePixelRatio = scale;
         const QString &path = joinPath(stateDir, scaleString);
+        scaleIcon.cacheSerial = fileAtom ? DIconCacheKey::pack(fileAtom, DIconNameAtoms::atom(path))
+                                         : nextLayerCacheSerial();
         for (const QString &layerPath : dciFile->list(path, true)) {
             props = layerPath.split(QLatin1Char('.'));
             const QVector<QStringView> &layerProps = fromQStringList(props);
@@ -589,19 +855,84 @@ void DDciIconPrivate::loadIconList()
         EntryNode node;
         node.iconSize = size;
         node.maxPaddings = 0;
-        const QString &dirPath = joinPath(QLatin1String(), dir);
-        for (const QString &imageDir : dciFile->list(dirPath, true)) {
-            auto icon = loadIcon(dirPath, imageDir);
-            if (!icon || icon->isNull())
-                continue;
-            icon->iconSize = size;
-            node.entries << icon;
-            node.maxPaddings = qMax(node.maxPaddings, icon->maxPaddings);
+        node.dirPath = joinPath(QLatin1String(), dir);
+        icons << std::move(node);
+    }
+}
+
+// Prefers the entry of the mode, falls back to the entry of the normal mode
+// unless DontFallbackMode, the theme must be matched.
+static DDciIconEntry *selectEntry(const EntryNode &node, DDciIcon::Theme theme, DDciIcon::Mode mode, bool dontFallbackMode)
+{
+    DDciIconEntry *fallback = nullptr;
+    for (DDciIconEntry *icon : node.entries) {
+        if (icon->theme != theme)
+            continue;
+        if (icon->mode == mode)
+            return icon;
+        if (!fallback && !dontFallbackMode && icon->mode == DDciIcon::Normal)
+            fallback = icon;
+    }
+
+    return fallback;
+}
+
+static void buildScalableLayerIndexes(DDciIconEntry *entry)
+{
+    const auto &layers = entry->scalableLayers;
+    int maxIndex = -1;
+    for (int i = 0; i < layers.size(); ++i) {
+        if (maxIndex < 0 || layers.at(i).imagePixelRatio > layers.at(maxIndex).imagePixelRatio)
+            maxIndex = i;
+    }
+    if (maxIndex < 0)
+        return;
+
+    // For each ratio, the first layer greater than it, or the first layer of the max ratio.
+    const int maxRatio = qMax(layers.at(maxIndex).imagePixelRatio, 0);
+    entry->scalableLayerIndexes.fill(maxIndex, maxRatio + 1);
+    for (int ratio = 0; ratio < maxRatio; ++ratio) {
+        for (int i = 0; i < layers.size(); ++i) {
+            if (layers.at(i).imagePixelRatio > ratio) {
+                entry->scalableLayerIndexes[ratio] = i;
+                break;
+            }
         }
-        if (node.entries.isEmpty())
+    }
+}
+
+void DDciIconPrivate::ensureNodeLoaded(const EntryNode &node) const
+{
+    if (node.loaded.loadAcquire())
+        return;
+
+    QMutexLocker locker(&nodeMutex);
+    if (node.loaded.loadAcquire())
+        return;
+
+    // The node is in the list which is never changed after loading.
+    EntryNode &n = const_cast<EntryNode &>(node);
+    for (const QString &imageDir : dciFile->list(n.dirPath, true)) {
+        auto icon = loadIcon(n.dirPath, imageDir);
+        if (!icon || icon->isNull()) {
+            delete icon;
             continue;
-        icons << std::move(node);
+        }
+        icon->iconSize = n.iconSize;
+        buildScalableLayerIndexes(icon);
+        n.entries << icon;
+        n.maxPaddings = qMax(n.maxPaddings, icon->maxPaddings);
+    }
+
+    for (int theme = DDciIcon::Light; theme <= DDciIcon::Dark; ++theme) {
+        for (int mode = DDciIcon::Normal; mode <= DDciIcon::Pressed; ++mode) {
+            for (int dontFallback = 0; dontFallback < 2; ++dontFallback) {
+                n.matchedEntries[theme][mode][dontFallback] = selectEntry(n, DDciIcon::Theme(theme),
+                                                                          DDciIcon::Mode(mode), dontFallback);
+            }
+        }
     }
+    n.loaded.storeRelease(1);
 }
 
 void DDciIconPrivate::ensureLoaded()
@@ -617,40 +948,23 @@ DDciIconEntry *DDciIconPrivate::tryMatchIcon(int iconSize, DDciIcon::Theme theme
     if (icons.isEmpty())
         return nullptr;
 
-    auto neighborIndex = findIconsByLowerBoundSize(icons, iconSize, flags & DDciIcon::RegardPaddingsAsSize);
+    auto neighborIndex = findIconsByLowerBoundSize(iconSize, flags & DDciIcon::RegardPaddingsAsSize);
     if (neighborIndex < 0) {
         neighborIndex = static_cast<int>(icons.size() - 1);
     }
 
-    const auto &listOfSize = icons.at(neighborIndex);
+    neighborIndex = findValidNode(neighborIndex);
+    if (neighborIndex < 0)
+        return nullptr;
 
-    QVector<qint8> iconWeight;
-    iconWeight.resize(listOfSize.entries.size());
-    for (int i = 0; i < listOfSize.entries.size(); ++i) {
-        qint8 weight = 0;
-        const DDciIconEntry *icon = listOfSize.entries.at(i);
-
-        if (icon->mode == mode) {
-            weight += 2;
-        } else if (flags.testFlag(DDciIcon::DontFallbackMode)
-                   || icon->mode != DDciIcon::Normal) {
-            weight = -1;
-            continue;
-        }
-        if (icon->theme == theme) {
-            weight += 1;
-        } else {
-            weight = -1;
-            continue;
-        }
+    const auto &listOfSize = icons.at(neighborIndex);
 
-        iconWeight[i] = weight;
-    }
+    const bool dontFallbackMode = flags.testFlag(DDciIcon::DontFallbackMode);
+    if (Q_LIKELY(theme >= DDciIcon::Light && theme <= DDciIcon::Dark
+                 && mode >= DDciIcon::Normal && mode <= DDciIcon::Pressed))
+        return listOfSize.matchedEntries[theme][mode][dontFallbackMode];
 
-    const auto targetIcon = std::max_element(iconWeight.constBegin(), iconWeight.constEnd());
-    if (targetIcon != iconWeight.constEnd() && *targetIcon > 0)
-        return listOfSize.entries.at(targetIcon - iconWeight.constBegin());
-    return nullptr;
+    return selectEntry(listOfSize, theme, mode, dontFallbackMode);
 }
 
 static const DDciIconEntry::ScalableLayer &findScalableLayer(const DDciIconEntry *entry, qreal devicePixelRatio)
@@ -658,6 +972,10 @@ static const DDciIconEntry::ScalableLayer &findScalableLayer(const DDciIconEntry
     const DDciIconEntry::ScalableLayer *maxLayer = nullptr;
     const int imagePixelRatio = qCeil(devicePixelRatio);
 
+    const auto &indexes = entry->scalableLayerIndexes;
+    if (Q_LIKELY(imagePixelRatio >= 0 && !indexes.isEmpty()))
+        return entry->scalableLayers.at(indexes.at(qMin(imagePixelRatio, int(indexes.size()) - 1)));
+
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
     for (const auto &i : std::as_const(entry->scalableLayers)) {
 #else
@@ -676,7 +994,7 @@ static const DDciIconEntry::ScalableLayer &findScalableLayer(const DDciIconEntry
 void DDciIconPrivate::paint(QPainter *painter, const QRectF &rect, Qt::Alignment alignment,
                             const QVector<DDciIconEntry::ScalableLayer::Layer> &layers,
                             QVector<DDciIconImagePrivate::ReaderData *> *layerReaders,
-                            const DDciIconPalette &palette, qreal pixmapScale)
+                            const DDciIconPalette &palette, qreal pixmapScale, quint64 cacheSerial)
 {
     const bool useImageReader = layerReaders && !layerReaders->isEmpty();
     Q_ASSERT(!useImageReader || layerReaders->size() == layers.size());
@@ -695,7 +1013,16 @@ void DDciIconPrivate::paint(QPainter *painter, const QRectF &rect, Qt::Alignment
         } else {
             if (layerIter->data.isEmpty())
                 continue;
-            layer = readImageData(layerIter->data, layerIter->format, pixmapScale, layerIter->isAlpha8Format);
+
+            const DDciIconLayerCacheKey key { cacheSerial, static_cast<int>(layerIter - layers.begin()), pixmapScale };
+            if (!cacheSerial || !_layerCache->find(key, &layer)) {
+                layer = readImageData(layerIter->data, layerIter->format, pixmapScale, layerIter->isAlpha8Format);
+                // Keep the premultiplied image in cache, the palette is applied on a copy of it.
+                if (!layer.isNull() && layer.format() != QImage::Format_ARGB32_Premultiplied)
+                    layer = layer.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+                if (cacheSerial && !layer.isNull())
+                    _layerCache->insert(key, layer);
+            }
         }
 
         if (layer.isNull())
@@ -754,8 +1081,9 @@ void DDciIconPrivate::paint(QPainter *painter, const QRect &rect, qreal devicePi
     if (pixelRatio <= 0)
         pixelRatio = 1.0;
 
-    auto scalableLayer = findScalableLayer(entry, devicePixelRatio);
-    paint(painter, rect, alignment, scalableLayer.layers, nullptr, palette, pixelRatio * pixmapScale / scalableLayer.imagePixelRatio);
+    const auto &scalableLayer = findScalableLayer(entry, devicePixelRatio);
+    paint(painter, rect, alignment, scalableLayer.layers, nullptr, palette,
+          pixelRatio * pixmapScale / scalableLayer.imagePixelRatio, scalableLayer.cacheSerial);
 }
 
 bool DDciIconPrivate::hasPalette(DDciIconMatchResult result) const
@@ -785,7 +1113,17 @@ DDciIcon::DDciIcon(const DDciFile *dciFile)
 DDciIcon::DDciIcon(const QString &fileName)
     : DDciIcon()
 {
-    d->dciFile.reset(new DDciFile(fileName));
+    d->mappedFile = DDciIconMappedFile::open(fileName);
+    if (d->mappedFile) {
+        d->dciFile = d->mappedFile->dciFile;
+        d->fileAtom = fileIdentityAtom(d->mappedFile->file.fileName(), d->mappedFile->lastModified,
+                                       d->mappedFile->size);
+    } else {
+        d->dciFile.reset(new DDciFile(fileName));
+        const QFileInfo info(fileName);
+        if (d->dciFile->isValid() && info.isFile())
+            d->fileAtom = fileIdentityAtom(info.absoluteFilePath(), info.lastModified(), info.size());
+    }
     d->ensureLoaded();
 }
 
@@ -817,7 +1155,8 @@ DDciIcon &DDciIcon::operator=(DDciIcon &&other) noexcept
 
 bool DDciIcon::isNull() const
 {
-    return d->icons.isEmpty();
+    // Usually only the first size is loaded.
+    return d->findValidNode(0) < 0;
 }
 
 DDciIconMatchResult DDciIcon::matchIcon(int size, Theme theme, Mode mode, IconMatchedFlags flags) const
@@ -844,7 +1183,8 @@ QList<int> DDciIcon::availableSizes(DDciIcon::Theme theme, DDciIcon::Mode mode)
     if (d->icons.isEmpty())
         return {};
     QList<int> sizes;
-    std::for_each(d->icons.begin(), d->icons.end(), [theme, mode, &sizes](const EntryNode &node) {
+    std::for_each(d->icons.cbegin(), d->icons.cend(), [this, theme, mode, &sizes](const EntryNode &node) {
+        d->ensureNodeLoaded(node);
         auto it = std::find_if(node.entries.begin(), node.entries.end(), [theme, mode](const DDciIconEntry *entry) {
             if (entry->mode == mode && entry->theme == theme)
                 return true;
@@ -891,10 +1231,46 @@ QPixmap DDciIcon::pixmap(qreal devicePixelRatio, int iconSize, DDciIcon::Theme t
 
 QPixmap DDciIcon::pixmap(qreal devicePixelRatio, int iconSize, DDciIconMatchResult result, const DDciIconPalette &palette) const
 {
-    auto image = this->image(result, iconSize, devicePixelRatio);
+    const QImage image = toImage(devicePixelRatio, iconSize, result, palette);
     if (image.isNull())
         return QPixmap();
-    return QPixmap::fromImage(image.toImage(palette));
+    return QPixmap::fromImage(image);
+}
+
+QImage DDciIcon::toImage(qreal devicePixelRatio, int iconSize, Theme theme, Mode mode, const DDciIconPalette &palette) const
+{
+    auto entry = d->tryMatchIcon(iconSize, theme, mode);
+    return toImage(devicePixelRatio, iconSize, entry, palette);
+}
+
+QImage DDciIcon::toImage(qreal devicePixelRatio, int iconSize, DDciIconMatchResult result, const DDciIconPalette &palette) const
+{
+    // The entries are never changed after the icon is loaded, and each DDciIconImage
+    // has its own readers, so it's safe to be called in multiple threads.
+    auto image = this->image(result, iconSize, devicePixelRatio);
+    if (image.isNull())
+        return QImage();
+
+    const quint64 cacheSerial = image.d->cacheSerial;
+    const DDciIconImageCacheKey key {
+        {
+            cacheSerial,
+            DIconCacheKey::pack(static_cast<quint32>(qMax(iconSize, 0)),
+                                static_cast<quint32>(qRound(devicePixelRatio * 100))),
+            DIconCacheKey::hash(palette)
+        },
+        palette
+    };
+
+    QImage rasterised;
+    if (cacheSerial && _imageCache->find(key, &rasterised))
+        return rasterised;
+
+    rasterised = image.toImage(palette);
+    if (cacheSerial && !rasterised.isNull())
+        _imageCache->insert(key, rasterised);
+
+    return rasterised;
 }
 
 void DDciIcon::paint(QPainter *painter, const QRect &rect, qreal devicePixelRatio, DDciIcon::Theme theme, DDciIcon::Mode mode,
@@ -921,7 +1297,7 @@ DDciIconImage DDciIcon::image(DDciIconMatchResult result, int size, qreal device
     if (!d->entryIsValid(entry))
         return DDciIconImage();
 
-    auto scalableLayer = findScalableLayer(entry, devicePixelRatio);
+    const auto &scalableLayer = findScalableLayer(entry, devicePixelRatio);
     int iconSize = size;
     if (iconSize <= 0)
         iconSize = entry->iconSize;
@@ -930,17 +1306,15 @@ DDciIconImage DDciIcon::image(DDciIconMatchResult result, int size, qreal device
     const qreal imageSize = (entry->maxPaddings * 2 + entry->iconSize) * pixmapScale;
     const qreal imageScale = pixmapScale * devicePixelRatio / scalableLayer.imagePixelRatio;
 
-    auto image = QSharedPointer<DDciIconImagePrivate>(new DDciIconImagePrivate(imageSize, devicePixelRatio, imageScale, scalableLayer));
+    auto image = QSharedPointer<DDciIconImagePrivate>(new DDciIconImagePrivate(d->mappedFile, imageSize, devicePixelRatio, imageScale, scalableLayer));
 
     return DDciIconImage(image);
 }
 
-DDciIcon DDciIcon::fromTheme(const QString &name)
+QString dciIconLookupName(const QString &name)
 {
     if (QDir::isAbsolutePath(name))
-        return DDciIcon(name);
-
-    DDciIcon icon;
+        return name;
 
     QString iconName = name;
     // FIX uengine appname is empty, will cause qt_assert
@@ -949,6 +1323,16 @@ DDciIcon DDciIcon::fromTheme(const QString &name)
         iconName.prepend(DSGApplication::id() + "/");
     }
 
+    return iconName;
+}
+
+// Also used by DDciIconEngine to know the file of the icon.
+QString dciIconFilePath(const QString &name)
+{
+    if (QDir::isAbsolutePath(name))
+        return name;
+
+    const QString iconName = dciIconLookupName(name);
     QString iconPath;
     QString iconThemeName =DGuiApplicationHelper::instance()->applicationTheme()->iconThemeName();
     if (auto cached = DIconTheme::cached()) {
@@ -957,10 +1341,16 @@ DDciIcon DDciIcon::fromTheme(const QString &name)
         iconPath = DIconTheme::findDciIconFile(iconName, iconThemeName);
     }
 
-    if (!iconPath.isEmpty())
-        icon = DDciIcon(iconPath);
+    return iconPath;
+}
 
-    return icon;
+DDciIcon DDciIcon::fromTheme(const QString &name)
+{
+    const QString iconPath = dciIconFilePath(name);
+    if (iconPath.isEmpty())
+        return DDciIcon();
+
+    return DDciIcon(iconPath);
 }
 
 DDciIcon DDciIcon::fromTheme(const QString &name, const DDciIcon &fallback)
@@ -1021,6 +1411,14 @@ DDciIconImage &DDciIconImage::operator=(DDciIconImage &&other) noexcept
     return *this;
 }
 
+// Returns a image which shares the data, but has its own reading state.
+DDciIconImage DDciIconImage::clone() const
+{
+    if (!d)
+        return DDciIconImage();
+    return DDciIconImage(QSharedPointer<DDciIconImagePrivate>(new DDciIconImagePrivate(*d)));
+}
+
 void DDciIconImage::reset()
 {
     if (!d)
@@ -1052,7 +1450,7 @@ QImage DDciIconImage::toImage(const DDciIconPalette &palette) const
 
 void DDciIconImage::paint(QPainter *painter, const QRectF &rect, Qt::Alignment alignment, const DDciIconPalette &palette) const
 {
-    DDciIconPrivate::paint(painter, rect, alignment, d->layers, &d->readers, palette, d->imageScale);
+    DDciIconPrivate::paint(painter, rect, alignment, d->layers, &d->readers, palette, d->imageScale, d->cacheSerial);
 }
 
 bool DDciIconImage::hasPalette() const
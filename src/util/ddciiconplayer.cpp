@@ -4,11 +4,17 @@
 
 #include "ddciiconplayer.h"
 #include "ddciicon.h"
+#include "private/dcachestatisticscounter_p.h"
 
 #include <DObjectPrivate>
 #include <QTimerEvent>
 #include <QCoreApplication>
 #include <QLoggingCategory>
+#include <QMutex>
+#include <QQueue>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QWaitCondition>
 #include <QDebug>
 
 DCORE_USE_NAMESPACE
@@ -20,17 +26,89 @@ Q_LOGGING_CATEGORY(diPlayer, "dtk.dciicon.player")
 Q_LOGGING_CATEGORY(diPlayer, "dtk.dciicon.player", QtInfoMsg)
 #endif
 
+// The frames cached by all players, they are counted by appendCachedFrame() and clearCache().
+Q_GLOBAL_STATIC_WITH_ARGS(DCacheStatisticsCounter, _frameCacheStatistics, ("dciiconplayer.frame"))
+
+// Decodes the frames of one image in a worker thread, the frames are played
+// in a loop, so the decoding continues from the first frame at the end.
+class DDciIconFrameDecoder
+{
+public:
+    struct Frame {
+        QImage image;
+        int duration = 0;
+        int frameNumber = -1;
+        // the index of the frame since the decoding started
+        int position = -1;
+    };
+
+    DDciIconFrameDecoder(const DDciIconImage &image, int imageIndex, int startFrameNumber,
+                         const DDciIconPalette &palette, int capacity)
+        : image(image)
+        , palette(palette)
+        , imageIndex(imageIndex)
+        , startFrameNumber(startFrameNumber)
+        , capacity(capacity)
+        , nextFrameNumber(startFrameNumber)
+    {}
+
+    int frameNumberAt(int position) const;
+    // Decodes until the queue is full, or until the frame at the last position is read.
+    void decode(int lastPosition = -1);
+
+    QMutex mutex;
+    QWaitCondition condition;
+    QQueue<Frame> frames;
+    // only be used in the decoding thread
+    DDciIconImage image;
+    const DDciIconPalette palette;
+    const int imageIndex;
+    const int startFrameNumber;
+    const int capacity;
+
+    int nextFrameNumber;
+    int nextPosition = 0;
+    // the frames before this position are not needed to compose
+    int consumedPosition = 0;
+    int frameCount = -1;
+    bool running = false;
+    bool canceled = false;
+};
+
+class DDciIconFrameDecodeWorker : public QRunnable
+{
+public:
+    explicit DDciIconFrameDecodeWorker(const QSharedPointer<DDciIconFrameDecoder> &decoder)
+        : decoder(decoder) {}
+
+    void run() override {
+        decoder->decode();
+    }
+
+private:
+    QSharedPointer<DDciIconFrameDecoder> decoder;
+};
+
 class DDciIconImagePlayerPrivate : DObjectPrivate
 {
 public:
     DDciIconImagePlayerPrivate(DDciIconImagePlayer *qq)
         : DObjectPrivate(qq) {}
+    ~DDciIconImagePlayerPrivate();
 
     bool initCurrent();
     bool ensureCurrent();
+    void appendCachedFrame(int imageIndex, const QImage &image, int duration);
     void clearCache();
     void setState(DDciIconImagePlayer::State newState);
 
+    void updateDecoder(bool advanced);
+    void stopDecoder();
+    void scheduleDecode();
+    bool decodeInCurrentThread(int position);
+    bool takeDecodedFrame(int position, DDciIconFrameDecoder::Frame *frame);
+    int waitDecodedFrameNumber(int position);
+
     inline bool reversed() const {
         return flags.testFlag(DDciIconImagePlayer::InvertedOrder);
     }
@@ -70,6 +148,11 @@ public:
         return cachedFrames[current];
     }
 
+    QSharedPointer<DDciIconFrameDecoder> decoder;
+    int preDecodeFrameCount = 3;
+    // the position of the current frame in the decoder
+    int decodePosition = 0;
+
     int timerId = 0;
     // loop count for all images sequential animation, init from "userLoopCount" when start
     int loopCount = 1;
@@ -91,6 +174,67 @@ inline static bool jumpImageTo(DDciIconImage &image, int number)
     return true;
 }
 
+int DDciIconFrameDecoder::frameNumberAt(int position) const
+{
+    const int number = startFrameNumber + position;
+    if (frameCount <= 0 || number < frameCount)
+        return number;
+    return (number - frameCount) % frameCount;
+}
+
+void DDciIconFrameDecoder::decode(int lastPosition)
+{
+    QMutexLocker locker(&mutex);
+    while (!canceled && frames.size() < capacity && (lastPosition < 0 || nextPosition <= lastPosition)) {
+        const int position = nextPosition;
+        // Still needs to read the skipped frames, the image can only be read sequentially.
+        const bool skip = position < consumedPosition;
+        int frameNumber = nextFrameNumber;
+        locker.unlock();
+
+        Frame frame;
+        bool ok = jumpImageTo(image, frameNumber);
+        if (!ok && frameNumber > 0) {
+            // Publish the end of the image before decoding the first frame again.
+            locker.relock();
+            frameCount = frameNumber;
+            condition.wakeAll();
+            locker.unlock();
+
+            frameNumber = 0;
+            ok = jumpImageTo(image, frameNumber);
+        }
+        // Loads the image again if it's reset by jumping back.
+        ok = ok && image.supportsAnimation();
+        if (ok && !skip) {
+            frame.image = image.toImage(palette);
+            frame.duration = image.currentImageDuration();
+            frame.frameNumber = frameNumber;
+            frame.position = position;
+        }
+
+        locker.relock();
+        if (!ok) {
+            canceled = true;
+            break;
+        }
+        nextFrameNumber = frameNumber + 1;
+        ++nextPosition;
+        if (!skip)
+            frames.enqueue(frame);
+        condition.wakeAll();
+    }
+
+    running = false;
+    condition.wakeAll();
+}
+
+DDciIconImagePlayerPrivate::~DDciIconImagePlayerPrivate()
+{
+    stopDecoder();
+    clearCache();
+}
+
 bool DDciIconImagePlayerPrivate::initCurrent()
 {
     if (!currentImage().supportsAnimation())
@@ -143,8 +287,27 @@ bool DDciIconImagePlayerPrivate::ensureCurrent()
     return false;
 }
 
+void DDciIconImagePlayerPrivate::appendCachedFrame(int imageIndex, const QImage &image, int duration)
+{
+    cachedFrames[imageIndex].append({image, duration});
+    if (!_frameCacheStatistics.isDestroyed())
+        _frameCacheStatistics->addEntries(1, image.sizeInBytes());
+}
+
 void DDciIconImagePlayerPrivate::clearCache()
 {
+    if (!_frameCacheStatistics.isDestroyed()) {
+        qint64 entries = 0, bytes = 0;
+        for (const auto &frames : std::as_const(cachedFrames)) {
+            for (const auto &frame : frames) {
+                ++entries;
+                bytes += frame.image.sizeInBytes();
+            }
+        }
+        if (entries > 0)
+            _frameCacheStatistics->addEntries(-entries, -bytes);
+    }
+
     cachedFrames.clear();
 }
 
@@ -156,6 +319,129 @@ void DDciIconImagePlayerPrivate::setState(DDciIconImagePlayer::State newState)
     Q_EMIT q_func()->stateChanged();
 }
 
+void DDciIconImagePlayerPrivate::updateDecoder(bool advanced)
+{
+    // The inverted order animation always caches all frames.
+    if (!flags.testFlag(DDciIconImagePlayer::PreDecode) || reversed() || currentHasCache()) {
+        stopDecoder();
+        return;
+    }
+
+    if (decoder && decoder->imageIndex == current) {
+        if (advanced)
+            ++decodePosition;
+        QMutexLocker locker(&decoder->mutex);
+        if (decoder->frameNumberAt(decodePosition) == currentFrameNumber) {
+            decoder->consumedPosition = decodePosition;
+            scheduleDecode();
+            return;
+        }
+    }
+
+    stopDecoder();
+    // The image is read in the worker thread, it can't share the reading state.
+    decoder.reset(new DDciIconFrameDecoder(currentImage().clone(), current, currentFrameNumber,
+                                           palette, preDecodeFrameCount));
+    decodePosition = 0;
+    QMutexLocker locker(&decoder->mutex);
+    scheduleDecode();
+}
+
+void DDciIconImagePlayerPrivate::stopDecoder()
+{
+    if (!decoder)
+        return;
+
+    // The worker may still hold the decoder, it will quit after the current frame.
+    QMutexLocker locker(&decoder->mutex);
+    decoder->canceled = true;
+    decoder->frames.clear();
+    locker.unlock();
+    decoder.reset();
+}
+
+void DDciIconImagePlayerPrivate::scheduleDecode()
+{
+    // The decoder's mutex must be locked by the caller.
+    if (decoder->running || decoder->canceled || decoder->frames.size() >= decoder->capacity)
+        return;
+
+    auto worker = new DDciIconFrameDecodeWorker(decoder);
+    decoder->running = true;
+    // Don't wait for a free thread, the frame is read in the current thread if no worker runs.
+    if (!QThreadPool::globalInstance()->tryStart(worker)) {
+        decoder->running = false;
+        delete worker;
+    }
+}
+
+// The decoder's mutex must be locked by the caller, it's unlocked while decoding.
+// The decoder's image is already at the frame before the position, reading it
+// in the current thread doesn't replay the image from the first frame.
+bool DDciIconImagePlayerPrivate::decodeInCurrentThread(int position)
+{
+    if (decoder->running || decoder->canceled)
+        return false;
+
+    const int nextPosition = decoder->nextPosition;
+    decoder->running = true;
+    decoder->mutex.unlock();
+    decoder->decode(position);
+    decoder->mutex.lock();
+    return decoder->nextPosition > nextPosition;
+}
+
+bool DDciIconImagePlayerPrivate::takeDecodedFrame(int position, DDciIconFrameDecoder::Frame *frame)
+{
+    if (!decoder)
+        return false;
+
+    QMutexLocker locker(&decoder->mutex);
+    Q_FOREVER {
+        auto &frames = decoder->frames;
+        while (!frames.isEmpty() && frames.head().position < position)
+            frames.dequeue();
+
+        if (!frames.isEmpty() && frames.head().position == position) {
+            *frame = frames.dequeue();
+            scheduleDecode();
+            return true;
+        }
+
+        // The frame is skipped.
+        if (decoder->nextPosition > position)
+            return false;
+        scheduleDecode();
+        if (decoder->running) {
+            decoder->condition.wait(&decoder->mutex);
+        } else if (!decodeInCurrentThread(position)) {
+            // The image can't be read any more, or the queue is full of other frames.
+            return false;
+        }
+    }
+}
+
+// Returns -1 if it's unknown, the frame number is known when the decoder
+// has read the frame or has reached the end of the image.
+int DDciIconImagePlayerPrivate::waitDecodedFrameNumber(int position)
+{
+    if (!decoder)
+        return -1;
+
+    QMutexLocker locker(&decoder->mutex);
+    Q_FOREVER {
+        if (decoder->frameCount >= 0 || decoder->nextPosition > position)
+            return decoder->frameNumberAt(position);
+
+        scheduleDecode();
+        if (decoder->running) {
+            decoder->condition.wait(&decoder->mutex);
+        } else if (!decodeInCurrentThread(position)) {
+            return -1;
+        }
+    }
+}
+
 DDciIconImagePlayer::DDciIconImagePlayer(QObject *parent)
     : QObject(parent)
     , DObject(*new DDciIconImagePlayerPrivate(this))
@@ -222,6 +508,11 @@ bool DDciIconImagePlayer::setPalette(const DDciIconPalette &palette)
         d->clearCache();
     } else {
         d->flags |= ClearCacheOnStop;
+        // The decoded frames are not using the new palette.
+        if (d->decoder) {
+            d->stopDecoder();
+            d->updateDecoder(false);
+        }
     }
 
     return true;
@@ -262,6 +553,20 @@ void DDciIconImagePlayer::abortLoop()
     d->loopCount = 0;
 }
 
+void DDciIconImagePlayer::setPreDecodeFrameCount(int count)
+{
+    D_D(DDciIconImagePlayer);
+    if (count <= 0)
+        return;
+    d->preDecodeFrameCount = count;
+}
+
+int DDciIconImagePlayer::preDecodeFrameCount() const
+{
+    D_DC(DDciIconImagePlayer);
+    return d->preDecodeFrameCount;
+}
+
 QImage DDciIconImagePlayer::readImage()
 {
     D_D(DDciIconImagePlayer);
@@ -273,18 +578,31 @@ QImage DDciIconImagePlayer::readImage()
     int timerIntervel = 0;
 
     if (d->currentHasCache()) {
+        _frameCacheStatistics->hit();
         image = d->currentCache().at(d->currentFrameNumber).image;
         timerIntervel = qRound(d->currentCache().at(d->currentFrameNumber).duration / d->speed);
     } else {
         Q_ASSERT(!d->reversed());
-        Q_ASSERT(d->currentImage().currentImageNumber() == d->currentFrameNumber);
-        image = d->currentImage().toImage(d->palette);
-        if (d->flags & CacheAll) {
+        DDciIconFrameDecoder::Frame frame;
+        int duration = 0;
+        if (d->takeDecodedFrame(d->decodePosition, &frame)) {
+            Q_ASSERT(frame.frameNumber == d->currentFrameNumber);
+            image = frame.image;
+            duration = frame.duration;
+        } else {
+            // Only if the decoder failed, the image isn't moved forward when the frames
+            // are decoded by the decoder, so it's read from the first frame again.
+            jumpImageTo(d->currentImage(), d->currentFrameNumber);
             Q_ASSERT(d->currentImage().currentImageNumber() == d->currentFrameNumber);
+            image = d->currentImage().toImage(d->palette);
+            duration = d->currentImage().currentImageDuration();
+        }
+        if (d->flags & CacheAll) {
             Q_ASSERT(d->currentCache().size() == d->currentFrameNumber);
-            d->currentCache().append({image, d->currentImage().currentImageDuration()});
+            _frameCacheStatistics->miss();
+            d->appendCachedFrame(d->current, image, duration);
         }
-        timerIntervel = qRound(d->currentImage().currentImageDuration() / d->speed);
+        timerIntervel = qRound(duration / d->speed);
     }
 
     d->timerId = startTimer(timerIntervel < 0 ? 0 : timerIntervel);
@@ -339,7 +657,7 @@ bool DDciIconImagePlayer::start(float speed, Flags flags)
                 image.reset();
 
                 do {
-                    d->cachedFrames[i].append({image.toImage(d->palette), image.currentImageDuration()});
+                    d->appendCachedFrame(i, image.toImage(d->palette), image.currentImageDuration());
                 } while (image.jumpToNextImage());
             }
         } else if (!flags.testFlag(Continue)) {
@@ -347,7 +665,7 @@ bool DDciIconImagePlayer::start(float speed, Flags flags)
             if (image.supportsAnimation()
                     && jumpImageTo(image, d->cachedFrames.last().size())) {
                 do {
-                    d->cachedFrames.last().append({image.toImage(d->palette), image.currentImageDuration()});
+                    d->appendCachedFrame(d->cachedFrames.size() - 1, image.toImage(d->palette), image.currentImageDuration());
                 } while (image.jumpToNextImage());
             }
 
@@ -359,7 +677,7 @@ bool DDciIconImagePlayer::start(float speed, Flags flags)
 
                 image.reset();
                 do {
-                    d->cachedFrames[i].append({image.toImage(d->palette), image.currentImageDuration()});
+                    d->appendCachedFrame(i, image.toImage(d->palette), image.currentImageDuration());
                 } while (image.jumpToNextImage());
             }
 
@@ -383,7 +701,7 @@ bool DDciIconImagePlayer::start(float speed, Flags flags)
                 image.reset();
 
                 do {
-                    d->cachedFrames[d->current].append({image.toImage(d->palette), image.currentImageDuration()});
+                    d->appendCachedFrame(d->current, image.toImage(d->palette), image.currentImageDuration());
                 } while (image.jumpToNextImage());
             }
         }
@@ -394,6 +712,7 @@ bool DDciIconImagePlayer::start(float speed, Flags flags)
 
     if (!d->ensureCurrent())
         return false;
+    d->updateDecoder(false);
     d->setState(WaitingRead);
     Q_EMIT started();
     Q_EMIT updated();
@@ -411,6 +730,7 @@ void DDciIconImagePlayer::stop()
         d->timerId = 0;
     }
 
+    d->stopDecoder();
     if (d->flags & ClearCacheOnStop)
         d->clearCache();
 
@@ -429,8 +749,12 @@ void DDciIconImagePlayer::timerEvent(QTimerEvent *event)
     bool finished = false;
     const int newFrameNumber =  d->currentFrameNumber + (d->reversed() ? -1 : 1);
     if (!d->hasCache(d->current, newFrameNumber)) {
+        int decodedFrameNumber = -1;
         if (d->reversed()) {
             finished = true;
+        } else if ((decodedFrameNumber = d->waitDecodedFrameNumber(d->decodePosition + 1)) >= 0) {
+            // The decoder continues from the first frame at the end of the image.
+            finished = decodedFrameNumber != newFrameNumber;
         } else {
             finished = !jumpImageTo(d->currentImage(), newFrameNumber);
         }
@@ -470,6 +794,7 @@ void DDciIconImagePlayer::timerEvent(QTimerEvent *event)
         stop();
         Q_EMIT this->finished();
     } else {
+        d->updateDecoder(true);
         d->setState(WaitingRead);
         Q_EMIT updated();
     }
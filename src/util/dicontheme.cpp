@@ -3,9 +3,15 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include "dicontheme.h"
+#include "dguiapplicationhelper.h"
+#include "dplatformtheme.h"
 #include "private/dbuiltiniconengine_p.h"
 #include "private/dciiconengine_p.h"
 #include "private/diconproxyengine_p.h"
+#include "private/ddciiconthemeindex_p.h"
+#include "private/diconcachekey_p.h"
+#include "private/dcachestatisticscounter_p.h"
+#include "dtrace_p.h"
 #include <private/qicon_p.h>
 #ifndef DTK_DISABLE_LIBXDG
 #include "private/xdgiconproxyengine_p.h"
@@ -21,6 +27,8 @@
 #include <QSet>
 #include <QGuiApplication>
 #include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QDeadlineTimer>
 #include <QDir>
 
 DGUI_BEGIN_NAMESPACE
@@ -57,15 +65,23 @@ static inline QString applicationBuiltInIconPath()
     return QLatin1String(":/dsg/built-in-icons");
 }
 
-static QString findDciIconFromPath(const QString &iconName, const QString &themeName, const QString path)
+// If the directories are \a watched, the index is checked once in a generation, and a
+// lookup in an indexed theme is a hash probe without stat().
+static QString findDciIconFromPath(const QString &iconName, const QString &themeName, const QString path,
+                                   bool watched)
 {
     if (path.isEmpty() || iconName.isEmpty())
         return nullptr;
 
     QString themePath = joinPath(path, themeName);
-    QFileInfo themeInfo(themePath);
-    if (!themeInfo.exists() || !themeInfo.isDir())
-        return nullptr;
+    // Prefer the prebuilt index of the theme directory, it avoids the stat() of the missing icons.
+    const auto index = DDciIconThemeIndex::cached(themePath, watched);
+    QFileInfo themeInfo;
+    if (!index) {
+        themeInfo.setFile(themePath);
+        if (!themeInfo.exists() || !themeInfo.isDir())
+            return nullptr;
+    }
 
     /*
      *  iconName has two types, like as:
@@ -82,7 +98,18 @@ static QString findDciIconFromPath(const QString &iconName, const QString &theme
     if (!QDir::cleanPath(iconPath).startsWith(QDir::cleanPath(themePath)))  // Wrongful
         return nullptr;
 
+    // Any change in the theme and group directories bumps the generation and drops the index,
+    // the deeper directories aren't watched.
+    if (index && watched && iconName.count(QLatin1Char('/')) <= 1)
+        return index->contains(iconName) ? iconPath : nullptr;
+
     QFileInfo iconInfo(iconPath);
+    // The index only answers for the directory not modified after it's generated, the
+    // icons installed later are looked up by stat(). An indexed icon is checked too, it
+    // may be removed or be a dangling symlink.
+    if (index && index->isUpToDate(iconInfo.path()) && !index->contains(iconName))
+        return nullptr;
+
     if (iconInfo.exists() && iconInfo.isFile())
         return iconPath;
 
@@ -113,6 +140,68 @@ QIcon DIconTheme::findQIcon(const QString &iconName, const QIcon &fallback, Opti
     return !icon.isNull() ? icon : fallback;
 }
 
+static inline void rasterisePixmap(const QIcon &icon, const QSize &size, qreal devicePixelRatio)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    icon.pixmap(size, devicePixelRatio);
+#else
+    // QIcon::pixmap always uses the device pixel ratio of the application.
+    Q_UNUSED(devicePixelRatio);
+    icon.pixmap(size);
+#endif
+}
+
+void DIconTheme::prefetch(const QStringList &iconNames, const QList<QSize> &sizes,
+                          const QList<qreal> &devicePixelRatios, Options options)
+{
+    if (!qApp || iconNames.isEmpty() || sizes.isEmpty())
+        return;
+
+    QList<qreal> ratios = devicePixelRatios;
+    if (ratios.isEmpty())
+        ratios.append(qApp->devicePixelRatio());
+
+    // DDciIconEngine caches the pixmaps by the sizes in device pixels.
+    QList<int> deviceSizes;
+    for (const QSize &size : sizes) {
+        for (qreal ratio : ratios) {
+            const int s = qRound(qMin(size.width(), size.height()) * ratio);
+            if (s > 0 && !deviceSizes.contains(s))
+                deviceSizes.append(s);
+        }
+    }
+
+    // The icons are created in the gui thread, DIconTheme::Cached isn't thread safe.
+    // The other icons than dci are rasterised in the gui thread too, the xdg and the
+    // builtin engines depend on QIconLoader, it can only be used in the gui thread.
+    auto resolve = [sizes, ratios, options](const QString &iconName, bool rasterise) {
+        const QIcon icon = DIconTheme::cached()->findQIcon(iconName, options);
+        if (!rasterise || icon.isNull())
+            return;
+
+        for (const QSize &size : sizes) {
+            for (qreal ratio : ratios)
+                rasterisePixmap(icon, size, ratio);
+        }
+    };
+
+    for (const QString &iconName : iconNames) {
+        if (iconName.isEmpty())
+            continue;
+
+        if (options.testFlag(IgnoreDciIcons) || QDir::isAbsolutePath(iconName)) {
+            QMetaObject::invokeMethod(qApp, [resolve, iconName] {
+                resolve(iconName, true);
+            }, Qt::QueuedConnection);
+            continue;
+        }
+
+        DDciIconEngine::prefetch(iconName, deviceSizes, [resolve, iconName](bool found) {
+            resolve(iconName, !found);
+        });
+    }
+}
+
 bool DIconTheme::isBuiltinIcon(const QIcon &icon)
 {
     if (icon.isNull())
@@ -140,11 +229,152 @@ bool DIconTheme::isXdgIcon(const QIcon &icon)
 #endif
 }
 
+// The generation is bumped when the result of the icon lookup may be changed,
+// a cached entry of an older generation is looked up again. The changes of the
+// dci search paths are watched by inotify, only the search paths, the theme
+// directories and the group directories (e.g. "org.deepin.app") in them are
+// watched. For the xdg icons, only the search paths and the theme directories
+// are watched, a new theme or an updated icon-theme.cache is noticed, but not
+// an icon added to a size directory.
+class DIconThemeGeneration : public QObject
+{
+public:
+    DIconThemeGeneration();
+
+    inline quint64 value() const {
+        return generation.loadAcquire();
+    }
+    inline bool isWatching() const {
+        return watcher;
+    }
+    void bump();
+    void watchSearchPaths();
+
+private:
+    QAtomicInteger<quint64> generation { 1 };
+    QFileSystemWatcher *watcher = nullptr;
+};
+Q_GLOBAL_STATIC(DIconThemeGeneration, _themeGeneration)
+
+DIconThemeGeneration::DIconThemeGeneration()
+{
+    // The watcher needs an event loop, it's not available without the application.
+    if (!QCoreApplication::instance())
+        return;
+
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, &QFileSystemWatcher::directoryChanged, this, [this] {
+        bump();
+        // The new theme directories need to be watched.
+        watchSearchPaths();
+    });
+    watchSearchPaths();
+
+    // Avoid creating DGuiApplicationHelper in the lookup of an icon.
+    QMetaObject::invokeMethod(this, [this] {
+        connect(DGuiApplicationHelper::instance()->applicationTheme(), &DPlatformTheme::iconThemeNameChanged,
+                this, &DIconThemeGeneration::bump);
+    }, Qt::QueuedConnection);
+}
+
+void DIconThemeGeneration::bump()
+{
+    generation.fetchAndAddOrdered(1);
+    // The index is opened again to check if it's out of date.
+    DDciIconThemeIndex::clearCache();
+}
+
+void DIconThemeGeneration::watchSearchPaths()
+{
+    if (!watcher)
+        return;
+
+    QStringList dirs;
+    const auto searchPaths = DIconTheme::dciThemeSearchPaths();
+    for (const QString &path : searchPaths) {
+        // The resource files are never changed.
+        if (path.startsWith(QLatin1Char(':')) || !QFileInfo(path).isDir())
+            continue;
+        dirs << path;
+        const auto themes = QDir(path).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+        for (const QString &theme : themes) {
+            const QString themePath = joinPath(path, theme);
+            dirs << themePath;
+            const auto groups = QDir(themePath).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+            for (const QString &group : groups)
+                dirs << joinPath(themePath, group);
+        }
+    }
+
+    // QIcon needs the platform theme to get the xdg search paths.
+    if (qobject_cast<QGuiApplication *>(QCoreApplication::instance())) {
+        const auto xdgSearchPaths = QIcon::themeSearchPaths() + QIcon::fallbackSearchPaths();
+        for (const QString &path : xdgSearchPaths) {
+            if (path.startsWith(QLatin1Char(':')) || !QFileInfo(path).isDir())
+                continue;
+            dirs << path;
+            const auto themes = QDir(path).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+            for (const QString &theme : themes)
+                dirs << joinPath(path, theme);
+        }
+    }
+
+    const QStringList watchedDirs = watcher->directories();
+    const QSet<QString> newDirs(dirs.cbegin(), dirs.cend());
+    const QSet<QString> oldDirs(watchedDirs.cbegin(), watchedDirs.cend());
+    const QStringList removedDirs = (oldDirs - newDirs).values();
+    const QStringList addedDirs = (newDirs - oldDirs).values();
+    if (!removedDirs.isEmpty())
+        watcher->removePaths(removedDirs);
+    if (!addedDirs.isEmpty())
+        watcher->addPaths(addedDirs);
+}
+
+// in milliseconds
+#define ICON_MISS_TIMEOUT 10000
+
 class DIconTheme::CachedData
 {
 public:
-    QCache<QString, QIcon> cache;
-    QCache<QString, QString> dciIconPathCache;
+    // The misses are cached too, as a null icon or an empty path. The missing dci
+    // icons are noticed by the generation, but the xdg icons aren't fully watched,
+    // so a null icon expires after a while.
+    struct Icon {
+        QIcon icon;
+        quint64 generation;
+        QDeadlineTimer expiry;
+    };
+    struct IconPath {
+        QString path;
+        quint64 generation;
+    };
+
+    static inline DIconCacheKey cacheKey(const QString &themeName, const QString &iconName, int options = 0) {
+        return { DIconCacheKey::pack(DIconNameAtoms::atom(themeName), DIconNameAtoms::atom(iconName)),
+                 static_cast<quint64>(options), 0 };
+    }
+
+    template<typename T>
+    static void insert(QCache<DIconCacheKey, T> &cache, const DIconCacheKey &key, T *object,
+                       DCacheStatisticsCounter &statistics) {
+        const int size = cache.size();
+        const bool replaced = cache.contains(key);
+        cache.insert(key, object);
+        statistics.countInsertion(size, replaced, cache.size());
+    }
+
+    QCache<DIconCacheKey, Icon> cache;
+    QCache<DIconCacheKey, IconPath> dciIconPathCache;
+
+    // The caches aren't thread safe, the statistics are queried in the GUI thread too.
+    DCacheStatisticsCounter iconStatistics { "icontheme.cached.icon", [this](DCacheStatistics::Cache *statistics) {
+        statistics->entries = cache.size();
+        statistics->maxEntries = cache.maxCost();
+    }};
+    DCacheStatisticsCounter dciIconPathStatistics { "icontheme.cached.dcipath", [this](DCacheStatistics::Cache *statistics) {
+        statistics->entries = dciIconPathCache.size();
+        statistics->maxEntries = dciIconPathCache.maxCost();
+    }};
 };
 
 DIconTheme::Cached::Cached()
@@ -178,42 +408,42 @@ void DIconTheme::Cached::clear()
 QIcon DIconTheme::Cached::findQIcon(const QString &iconName, Options options, const QIcon &fallback)
 {
     const QString themeName = QIcon::themeName();
-    const QString cacheKey = themeName + QChar('/') + iconName + QChar('/') + QString::number(static_cast<int>(options));
-    if (data->cache.contains(cacheKey)) {
-        auto cacheIcon = data->cache.object(cacheKey);
-        if (cacheIcon->isNull())
-            return fallback;
-        return *cacheIcon;
+    const DIconCacheKey cacheKey = CachedData::cacheKey(themeName, iconName, static_cast<int>(options));
+    const quint64 generation = _themeGeneration->value();
+    if (auto cacheIcon = data->cache.object(cacheKey)) {
+        if (cacheIcon->generation == generation && !cacheIcon->expiry.hasExpired()) {
+            data->iconStatistics.hit();
+            return cacheIcon->icon.isNull() ? fallback : cacheIcon->icon;
+        }
     }
 
-    auto newIcon = new QIcon(DIconTheme::findQIcon(iconName, options));
-
-    if (newIcon->isNull()) {
-        return fallback;
-    } else {
-        data->cache.insert(cacheKey, newIcon);
-    }
+    data->iconStatistics.miss();
+    const QIcon icon = DIconTheme::findQIcon(iconName, options);
+    auto newIcon = new CachedData::Icon { icon, generation,
+                                          icon.isNull() ? QDeadlineTimer(ICON_MISS_TIMEOUT)
+                                                        : QDeadlineTimer(QDeadlineTimer::Forever) };
+    CachedData::insert(data->cache, cacheKey, newIcon, data->iconStatistics);
 
-    return *newIcon;
+    return icon.isNull() ? fallback : icon;
 }
 
 QString DIconTheme::Cached::findDciIconFile(const QString &iconName, const QString &themeName, const QString &fallback)
 {
-    const QString cacheKey = themeName + QLatin1Char('/') + iconName;
-    if (data->dciIconPathCache.contains(cacheKey)) {
-        const QString *cachePath = data->dciIconPathCache.object(cacheKey);
-        if (cachePath->isEmpty())
-            return fallback;
-        return *cachePath;
+    const DIconCacheKey cacheKey = CachedData::cacheKey(themeName, iconName);
+    const quint64 generation = _themeGeneration->value();
+    if (auto cachePath = data->dciIconPathCache.object(cacheKey)) {
+        if (cachePath->generation == generation) {
+            data->dciIconPathStatistics.hit();
+            return cachePath->path.isEmpty() ? fallback : cachePath->path;
+        }
     }
 
-    QString *path = new QString(DIconTheme::findDciIconFile(iconName, themeName));
-    data->dciIconPathCache.insert(cacheKey, path);
-
-    if (path->isEmpty())
-        return fallback;
+    data->dciIconPathStatistics.miss();
+    auto newPath = new CachedData::IconPath { DIconTheme::findDciIconFile(iconName, themeName), generation };
+    const QString path = newPath->path;
+    CachedData::insert(data->dciIconPathCache, cacheKey, newPath, data->dciIconPathStatistics);
 
-    return *path;
+    return path.isEmpty() ? fallback : path;
 }
 
 static inline QStringList getDciThemePaths() {
@@ -243,6 +473,8 @@ QString DIconTheme::findDciIconFile(const QString &iconName, const QString &them
     if (iconName.isEmpty())
         return nullptr;
 
+    D_TRACE_SCOPE("DIconTheme::findDciIconFile", "icon", iconName);
+
     const QString cleanIconName = QDir::cleanPath(iconName);
     if (iconName.startsWith('/') || iconName.endsWith('/')
             || cleanIconName.length() != iconName.length()
@@ -265,9 +497,11 @@ QString DIconTheme::findDciIconFile(const QString &iconName, const QString &them
 
     // "qrc:/dsg/built-in-icons/accounts.dci" // fallback to built-in icons
 
+    // Don't create the watcher here, it may be called in a worker thread.
+    const bool watched = _themeGeneration.exists() && _themeGeneration->isWatching();
     const auto &searchPaths = DIconTheme::dciThemeSearchPaths();
     for (const QString &themePath : searchPaths) {
-        QString iconPath = findDciIconFromPath(effectiveIconName, themeName, themePath);
+        QString iconPath = findDciIconFromPath(effectiveIconName, themeName, themePath, watched);
         if (!iconPath.isEmpty())
             return iconPath;
     }
@@ -276,7 +510,7 @@ QString DIconTheme::findDciIconFile(const QString &iconName, const QString &them
         effectiveIconName = iconName.mid(splitCharPos + 1);
         Q_ASSERT(!effectiveIconName.isEmpty());
         for (const QString &themePath : searchPaths) {
-            QString iconPath = findDciIconFromPath(effectiveIconName, themeName, themePath);
+            QString iconPath = findDciIconFromPath(effectiveIconName, themeName, themePath, watched);
             if (!iconPath.isEmpty())
                 return iconPath;
         }
@@ -284,12 +518,12 @@ QString DIconTheme::findDciIconFile(const QString &iconName, const QString &them
 
     // fallback to without theme directory
     for (const QString &themePath : searchPaths) {
-        QString iconPath = findDciIconFromPath(effectiveIconName, nullptr, themePath);
+        QString iconPath = findDciIconFromPath(effectiveIconName, nullptr, themePath, watched);
         if (!iconPath.isEmpty())
             return iconPath;
     }
 
-    return findDciIconFromPath(effectiveIconName, nullptr, applicationBuiltInIconPath());
+    return findDciIconFromPath(effectiveIconName, nullptr, applicationBuiltInIconPath(), watched);
 }
 
 QStringList DIconTheme::dciThemeSearchPaths()
@@ -300,6 +534,12 @@ QStringList DIconTheme::dciThemeSearchPaths()
 void DIconTheme::setDciThemeSearchPaths(const QStringList &path)
 {
     *_dciThemePath = path;
+    if (_themeGeneration.exists()) {
+        _themeGeneration->bump();
+        _themeGeneration->watchSearchPaths();
+    } else {
+        DDciIconThemeIndex::clearCache();
+    }
 }
 
 DGUI_END_NAMESPACE
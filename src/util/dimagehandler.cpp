@@ -12,9 +12,17 @@
 #include <QFileInfo>
 #include <QImageReader>
 #include <QPainter>
+#include <QMutex>
+#include <QAtomicInteger>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <QVector>
 
 #include <omp.h>
 #include <cmath>
+#include <algorithm>
+#include <memory>
 
 #define SAVE_QUAITY_VALUE 100
 
@@ -35,7 +43,6 @@ struct SupportFormats
 Q_GLOBAL_STATIC(SupportFormats, SupportFormatsInstance)
 #ifndef DTK_DISABLE_EX_IMAGE_FORMAT
 Q_GLOBAL_STATIC(DLibFreeImage, DLibFreeImageInstance)
-Q_GLOBAL_STATIC(DLibRaw, DLibRawInstance)
 #endif
 
 SupportFormats::SupportFormats()
@@ -164,7 +171,7 @@ SupportFormats::SupportFormats()
     }
 
     // Add libRaw support formats.
-    if (DLibRawInstance()->isValid()) {
+    if (DLibRaw::instance()->isValid()) {
         for (const QString &format : libRawFormats) {
             formats.insert(format);
         }
@@ -192,6 +199,15 @@ QString detectImageFormatInternal(const QString &fileName, FREE_IMAGE_FORMAT &fo
 QString detectImageFormatInternal(const QString &fileName);
 #endif
 
+// Shared with the async loading workers, the handler is reset when it's destroyed.
+struct DImageLoadContext
+{
+    QMutex mutex;
+    DImageHandler *handler = nullptr;
+    // The serial of the current load, a worker of an older serial stops early.
+    QAtomicInteger<quint64> serial { 0 };
+};
+
 class DImageHandlerPrivate : public DObjectPrivate
 {
     D_DECLARE_PUBLIC(DImageHandler)
@@ -199,28 +215,131 @@ public:
     enum ImageOption { Readable = 0x1, Wirteable = 0x2, Rotatable = 0x4, SupportFreeImage = 0x8 };
     Q_DECLARE_FLAGS(ImageOptions, ImageOption);
 
+    enum ImageLoader { QtLoader, LibRawLoader, FreeImageLoader, UnsupportedLoader };
+
     explicit DImageHandlerPrivate(DImageHandler *qq);
 
     bool formatReadable(const QString &fileFormat) const;
     bool formatWriteable(const QString &fileFormat) const;
 
-    bool loadStaticImageFromFile(const QString &fileName, QImage &image);
+    // The format of a file, detected once and shared by the header and the image reading.
+    struct FileType
+    {
+        ImageLoader loader = UnsupportedLoader;
+        QString format;
+        int fifFormat = -1;
+    };
+
+    // The loading functions don't touch the handler, they are called in the async workers.
+    static FileType detectFileType(const QString &fileName);
+    static FileType fileTypeOf(const QString &fileName, const QString &detectedFormat, int fifFormat);
+    static bool loadImageFile(const QString &fileName, const FileType &type, QImage &image, QString &errorString,
+                              const QSize &requestSize = QSize());
+    static QSize readImageHeaderSize(const QString &fileName, const FileType &type);
+    FileType cachedFileType() const;
 #ifndef DTK_DISABLE_EX_IMAGE_FORMAT
-    bool loadImageWithFreeImage(const QString &fileName, QImage &image, FREE_IMAGE_FORMAT fifForamt, QString fileFormat);
+    static bool loadImageWithFreeImage(const QString &fileName, QImage &image, FREE_IMAGE_FORMAT fifForamt,
+                                       QString fileFormat, QString &errorString);
 #endif
+    bool loadStaticImageFromFile(const QString &fileName, QImage &image);
     bool rotateImageFile(const QString &fileName, int angle);
     bool rotateImage(QImage &image, int angle);
 
     void adjustImageToRealOrientation(QImage &image, ExifImageOrientation orientation);
 
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+    const DImageHeaderInfo &headerInfo();
+#endif
+    void resetFileCache();
+
+    enum LoadResultType { SizeResult, PreviewResult, ImageResult };
+    static void postLoadResult(const QSharedPointer<DImageLoadContext> &context, quint64 serial, LoadResultType type,
+                               const QSize &size, const QImage &image = QImage(), const QString &errorString = QString());
+    void handleLoadResult(quint64 serial, LoadResultType type, const QSize &size, const QImage &image,
+                          const QString &errorString);
+
     QString fileName;
     ImageOptions options;
     QImage cachedImage;
+    QSize cachedSize;
     QString cachedFormat;
     QString lastError;
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+    // Detected when the file name is set, FIF_UNKNOWN if FreeImage doesn't know it.
+    FREE_IMAGE_FORMAT cachedFifFormat = FIF_UNKNOWN;
+    bool headerInfoLoaded = false;
+    DImageHeaderInfo cachedHeaderInfo;
+#endif
+
+    // Increased when the file or the cache is changed, the outdated async results are dropped.
+    quint64 loadSerial = 0;
+    QSharedPointer<DImageLoadContext> loadContext;
 };
 Q_DECLARE_OPERATORS_FOR_FLAGS(DImageHandlerPrivate::ImageOptions)
 
+class DImageLoadWorker : public QRunnable
+{
+public:
+    DImageLoadWorker(const QSharedPointer<DImageLoadContext> &context, const QString &fileName, quint64 serial,
+                     const QSize &previewSize)
+        : context(context)
+        , fileName(fileName)
+        , serial(serial)
+        , previewSize(previewSize)
+    {
+    }
+
+    void run() override
+    {
+        // The file is changed or read again before the worker is started.
+        if (isStale()) {
+            return;
+        }
+
+        const DImageHandlerPrivate::FileType type = DImageHandlerPrivate::detectFileType(fileName);
+
+        const QSize size = DImageHandlerPrivate::readImageHeaderSize(fileName, type);
+        if (size.isValid()) {
+            DImageHandlerPrivate::postLoadResult(context, serial, DImageHandlerPrivate::SizeResult, size);
+        }
+        if (isStale()) {
+            return;
+        }
+
+        QString errorString;
+        // Only Qt (e.g. the reduced DCT scale of jpeg) and LibRaw (the embedded preview) decode
+        // a smaller image faster, a preview from the other loaders costs as much as the image.
+        const bool scalable = DImageHandlerPrivate::QtLoader == type.loader || DImageHandlerPrivate::LibRawLoader == type.loader;
+        if (scalable && !previewSize.isEmpty() && size.isValid()
+                && (size.width() > previewSize.width() || size.height() > previewSize.height())) {
+            QImage preview;
+            if (DImageHandlerPrivate::loadImageFile(fileName, type, preview, errorString, previewSize)) {
+                DImageHandlerPrivate::postLoadResult(context, serial, DImageHandlerPrivate::PreviewResult, size, preview);
+            }
+            if (isStale()) {
+                return;
+            }
+        }
+
+        QImage image;
+        errorString.clear();
+        DImageHandlerPrivate::loadImageFile(fileName, type, image, errorString);
+        DImageHandlerPrivate::postLoadResult(context, serial, DImageHandlerPrivate::ImageResult, image.size(), image, errorString);
+    }
+
+private:
+    // A viewer flipping through the files doesn't wait for the decoding of the skipped ones.
+    inline bool isStale() const
+    {
+        return context->serial.loadAcquire() != serial;
+    }
+
+    QSharedPointer<DImageLoadContext> context;
+    QString fileName;
+    quint64 serial;
+    QSize previewSize;
+};
+
 DImageHandlerPrivate::DImageHandlerPrivate(DImageHandler *qq)
     : DObjectPrivate(qq)
 {
@@ -260,36 +379,97 @@ bool DImageHandlerPrivate::formatWriteable(const QString &fileFormat) const
     return SupportFormatsInstance()->saveableFormats.contains(fileFormat);
 }
 
-bool DImageHandlerPrivate::loadStaticImageFromFile(const QString &fileName, QImage &image)
+DImageHandlerPrivate::FileType DImageHandlerPrivate::detectFileType(const QString &fileName)
 {
-    D_Q(DImageHandler);
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+    FREE_IMAGE_FORMAT format = FIF_UNKNOWN;
+    const QString fileFormat = detectImageFormatInternal(fileName, format);
+    return fileTypeOf(fileName, fileFormat, format);
+#else
+    return fileTypeOf(fileName, detectImageFormatInternal(fileName), -1);
+#endif
+}
 
-    QFileInfo fileInfo(fileName);
-    if (0 == fileInfo.size()) {
-        lastError = QString("Error file!");
-        return false;
-    }
+DImageHandlerPrivate::FileType DImageHandlerPrivate::fileTypeOf(const QString &fileName, const QString &detectedFormat,
+                                                                int fifFormat)
+{
+    FileType type;
+    type.format = detectedFormat;
+    type.fifFormat = fifFormat;
 
 #ifndef DTK_DISABLE_EX_IMAGE_FORMAT
-    FREE_IMAGE_FORMAT fifFormat = FIF_UNKNOWN;
-    QString fileFormat = detectImageFormatInternal(fileName, fifFormat);
     if (DLibFreeImageInstance()->isValid()) {
-        // Using free image meta type.
-        QHash<QString, QString> dataMap = DLibFreeImageInstance()->findAllMetaData(fileName);
-        fileFormat = dataMap.value("FileFormat").toUpper();
+        // Same as the "FileFormat" of the FreeImage meta data, without parsing the whole meta data.
+        type.format = QFileInfo(fileName).suffix().toUpper();
     }
 
     // For some formats, need use Qt image reader load, to aviod some errors on different hardware architectures.
-    bool usingQImage = ((FIF_PICT == fifFormat) && ("PCT" != fileFormat));
+    bool usingQImage = ((FIF_PICT == fifFormat) && ("PCT" != type.format));
 
-    if (usingQImage || SupportFormatsInstance()->qtSupportFormats.contains(fileFormat)) {
+    if (usingQImage || SupportFormatsInstance()->qtSupportFormats.contains(type.format)) {
+        type.loader = QtLoader;
+    } else if (SupportFormatsInstance()->libRawFormats.contains(type.format) && DLibRaw::instance()->isValid()) {
+        type.loader = LibRawLoader;
+    } else if (DLibFreeImageInstance()->isValid()) {
+        type.loader = FreeImageLoader;
+    }
 #else
-    QString fileFormat = detectImageFormatInternal(fileName);
+    Q_UNUSED(fileName)
+    type.loader = QtLoader;
 #endif
+
+    return type;
+}
+
+// The type of the current file, the format detected in setFileName is reused.
+DImageHandlerPrivate::FileType DImageHandlerPrivate::cachedFileType() const
+{
+    if (cachedFormat.isEmpty()) {
+        return detectFileType(fileName);
+    }
+
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+    return fileTypeOf(fileName, cachedFormat, cachedFifFormat);
+#else
+    return fileTypeOf(fileName, cachedFormat, -1);
+#endif
+}
+
+// The request size is the bounding size of the image after the transformation.
+static void setReaderRequestSize(QImageReader &reader, const QSize &requestSize)
+{
+    if (requestSize.isEmpty()) {
+        return;
+    }
+
+    const QSize size = reader.size();
+    const QSize boundSize = reader.transformation().testFlag(QImageIOHandler::TransformationRotate90)
+                                ? requestSize.transposed()
+                                : requestSize;
+    if (size.width() > boundSize.width() || size.height() > boundSize.height()) {
+        reader.setScaledSize(size.scaled(boundSize, Qt::KeepAspectRatio));
+    }
+}
+
+bool DImageHandlerPrivate::loadImageFile(const QString &fileName, const FileType &type, QImage &image,
+                                         QString &errorString, const QSize &requestSize)
+{
+    QFileInfo fileInfo(fileName);
+    if (0 == fileInfo.size()) {
+        errorString = QString("Error file!");
+        return false;
+    }
+
+    const ImageLoader loader = type.loader;
+    const QString &fileFormat = type.format;
+    const int fifFormat = type.fifFormat;
+
+    if (QtLoader == loader) {
         QImageReader reader(fileName);
         reader.setAutoTransform(true);
 
         if (reader.imageCount() > 0 || "ICNS" != fileFormat) {
+            setReaderRequestSize(reader, requestSize);
             image = reader.read();
             if (!image.isNull()) {
                 return true;
@@ -302,37 +482,132 @@ bool DImageHandlerPrivate::loadStaticImageFromFile(const QString &fileName, QIma
 
 #ifndef DTK_DISABLE_EX_IMAGE_FORMAT
                 } else if (DLibFreeImageInstance()->isValid() &&
-                           DLibFreeImageInstance()->FreeImage_FIFSupportsReading(fifFormat)) {
+                           DLibFreeImageInstance()->FreeImage_FIFSupportsReading(FREE_IMAGE_FORMAT(fifFormat))) {
                     // Try load with FreeImage.
-                    return loadImageWithFreeImage(fileName, image, fifFormat, fileFormat);
+                    return loadImageWithFreeImage(fileName, image, FREE_IMAGE_FORMAT(fifFormat), fileFormat, errorString);
 #endif
                 } else {
-                    lastError = QString("Load image by qt failed, %1, use format: %2").arg(reader.errorString()).arg(fileFormat);
+                    errorString = QString("Load image by qt failed, %1, use format: %2").arg(reader.errorString()).arg(fileFormat);
                     return false;
                 }
             }
         }
 
 #ifndef DTK_DISABLE_EX_IMAGE_FORMAT
-    } else if (SupportFormatsInstance()->libRawFormats.contains(fileFormat) && DLibRawInstance()->isValid()) {
-        // Use libRaw load.
-        image = DLibRawInstance()->loadImage(fileName, lastError);
+    } else if (LibRawLoader == loader) {
+        // Use libRaw load, the embedded preview is used if it's larger than the request size.
+        image = DLibRaw::instance()->loadImage(fileName, errorString, requestSize);
         return !image.isNull();
-    } else if (DLibFreeImageInstance()->isValid()) {
+    } else if (FreeImageLoader == loader) {
         // Use FreeImage load.
-        return loadImageWithFreeImage(fileName, image, fifFormat, fileFormat);
-    }
+        return loadImageWithFreeImage(fileName, image, FREE_IMAGE_FORMAT(fifFormat), fileFormat, errorString);
 #endif
+    }
 
-    lastError = QString("Unsupport image format: %1").arg(fileFormat);
+    errorString = QString("Unsupport image format: %1").arg(fileFormat);
     return false;
 }
 
+QSize DImageHandlerPrivate::readImageHeaderSize(const QString &fileName, const FileType &type)
+{
+    const ImageLoader loader = type.loader;
+    const QString &fileFormat = type.format;
+
+    if (QtLoader == loader) {
+        QImageReader reader(fileName);
+        reader.setAutoTransform(true);
+        QSize size = reader.size();
+        if (!size.isValid()) {
+            reader.setFormat(fileFormat.toLower().toUtf8());
+            size = reader.size();
+        }
+
+        if (size.isValid() && reader.transformation().testFlag(QImageIOHandler::TransformationRotate90)) {
+            size.transpose();
+        }
+        return size;
+
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+    } else if (LibRawLoader == loader) {
+        QString errorString;
+        return DLibRaw::instance()->imageSize(fileName, errorString);
+    } else if (FreeImageLoader == loader) {
+        FIBITMAP *dib = DLibFreeImageInstance()->readFileToFIBITMAP(fileName, FIF_LOAD_NOPIXELS);
+        if (dib) {
+            const QSize size(static_cast<int>(DLibFreeImageInstance()->FreeImage_GetWidth(dib)),
+                             static_cast<int>(DLibFreeImageInstance()->FreeImage_GetHeight(dib)));
+            DLibFreeImageInstance()->FreeImage_Unload(dib);
+            return size.isEmpty() ? QSize() : size;
+        }
+#endif
+    }
+
+    return QSize();
+}
+
+bool DImageHandlerPrivate::loadStaticImageFromFile(const QString &fileName, QImage &image)
+{
+    // The current file reuses the format detected in setFileName.
+    const FileType type = (fileName == this->fileName) ? cachedFileType() : detectFileType(fileName);
+    return loadImageFile(fileName, type, image, lastError);
+}
+
+void DImageHandlerPrivate::postLoadResult(const QSharedPointer<DImageLoadContext> &context, quint64 serial,
+                                          LoadResultType type, const QSize &size, const QImage &image,
+                                          const QString &errorString)
+{
+    // The handler can't be destroyed while the call is queued.
+    QMutexLocker locker(&context->mutex);
+    DImageHandler *handler = context->handler;
+    if (!handler) {
+        return;
+    }
+
+    // Dropped if the handler is destroyed before the call is invoked.
+    QMetaObject::invokeMethod(
+        handler,
+        [handler, serial, type, size, image, errorString]() {
+            handler->d_func()->handleLoadResult(serial, type, size, image, errorString);
+        },
+        Qt::QueuedConnection);
+}
+
+void DImageHandlerPrivate::handleLoadResult(quint64 serial, LoadResultType type, const QSize &size, const QImage &image,
+                                            const QString &errorString)
+{
+    D_Q(DImageHandler);
+
+    if (serial != loadSerial) {
+        return;
+    }
+
+    switch (type) {
+        case SizeResult:
+            cachedSize = size;
+            Q_EMIT q->imageSizeReady(size);
+            break;
+        case PreviewResult:
+            Q_EMIT q->previewImageReady(image);
+            break;
+        case ImageResult:
+            if (image.isNull()) {
+                lastError = errorString;
+                Q_EMIT q->loadImageFailed(errorString);
+            } else {
+                cachedImage = image;
+                cachedSize = image.size();
+                Q_EMIT q->imageLoaded(image);
+            }
+            break;
+    }
+}
+
 #ifndef DTK_DISABLE_EX_IMAGE_FORMAT
 bool DImageHandlerPrivate::loadImageWithFreeImage(const QString &fileName,
                                                   QImage &image,
                                                   FREE_IMAGE_FORMAT fifFormat,
-                                                  QString fileFormat)
+                                                  QString fileFormat,
+                                                  QString &errorString)
 {
     if (!DLibFreeImageInstance()->isValid()) {
         return false;
@@ -345,20 +620,20 @@ bool DImageHandlerPrivate::loadImageWithFreeImage(const QString &fileName,
 
         static const int MAX_JP2_SUPPORT_SIZE = 40960000;
         if (FIF_JP2 == fifFormat && QFileInfo(fileName).size() > MAX_JP2_SUPPORT_SIZE) {
-            lastError = QString("Load image failed, JP2 image size to big, format: %1").arg(fileFormat);
+            errorString = QString("Load image failed, JP2 image size to big, format: %1").arg(fileFormat);
             return false;
         }
 
         FIBITMAP *dib = DLibFreeImageInstance()->FreeImage_Load(fifFormat, fileName.toUtf8().data(), 0);
         if (!dib) {
-            lastError = QString("Load image failed, format: %1").arg(fileFormat);
+            errorString = QString("Load image failed, format: %1").arg(fileFormat);
             return false;
         }
 
         image = DLibFreeImageInstance()->FIBITMAPToQImage(dib);
         if (image.isNull()) {
             DLibFreeImageInstance()->FreeImage_Unload(dib);
-            lastError = QString("Convert to QImage failed: %1").arg(fileFormat);
+            errorString = QString("Convert to QImage failed: %1").arg(fileFormat);
             return false;
         }
 
@@ -366,7 +641,7 @@ bool DImageHandlerPrivate::loadImageWithFreeImage(const QString &fileName,
         return true;
     }
 
-    lastError = QString("Unsupport image format: %1").arg(fileFormat);
+    errorString = QString("Unsupport image format: %1").arg(fileFormat);
     return false;
 }
 #endif
@@ -387,14 +662,18 @@ bool DImageHandlerPrivate::rotateImageFile(const QString &fileName, int angle)
 #ifndef DTK_DISABLE_EX_IMAGE_FORMAT
         // Some image formats support use EXIF info store orientation info.
         if (DLibFreeImageInstance()->isValid()) {
-            // Using libFreeImage to get EXIF information.
-            ExifImageOrientation orientation = DLibFreeImageInstance()->imageOrientation(fileName);
+            // Using libFreeImage to get EXIF information, reuse the header of the current file.
+            ExifImageOrientation orientation = (fileName == this->fileName) ? headerInfo().orientation
+                                                                            : DLibFreeImageInstance()->imageOrientation(fileName);
             adjustImageToRealOrientation(image, orientation);
         }
 #endif
 
         if (rotateImage(image, angle)) {
             image.save(fileName, format.toLatin1().data(), SAVE_QUAITY_VALUE);
+            if (fileName == this->fileName) {
+                resetFileCache();
+            }
             return true;
         }
         return false;
@@ -402,7 +681,11 @@ bool DImageHandlerPrivate::rotateImageFile(const QString &fileName, int angle)
 
 #ifndef DTK_DISABLE_EX_IMAGE_FORMAT
     if (DLibFreeImageInstance()->isValid()) {
-        return DLibFreeImageInstance()->rotateImageFile(fileName, angle, lastError);
+        const bool rotated = DLibFreeImageInstance()->rotateImageFile(fileName, angle, lastError);
+        if (rotated && fileName == this->fileName) {
+            resetFileCache();
+        }
+        return rotated;
     }
 #endif
 
@@ -410,6 +693,35 @@ bool DImageHandlerPrivate::rotateImageFile(const QString &fileName, int angle)
     return false;
 }
 
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+const DImageHeaderInfo &DImageHandlerPrivate::headerInfo()
+{
+    if (!headerInfoLoaded) {
+        cachedHeaderInfo = DImageHeaderInfo();
+        if (DLibFreeImageInstance()->isValid()) {
+            DLibFreeImageInstance()->readHeaderInfo(fileName, cachedHeaderInfo, cachedFifFormat);
+        }
+        headerInfoLoaded = true;
+    }
+
+    return cachedHeaderInfo;
+}
+#endif
+
+// The content of the file is changed or should be read again.
+void DImageHandlerPrivate::resetFileCache()
+{
+    cachedImage = QImage();
+    cachedSize = QSize();
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+    headerInfoLoaded = false;
+#endif
+    ++loadSerial;
+    if (loadContext) {
+        loadContext->serial.storeRelease(loadSerial);
+    }
+}
+
 bool DImageHandlerPrivate::rotateImage(QImage &image, int angle)
 {
     if (image.isNull()) {
@@ -472,7 +784,16 @@ DImageHandler::DImageHandler(QObject *parent)
 {
 }
 
-DImageHandler::~DImageHandler() {}
+DImageHandler::~DImageHandler()
+{
+    D_D(DImageHandler);
+    if (d->loadContext) {
+        QMutexLocker locker(&d->loadContext->mutex);
+        d->loadContext->handler = nullptr;
+        // Stops the running workers, the serials start from 1.
+        d->loadContext->serial.storeRelease(0);
+    }
+}
 
 void DImageHandler::setFileName(const QString &fileName)
 {
@@ -486,7 +807,12 @@ void DImageHandler::setFileName(const QString &fileName)
     clearCache();
 
     if (!d->fileName.isEmpty()) {
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+        // Keep the FreeImage format, the header is read without detecting it again.
+        d->cachedFormat = detectImageFormatInternal(fileName, d->cachedFifFormat);
+#else
         d->cachedFormat = detectImageFormat(fileName);
+#endif
         d->options.setFlag(DImageHandlerPrivate::Readable, d->formatReadable(d->cachedFormat));
         if (d->formatWriteable(d->cachedFormat)) {
             d->options.setFlag(DImageHandlerPrivate::Wirteable);
@@ -537,11 +863,54 @@ QString DImageHandler::imageFormat() const
 QSize DImageHandler::imageSize()
 {
     D_D(DImageHandler);
-    if (isReadable() && d->cachedImage.isNull()) {
-        d->loadStaticImageFromFile(d->fileName, d->cachedImage);
+    if (!isReadable() || !d->cachedImage.isNull()) {
+        return d->cachedImage.size();
+    }
+
+    if (!d->cachedSize.isValid()) {
+        // Read the size from the image header, the whole image is decoded only if it's unknown.
+        const DImageHandlerPrivate::FileType type = d->cachedFileType();
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+        if (DImageHandlerPrivate::FreeImageLoader == type.loader) {
+            // The header is shared with the orientation and the meta data, the file is opened once.
+            const QSize size = d->headerInfo().size;
+            d->cachedSize = size.isEmpty() ? QSize() : size;
+        } else
+#endif
+        {
+            d->cachedSize = d->readImageHeaderSize(d->fileName, type);
+        }
+        if (!d->cachedSize.isValid() && d->loadStaticImageFromFile(d->fileName, d->cachedImage)) {
+            d->cachedSize = d->cachedImage.size();
+        }
     }
 
-    return d->cachedImage.size();
+    return d->cachedSize.isValid() ? d->cachedSize : d->cachedImage.size();
+}
+
+void DImageHandler::readImageAsync(const QSize &previewSize)
+{
+    D_D(DImageHandler);
+
+    if (!d->loadContext) {
+        d->loadContext.reset(new DImageLoadContext);
+        d->loadContext->handler = this;
+    }
+
+    // The pending results of the previous call are dropped.
+    const quint64 serial = ++d->loadSerial;
+    d->loadContext->serial.storeRelease(serial);
+
+    // The results are always delivered asynchronously.
+    if (!isReadable()) {
+        d->postLoadResult(d->loadContext, serial, DImageHandlerPrivate::ImageResult, QSize(), QImage(),
+                          QString("File is not readable"));
+    } else if (!d->cachedImage.isNull()) {
+        d->postLoadResult(d->loadContext, serial, DImageHandlerPrivate::SizeResult, d->cachedImage.size());
+        d->postLoadResult(d->loadContext, serial, DImageHandlerPrivate::ImageResult, d->cachedImage.size(), d->cachedImage);
+    } else {
+        QThreadPool::globalInstance()->start(new DImageLoadWorker(d->loadContext, d->fileName, serial, previewSize));
+    }
 }
 
 QHash<QString, QString> DImageHandler::findAllMetaData()
@@ -553,7 +922,7 @@ QHash<QString, QString> DImageHandler::findAllMetaData()
 
 #ifndef DTK_DISABLE_EX_IMAGE_FORMAT
     if (DLibFreeImageInstance()->isValid()) {
-        return DLibFreeImageInstance()->findAllMetaData(d->fileName);
+        return DLibFreeImageInstance()->findAllMetaData(d->fileName, d->headerInfo());
     }
 #endif
 
@@ -636,8 +1005,11 @@ bool DImageHandler::isRotatable() const
 void DImageHandler::clearCache()
 {
     D_D(DImageHandler);
-    d->cachedImage = QImage();
+    d->resetFileCache();
     d->cachedFormat.clear();
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+    d->cachedFifFormat = FIF_UNKNOWN;
+#endif
     d->lastError.clear();
 }
 
@@ -781,142 +1153,130 @@ QString DImageHandler::detectImageFormat(const QString &fileName)
 #endif
 }
 
-QImage DImageHandler::oldColorFilter(const QImage &img)
+// The filters below work on RGB888 images. The rows are independent for the point
+// operations, and only read the neighbouring rows of the source for the 3x3 kernels,
+// so they are split between the OpenMP threads row by row.
+static inline QImage toRgb888(const QImage &img)
 {
-    QImage imgCopy;
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    uint8_t *rgb = imgCopy.bits();
-    if (nullptr == rgb) {
+    QImage imgCopy = img.convertToFormat(QImage::Format_RGB888);
+    // Detach from the source image.
+    if (nullptr == imgCopy.bits()) {
         return QImage();
     }
-    int size = img.width() * img.height();
+    return imgCopy;
+}
 
-#pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        float r = 0.393 * rgb[i * 3] + 0.769 * rgb[i * 3 + 1] + 0.189 * rgb[i * 3 + 2];
-        float g = 0.349 * rgb[i * 3] + 0.686 * rgb[i * 3 + 1] + 0.168 * rgb[i * 3 + 2];
-        float b = 0.272 * rgb[i * 3] + 0.534 * rgb[i * 3 + 1] + 0.131 * rgb[i * 3 + 2];
-        r = qBound<float>(0, r, 255.0);
-        g = qBound<float>(0, g, 255.0);
-        b = qBound<float>(0, b, 255.0);
-        rgb[i * 3] = r;
-        rgb[i * 3 + 1] = g;
-        rgb[i * 3 + 2] = b;
+template<typename PointOp>
+static QImage mapRgb888(const QImage &img, PointOp op)
+{
+    QImage imgCopy = toRgb888(img);
+    if (imgCopy.isNull()) {
+        return imgCopy;
+    }
+
+    const int width = imgCopy.width();
+    const int height = imgCopy.height();
+    // QImage::scanLine() isn't reentrant, it may detach the image.
+    uint8_t *bits = imgCopy.bits();
+    const auto bytesPerLine = imgCopy.bytesPerLine();
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        uint8_t *rgb = bits + y * bytesPerLine;
+        for (int x = 0; x < width; x++, rgb += 3) {
+            op(rgb);
+        }
     }
 
     return imgCopy;
 }
 
-QImage DImageHandler::warmColorFilter(const QImage &img, int intensity)
+// The channels are mapped independently, use a table instead of the per-pixel arithmetic.
+template<typename RedOp, typename GreenOp, typename BlueOp>
+static QImage mapRgb888Channels(const QImage &img, RedOp redOp, GreenOp greenOp, BlueOp blueOp)
 {
-    QImage imgCopy;
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    uint8_t *rgb = imgCopy.bits();
-    if (nullptr == rgb) {
-        return QImage();
-    }
-    QColor frontColor;
-    int size = img.width() * img.height();
+    uint8_t red[256], green[256], blue[256];
+    for (int i = 0; i < 256; i++) {
+        red[i] = qBound(0, redOp(i), 255);
+        green[i] = qBound(0, greenOp(i), 255);
+        blue[i] = qBound(0, blueOp(i), 255);
+    }
+
+    return mapRgb888(img, [&](uint8_t *rgb) {
+        rgb[0] = red[rgb[0]];
+        rgb[1] = green[rgb[1]];
+        rgb[2] = blue[rgb[2]];
+    });
+}
 
-#pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        int r = rgb[i * 3] + intensity;
-        int g = rgb[i * 3 + 1] + intensity;
-        int b = rgb[i * 3 + 2];
+template<typename ValueOp>
+static inline QImage mapRgb888Channels(const QImage &img, ValueOp op)
+{
+    return mapRgb888Channels(img, op, op, op);
+}
 
-        rgb[i * 3] = r > 255 ? 255 : r;
-        rgb[i * 3 + 1] = g > 255 ? 255 : g;
-        rgb[i * 3 + 2] = b > 255 ? 255 : b;
+// Calls op(x, y, rows) for every pixel, rows[0..2] are the scanlines above, at and
+// below y of the source image, and the edges are clamped to the border pixels.
+template<typename KernelOp>
+static void forEachRgb888Neighborhood(const QImage &source, KernelOp op)
+{
+    const int width = source.width();
+    const int height = source.height();
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        const uint8_t *rows[3] = { source.constScanLine(qMax(0, y - 1)), source.constScanLine(y),
+                                   source.constScanLine(qMin(height - 1, y + 1)) };
+        for (int x = 0; x < width; x++) {
+            op(x, y, rows);
+        }
     }
-
-    return imgCopy;
 }
 
-QImage DImageHandler::coolColorFilter(const QImage &img, int intensity)
+static inline int grayValue(const uint8_t *rgb)
 {
-    QImage imgCopy;
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    uint8_t *rgb = imgCopy.bits();
-    if (nullptr == rgb) {
-        return QImage();
-    }
-    QColor frontColor;
-    int size = img.width() * img.height();
+    return (rgb[0] * 299 + rgb[1] * 587 + rgb[2] * 114 + 500) / 1000;
+}
 
-#pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        int r = rgb[i * 3];
-        int g = rgb[i * 3 + 1];
-        int b = rgb[i * 3 + 2] + intensity;
+QImage DImageHandler::oldColorFilter(const QImage &img)
+{
+    return mapRgb888(img, [](uint8_t *rgb) {
+        float r = 0.393f * rgb[0] + 0.769f * rgb[1] + 0.189f * rgb[2];
+        float g = 0.349f * rgb[0] + 0.686f * rgb[1] + 0.168f * rgb[2];
+        float b = 0.272f * rgb[0] + 0.534f * rgb[1] + 0.131f * rgb[2];
+        rgb[0] = qBound<float>(0, r, 255.0);
+        rgb[1] = qBound<float>(0, g, 255.0);
+        rgb[2] = qBound<float>(0, b, 255.0);
+    });
+}
 
-        rgb[i * 3] = r > 255 ? 255 : r;
-        rgb[i * 3 + 1] = g > 255 ? 255 : g;
-        rgb[i * 3 + 2] = b > 255 ? 255 : b;
-    }
+QImage DImageHandler::warmColorFilter(const QImage &img, int intensity)
+{
+    auto increase = [intensity](int value) { return value + intensity; };
+    auto keep = [](int value) { return value; };
+    return mapRgb888Channels(img, increase, increase, keep);
+}
 
-    return imgCopy;
+QImage DImageHandler::coolColorFilter(const QImage &img, int intensity)
+{
+    auto increase = [intensity](int value) { return value + intensity; };
+    auto keep = [](int value) { return value; };
+    return mapRgb888Channels(img, keep, keep, increase);
 }
 
 QImage DImageHandler::grayScaleColorFilter(const QImage &img)
 {
-    QImage imgCopy;
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    uint8_t *rgb = imgCopy.bits();
-    if (nullptr == rgb) {
-        return QImage();
-    }
-    QColor frontColor;
-    int size = img.width() * img.height();
-
-#pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        int average = (rgb[i * 3] + rgb[i * 3 + 1] + rgb[i * 3 + 2]) / 3;
-        rgb[i * 3] = average > 255 ? 255 : average;
-        rgb[i * 3 + 1] = average > 255 ? 255 : average;
-        rgb[i * 3 + 2] = average > 255 ? 255 : average;
-    }
-
-    return imgCopy;
+    return mapRgb888(img, [](uint8_t *rgb) {
+        const uint8_t average = (rgb[0] + rgb[1] + rgb[2]) / 3;
+        rgb[0] = average;
+        rgb[1] = average;
+        rgb[2] = average;
+    });
 }
 
 QImage DImageHandler::antiColorFilter(const QImage &img)
 {
-    QImage imgCopy;
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    uint8_t *rgb = imgCopy.bits();
-    if (nullptr == rgb) {
-        return QImage();
-    }
-    int size = img.width() * img.height();
-
-#pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        rgb[i * 3] = 255 - rgb[i * 3];
-        rgb[i * 3 + 1] = 255 - rgb[i * 3 + 1];
-        rgb[i * 3 + 2] = 255 - rgb[i * 3 + 2];
-    }
-
-    return imgCopy;
+    return mapRgb888Channels(img, [](int value) { return 255 - value; });
 }
 
 QImage DImageHandler::metalColorFilter(const QImage &img)
@@ -936,519 +1296,282 @@ QImage DImageHandler::metalColorFilter(const QImage &img)
     return newImage;
 }
 
-QImage DImageHandler::bilateralFilter(const QImage &img, double spatialDecay, double photometricStandardDeviation)
-{
-    QImage imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-
-    double c = -0.5 / (photometricStandardDeviation * photometricStandardDeviation);
-    double mu = spatialDecay / (2 - spatialDecay);
-
-    double *exptable = new double[256];
-    double *g_table = new double[256];
-#pragma omp parallel for
-    for (int i = 0; i <= 255; i++) {
-        exptable[i] = (1 - spatialDecay) * exp(c * i * i);
-        g_table[i] = mu * i;
-    }
-    int width = img.width();
-    int height = img.height();
-    int length = width * height;
-    double *data2Red = new double[length];
-    double *data2Green = new double[length];
-    double *data2Blue = new double[length];
-
-    int size = imgCopy.width() * imgCopy.height();
-    uint8_t *rgb = imgCopy.bits();
-#pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        data2Red[i] = rgb[i * 3];
-        data2Green[i] = rgb[i * 3 + 1];
-        data2Blue[i] = rgb[i * 3 + 2];
-    }
-
-    double *gRed = new double[length];
-    double *pRed = new double[length];
-    double *rRed = new double[length];
-
-    double *gGreen = new double[length];
-    double *pGreen = new double[length];
-    double *rGreen = new double[length];
-
-    double *gBlue = new double[length];
-    double *pBlue = new double[length];
-    double *rBlue = new double[length];
-    memcpy(pRed, data2Red, sizeof(double) * length);
-    memcpy(rRed, data2Red, sizeof(double) * length);
-
-    memcpy(pGreen, data2Green, sizeof(double) * length);
-    memcpy(rGreen, data2Green, sizeof(double) * length);
-
-    memcpy(pBlue, data2Blue, sizeof(double) * length);
-    memcpy(rBlue, data2Blue, sizeof(double) * length);
-
-    double rho0 = 1.0 / (2 - spatialDecay);
-#pragma omp parallel for
-    for (int k2 = 0; k2 < height; ++k2) {
-        int startIndex = k2 * width;
-        double mu2 = 0.0;
-
-        for (int k = startIndex + 1, K = startIndex + width; k < K; ++k) {
-            int div0Red = fabs(pRed[k] - pRed[k - 1]);
-            mu2 = exptable[div0Red];
-            pRed[k] = pRed[k - 1] * mu2 + pRed[k] * (1.0 - mu2);
-
-            int div0Green = fabs(pGreen[k] - pGreen[k - 1]);
-            mu2 = exptable[div0Green];
-            pGreen[k] = pGreen[k - 1] * mu2 + pGreen[k] * (1.0 - mu2);
-
-            int div0Blue = fabs(pBlue[k] - pBlue[k - 1]);
-            mu2 = exptable[div0Blue];
-            pBlue[k] = pBlue[k - 1] * mu2 + pBlue[k] * (1.0 - mu2);
-        }
-
-        for (int k = startIndex + width - 2; startIndex <= k; --k) {
-            int div0Red = fabs(rRed[k] - rRed[k + 1]);
-            mu2 = exptable[div0Red];
-            rRed[k] = rRed[k + 1] * mu2 + rRed[k] * (1.0 - mu2);
-
-            int div0Green = fabs(rGreen[k] - rGreen[k + 1]);
-            mu2 = exptable[div0Green];
-            rGreen[k] = rGreen[k + 1] * mu2 + rGreen[k] * (1.0 - mu2);
+// The scratch of a vertical strip, in floats. The strips are narrower for the tall images,
+// the recursive pass needs the causal result of the whole column.
+#define BILATERAL_STRIP_SCRATCH (64 * 1024)
+#define BILATERAL_MAX_STRIP_WIDTH 64
 
-            int div0Blue = fabs(rBlue[k] - rBlue[k + 1]);
-            mu2 = exptable[div0Blue];
-            rBlue[k] = rBlue[k + 1] * mu2 + rBlue[k] * (1.0 - mu2);
-        }
-
-        for (int k = startIndex, K = startIndex + width; k < K; k++) {
-            rRed[k] = (rRed[k] + pRed[k]) * rho0 - g_table[(int)data2Red[k]];
-            rGreen[k] = (rGreen[k] + pGreen[k]) * rho0 - g_table[(int)data2Green[k]];
-            rBlue[k] = (rBlue[k] + pBlue[k]) * rho0 - g_table[(int)data2Blue[k]];
-        }
-    }
-
-    int m = 0;
-
-    for (int k2 = 0; k2 < height; k2++) {
-        int n = k2;
+static inline uint8_t toChannelValue(float value)
+{
+    return static_cast<uint8_t>(qBound(0.0f, value + 0.5f, 255.0f));
+}
 
-        for (int k1 = 0; k1 < width; k1++) {
-            gRed[n] = rRed[m];
-            gGreen[n] = rGreen[m];
-            gBlue[n] = rBlue[m];
-            m++;
-            n += height;
-        }
+QImage DImageHandler::bilateralFilter(const QImage &img, double spatialDecay, double photometricStandardDeviation)
+{
+    QImage imgCopy = toRgb888(img);
+    if (imgCopy.isNull()) {
+        return imgCopy;
     }
 
-    memcpy(pRed, gRed, sizeof(double) * height * width);
-    memcpy(rRed, gRed, sizeof(double) * height * width);
-
-    memcpy(pGreen, gGreen, sizeof(double) * height * width);
-    memcpy(rGreen, gGreen, sizeof(double) * height * width);
-
-    memcpy(pBlue, gBlue, sizeof(double) * height * width);
-    memcpy(rBlue, gBlue, sizeof(double) * height * width);
-
-#pragma omp parallel for
-    for (int k1 = 0; k1 < width; ++k1) {
-        int startIndex = k1 * height;
-        double mu1 = 0.0;
-
-        for (int k = startIndex + 1, K = startIndex + height; k < K; ++k) {
-            int div0Red = fabs(pRed[k] - pRed[k - 1]);
-            mu1 = exptable[div0Red];
-            pRed[k] = pRed[k - 1] * mu1 + pRed[k] * (1.0 - mu1);
+    const float c = -0.5 / (photometricStandardDeviation * photometricStandardDeviation);
+    const float mu = spatialDecay / (2 - spatialDecay);
+    const float rho0 = 1.0 / (2 - spatialDecay);
 
-            int div0Green = fabs(pGreen[k] - pGreen[k - 1]);
-            mu1 = exptable[div0Green];
-            pGreen[k] = pGreen[k - 1] * mu1 + pGreen[k] * (1.0 - mu1);
-
-            int div0Blue = fabs(pBlue[k] - pBlue[k - 1]);
-            mu1 = exptable[div0Blue];
-            pBlue[k] = pBlue[k - 1] * mu1 + pBlue[k] * (1.0 - mu1);
-        }
-
-        for (int k = startIndex + height - 2; startIndex <= k; --k) {
-            int div0Red = fabs(rRed[k] - rRed[k + 1]);
-            mu1 = exptable[div0Red];
-            rRed[k] = rRed[k + 1] * mu1 + rRed[k] * (1.0 - mu1);
+    float expTable[256];
+    float gTable[256];
+    for (int i = 0; i <= 255; i++) {
+        expTable[i] = (1 - spatialDecay) * std::exp(c * i * i);
+        gTable[i] = mu * i;
+    }
+    auto weight = [&expTable](float a, float b) { return expTable[qMin(255, int(std::fabs(a - b)))]; };
+
+    const int width = imgCopy.width();
+    const int height = imgCopy.height();
+    uint8_t *bits = imgCopy.bits();
+    const auto bytesPerLine = imgCopy.bytesPerLine();
+    const int rowSize = width * 3;
+
+    // The horizontal pass works in place row by row. The causal pass is kept in the scratch,
+    // the anti-causal pass is fused with the combination of both.
+#pragma omp parallel
+    {
+        // The scratch is allocated per thread for the call, and released after it.
+        std::unique_ptr<float[]> scratch(new float[rowSize]);
+        float *p = scratch.get();
+
+#pragma omp for schedule(static)
+        for (int y = 0; y < height; y++) {
+            uint8_t *rgb = bits + y * bytesPerLine;
 
-            int div0Green = fabs(rGreen[k] - rGreen[k + 1]);
-            mu1 = exptable[div0Green];
-            rGreen[k] = rGreen[k + 1] * mu1 + rGreen[k] * (1.0 - mu1);
+            for (int k = 0; k < 3; k++) {
+                p[k] = rgb[k];
+            }
+            for (int k = 3; k < rowSize; k++) {
+                const float m = weight(rgb[k], p[k - 3]);
+                p[k] = p[k - 3] * m + rgb[k] * (1.0f - m);
+            }
 
-            int div0Blue = fabs(rBlue[k] - rBlue[k + 1]);
-            mu1 = exptable[div0Blue];
-            rBlue[k] = rBlue[k + 1] * mu1 + rBlue[k] * (1.0 - mu1);
+            float r[3];
+            for (int k = rowSize - 1; k >= 0; k--) {
+                const float value = rgb[k];
+                const int ch = k % 3;
+                if (k >= rowSize - 3) {
+                    r[ch] = value;
+                } else {
+                    const float m = weight(value, r[ch]);
+                    r[ch] = r[ch] * m + value * (1.0f - m);
+                }
+                rgb[k] = toChannelValue((r[ch] + p[k]) * rho0 - gTable[rgb[k]]);
+            }
         }
     }
 
-    double init_gain_mu = spatialDecay / (2 - spatialDecay);
-
-#pragma omp parallel for
-    for (int k = 0; k < length; ++k) {
-        rRed[k] = (rRed[k] + pRed[k]) * rho0 - gRed[k] * init_gain_mu;
+    // The vertical pass works on strips of columns, so the rows are read in memory
+    // order and the scratch only holds one strip.
+    const int stripWidth = qBound(1, BILATERAL_STRIP_SCRATCH / (height * 3), BILATERAL_MAX_STRIP_WIDTH);
+    const int stripCount = (width + stripWidth - 1) / stripWidth;
 
-        rGreen[k] = (rGreen[k] + pGreen[k]) * rho0 - gGreen[k] * init_gain_mu;
+#pragma omp parallel
+    {
+        std::unique_ptr<float[]> scratch(new float[size_t(height) * stripWidth * 3]);
+        float *p = scratch.get();
 
-        rBlue[k] = (rBlue[k] + pBlue[k]) * rho0 - gBlue[k] * init_gain_mu;
-    }
+#pragma omp for schedule(dynamic)
+        for (int strip = 0; strip < stripCount; strip++) {
+            uint8_t *stripBits = bits + strip * stripWidth * 3;
+            const int n = qMin(stripWidth, width - strip * stripWidth) * 3;
 
-    m = 0;
-    int nRowBytes = (width * 24 + 31) / 32 * 4;
-    int lineNum_24 = 0;
+            for (int i = 0; i < n; i++) {
+                p[i] = stripBits[i];
+            }
+            for (int y = 1; y < height; y++) {
+                const uint8_t *rgb = stripBits + y * bytesPerLine;
+                float *current = p + y * n;
+                const float *previous = current - n;
+                for (int i = 0; i < n; i++) {
+                    const float m = weight(rgb[i], previous[i]);
+                    current[i] = previous[i] * m + rgb[i] * (1.0f - m);
+                }
+            }
 
-    for (int k1 = 0; k1 < width; ++k1) {
-        int n = k1;
-        for (int k2 = 0; k2 < height; ++k2) {
-            data2Red[n] = rRed[m];
-            data2Green[n] = rGreen[m];
-            data2Blue[n] = rBlue[m];
-            lineNum_24 = k2 * nRowBytes;
-            rgb[lineNum_24 + k1 * 3] = data2Red[n];
-            rgb[lineNum_24 + k1 * 3 + 1] = data2Green[n];
-            rgb[lineNum_24 + k1 * 3 + 2] = data2Blue[n];
-            m++;
-            n += width;
+            float r[BILATERAL_MAX_STRIP_WIDTH * 3];
+            for (int y = height - 1; y >= 0; y--) {
+                uint8_t *rgb = stripBits + y * bytesPerLine;
+                const float *current = p + y * n;
+                for (int i = 0; i < n; i++) {
+                    const float value = rgb[i];
+                    if (y == height - 1) {
+                        r[i] = value;
+                    } else {
+                        const float m = weight(value, r[i]);
+                        r[i] = r[i] * m + value * (1.0f - m);
+                    }
+                    rgb[i] = toChannelValue((r[i] + current[i]) * rho0 - value * mu);
+                }
+            }
         }
     }
-    delete[] data2Red;
-    data2Red = nullptr;
-    delete[] data2Green;
-    data2Green = nullptr;
-    delete[] data2Blue;
-    data2Blue = nullptr;
-
-    delete[] pRed;
-    pRed = nullptr;
-    delete[] rRed;
-    rRed = nullptr;
-    delete[] gRed;
-    gRed = nullptr;
-
-    delete[] pGreen;
-    pGreen = nullptr;
-    delete[] rGreen;
-    rGreen = nullptr;
-    delete[] gGreen;
-    gGreen = nullptr;
-
-    delete[] pBlue;
-    pBlue = nullptr;
-    delete[] rBlue;
-    rBlue = nullptr;
-    delete[] gBlue;
-    gBlue = nullptr;
-
-    delete[] exptable;
-    exptable = nullptr;
-    delete[] g_table;
-    g_table = nullptr;
 
     return imgCopy;
 }
 
 QImage DImageHandler::contourExtraction(const QImage &img)
 {
-    int width = img.width();
-    int height = img.height();
+    const QImage binImg = binaryzation(img);
+    const int width = binImg.width();
+    const int height = binImg.height();
 
-    QImage binImg = binaryzation(img);
     QImage newImg = QImage(width, height, QImage::Format_RGB888);
     newImg.fill(Qt::white);
+    if (binImg.isNull()) {
+        return newImg;
+    }
 
-    uint8_t *rgb = newImg.bits();
-    uint8_t *binrgb = binImg.bits();
-    int nRowBytes = (width * 24 + 31) / 32 * 4;
-
-#pragma omp parallel for
-    for (int y = 1; y < height - 1; y++) {
-        for (int x = 1; x < width - 1; x++) {
-            int pixel[8];
-            memset(pixel, 0, 8 * sizeof(int));
-            int lineNum_24 = y * nRowBytes;
-            if (binrgb[lineNum_24 + x * 3] == 0) {
-                rgb[lineNum_24 + x * 3] = 0;
-                rgb[lineNum_24 + x * 3 + 1] = 0;
-                rgb[lineNum_24 + x * 3 + 2] = 0;
-                pixel[0] = binrgb[(y - 1) * nRowBytes + (x - 1) * 3];
-                pixel[1] = binrgb[(y)*nRowBytes + (x - 1) * 3];
-                pixel[2] = binrgb[(y + 1) * nRowBytes + (x - 1) * 3];
-                pixel[3] = binrgb[(y - 1) * nRowBytes + (x)*3];
-                pixel[4] = binrgb[(y + 1) * nRowBytes + (x)*3];
-                pixel[5] = binrgb[(y - 1) * nRowBytes + (x + 1) * 3];
-                pixel[6] = binrgb[(y)*nRowBytes + (x + 1) * 3];
-                pixel[7] = binrgb[(y + 1) * nRowBytes + (x + 1) * 3];
-
-                if (pixel[0] + pixel[1] + pixel[2] + pixel[3] + pixel[4] + pixel[5] + pixel[6] + pixel[7] == 0) {
-                    rgb[lineNum_24 + x * 3] = 255;
-                    rgb[lineNum_24 + x * 3 + 1] = 255;
-                    rgb[lineNum_24 + x * 3 + 2] = 255;
-                }
-            }
+    uint8_t *bits = newImg.bits();
+    const auto bytesPerLine = newImg.bytesPerLine();
+
+    forEachRgb888Neighborhood(binImg, [&](int x, int y, const uint8_t *const *rows) {
+        // The pixels on the border are kept white.
+        if (x == 0 || y == 0 || x == width - 1 || y == height - 1 || rows[1][x * 3] != 0) {
+            return;
         }
-    }
+
+        // Only the black pixels next to a white pixel are kept.
+        const int left = (x - 1) * 3;
+        const int right = (x + 1) * 3;
+        const int sum = rows[0][left] + rows[0][x * 3] + rows[0][right] + rows[1][left] + rows[1][right] + rows[2][left] +
+                        rows[2][x * 3] + rows[2][right];
+        if (sum != 0) {
+            uint8_t *rgb = bits + y * bytesPerLine + x * 3;
+            rgb[0] = 0;
+            rgb[1] = 0;
+            rgb[2] = 0;
+        }
+    });
 
     return newImg;
 }
 
 QImage DImageHandler::binaryzation(const QImage &img)
 {
-    QImage imgCopy;
-
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    uint8_t *rgb = imgCopy.bits();
-
-    int size = img.width() * img.height();
-
-#pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        int gray = (rgb[i * 3] + rgb[i * 3 + 1] + rgb[i * 3 + 2]) / 3;
-        int newGray = 0;
-        if (gray > 128)
-            newGray = 255;
-        else
-            newGray = 0;
-        rgb[i * 3] = newGray;
-        rgb[i * 3 + 1] = newGray;
-        rgb[i * 3 + 2] = newGray;
-    }
-
-    return imgCopy;
+    return mapRgb888(img, [](uint8_t *rgb) {
+        const int gray = (rgb[0] + rgb[1] + rgb[2]) / 3;
+        const uint8_t newGray = gray > 128 ? 255 : 0;
+        rgb[0] = newGray;
+        rgb[1] = newGray;
+        rgb[2] = newGray;
+    });
 }
 
 QImage DImageHandler::grayScale(const QImage &img)
 {
-    QImage imgCopy;
-
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    uint8_t *rgb = imgCopy.bits();
-    int size = img.width() * img.height();
-
-#pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        int average = (rgb[i * 3] * 299 + rgb[i * 3 + 1] * 587 + rgb[i * 3 + 1] * 114 + 500) / 1000;
-        rgb[i * 3] = average;
-        rgb[i * 3 + 1] = average;
-        rgb[i * 3 + 2] = average;
-    }
-
-    return imgCopy;
+    return mapRgb888(img, [](uint8_t *rgb) {
+        const uint8_t gray = grayValue(rgb);
+        rgb[0] = gray;
+        rgb[1] = gray;
+        rgb[2] = gray;
+    });
 }
 
 QImage DImageHandler::laplaceSharpen(const QImage &img)
 {
-    QImage imgCopy;
-    int width = img.width();
-    int height = img.height();
-    int window[3][3] = {0, -1, 0, -1, 4, -1, 0, -1, 0};
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(width, height, QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    QImage imgCopyrgbImg = QImage(img).convertToFormat(QImage::Format_RGB888);
-    uint8_t *rgbImg = imgCopyrgbImg.bits();
-    uint8_t *rgb = imgCopy.bits();
-    int nRowBytes = (width * 24 + 31) / 32 * 4;
-
-#pragma omp parallel for
-    for (int x = 1; x < img.width(); x++) {
-        for (int y = 1; y < img.height(); y++) {
-            int sumR = 0;
-            int sumG = 0;
-            int sumB = 0;
-            int lineNum_24 = 0;
-
-            for (int m = x - 1; m <= x + 1; m++)
-                for (int n = y - 1; n <= y + 1; n++) {
-                    if (m >= 0 && m < width && n < height) {
-                        lineNum_24 = n * nRowBytes;
-                        sumR += rgbImg[lineNum_24 + m * 3] * window[n - y + 1][m - x + 1];
-                        sumG += rgbImg[lineNum_24 + m * 3 + 1] * window[n - y + 1][m - x + 1];
-                        sumB += rgbImg[lineNum_24 + m * 3 + 2] * window[n - y + 1][m - x + 1];
-                    }
-                }
+    const QImage source = toRgb888(img);
+    if (source.isNull()) {
+        return QImage();
+    }
 
-            int old_r = rgbImg[lineNum_24 + x * 3];
-            sumR += old_r;
-            sumR = qBound(0, sumR, 255);
-
-            int old_g = rgbImg[lineNum_24 + x * 3 + 1];
-            sumG += old_g;
-            sumG = qBound(0, sumG, 255);
-
-            int old_b = rgbImg[lineNum_24 + x * 3 + 2];
-            sumB += old_b;
-            sumB = qBound(0, sumB, 255);
-            lineNum_24 = y * nRowBytes;
-            rgb[lineNum_24 + x * 3] = sumR;
-            rgb[lineNum_24 + x * 3 + 1] = sumG;
-            rgb[lineNum_24 + x * 3 + 2] = sumB;
+    const int width = source.width();
+    QImage imgCopy = QImage(width, source.height(), QImage::Format_RGB888);
+    uint8_t *bits = imgCopy.bits();
+    const auto bytesPerLine = imgCopy.bytesPerLine();
+
+    // The pixel adds the laplacian of {0, -1, 0, -1, 4, -1, 0, -1, 0}.
+    forEachRgb888Neighborhood(source, [&](int x, int y, const uint8_t *const *rows) {
+        const int center = x * 3;
+        const int left = qMax(0, x - 1) * 3;
+        const int right = qMin(width - 1, x + 1) * 3;
+        uint8_t *rgb = bits + y * bytesPerLine + center;
+
+        for (int c = 0; c < 3; c++) {
+            const int sum = 5 * rows[1][center + c] - rows[0][center + c] - rows[2][center + c] - rows[1][left + c] -
+                            rows[1][right + c];
+            rgb[c] = qBound(0, sum, 255);
         }
-    }
+    });
 
     return imgCopy;
 }
 
 QImage DImageHandler::sobelEdgeDetector(const QImage &img)
 {
-    double *Gx = new double[9];
-    double *Gy = new double[9];
-
-    /* Sobel */
-    Gx[0] = 1.0;
-    Gx[1] = 0.0;
-    Gx[2] = -1.0;
-    Gx[3] = 2.0;
-    Gx[4] = 0.0;
-    Gx[5] = -2.0;
-    Gx[6] = 1.0;
-    Gx[7] = 0.0;
-    Gx[8] = -1.0;
-
-    Gy[0] = -1.0;
-    Gy[1] = -2.0;
-    Gy[2] = -1.0;
-    Gy[3] = 0.0;
-    Gy[4] = 0.0;
-    Gy[5] = 0.0;
-    Gy[6] = 1.0;
-    Gy[7] = 2.0;
-    Gy[8] = 1.0;
-
-    QImage grayImage = grayScale(img);
-    int height = grayImage.height();
-    int width = grayImage.width();
+    const QImage grayImage = grayScale(img);
+    const int height = grayImage.height();
+    const int width = grayImage.width();
     QImage imgCopy = QImage(width, height, QImage::Format_RGB888);
-
-    uint8_t *rgbImg = grayImage.bits();
-    uint8_t *rgb = imgCopy.bits();
-
-    int nRowBytes = (width * 24 + 31) / 32 * 4;
-
-    float *sobel_norm = new float[width * height];
-    float max = 0.0;
-    QColor my_color;
-
-    for (int x = 0; x < width; x++) {
-        for (int y = 0; y < height; y++) {
-            double value_gx = 0.0;
-            double value_gy = 0.0;
-
-            for (int k = 0; k < 3; k++) {
-                for (int p = 0; p < 3; p++) {
-                    if ((x + 1 + 1 - k < width) && (y + 1 + 1 - p < height)) {
-                        int lineNum_24 = (y + 1 + 1 - p) * nRowBytes;
-                        value_gx += Gx[p * 3 + k] * rgbImg[lineNum_24 + (x + 1 + 1 - k) * 3];
-                        value_gy += Gy[p * 3 + k] * rgbImg[lineNum_24 + (x + 1 + 1 - k) * 3];
-                    }
-                }
-                sobel_norm[x + y * width] = abs(value_gx) + abs(value_gy);
-
-                max = sobel_norm[x + y * width] > max ? sobel_norm[x + y * width] : max;
-            }
+    if (grayImage.isNull()) {
+        return imgCopy;
+    }
+
+    QVector<float> sobelNorm(width * height);
+    float *norm = sobelNorm.data();
+
+    // The channels of the gray image are equal, only the red one is used.
+    forEachRgb888Neighborhood(grayImage, [&](int x, int y, const uint8_t *const *rows) {
+        const int left = qMax(0, x - 1) * 3;
+        const int center = x * 3;
+        const int right = qMin(width - 1, x + 1) * 3;
+
+        // Gx = {1, 0, -1, 2, 0, -2, 1, 0, -1}, Gy = {-1, -2, -1, 0, 0, 0, 1, 2, 1}
+        const int gx = rows[0][left] - rows[0][right] + 2 * (rows[1][left] - rows[1][right]) + rows[2][left] - rows[2][right];
+        const int gy = rows[2][left] - rows[0][left] + 2 * (rows[2][center] - rows[0][center]) + rows[2][right] - rows[0][right];
+        norm[x + y * width] = qAbs(gx) + qAbs(gy);
+    });
+
+    const float max = *std::max_element(sobelNorm.constBegin(), sobelNorm.constEnd());
+    uint8_t *bits = imgCopy.bits();
+    const auto bytesPerLine = imgCopy.bytesPerLine();
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        uint8_t *rgb = bits + y * bytesPerLine;
+        for (int x = 0; x < width; x++, rgb += 3) {
+            const uint8_t value = max > 0 ? 255 - int(255.0f * norm[x + y * width] / max) : 255;
+            rgb[0] = value;
+            rgb[1] = value;
+            rgb[2] = value;
         }
     }
 
-    for (int i = 0; i < width; i++) {
-        for (int j = 0; j < height; j++) {
-            my_color.setHsv(0, 0, 255 - int(255.0 * sobel_norm[i + j * width] / max));
-
-            int lineNum_24 = j * nRowBytes;
-            rgb[lineNum_24 + i * 3] = my_color.red();
-            rgb[lineNum_24 + i * 3 + 1] = my_color.green();
-            rgb[lineNum_24 + i * 3 + 2] = my_color.blue();
-        }
-    }
-    delete[] sobel_norm;
-
     return imgCopy;
 }
 
 QImage DImageHandler::changeLightAndContrast(const QImage &img, int light, int contrast)
 {
-    QImage imgCopy;
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    uint8_t *rgb = imgCopy.bits();
-    if (nullptr == rgb) {
-        return QImage();
-    }
-
-    int size = img.width() * img.height();
-
-#pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        int r;
-        int g;
-        int b;
-        r = light * 0.01 * rgb[i * 3] - 150 + contrast;
-        g = light * 0.01 * rgb[i * 3 + 1] - 150 + contrast;
-        b = light * 0.01 * rgb[i * 3 + 2] - 150 + contrast;
-
-        rgb[i * 3] = qBound(0, r, 255);
-        rgb[i * 3 + 1] = qBound(0, g, 255);
-        rgb[i * 3 + 2] = qBound(0, b, 255);
-    }
-
-    return imgCopy;
+    return mapRgb888Channels(img, [light, contrast](int value) { return int(light * 0.01 * value - 150 + contrast); });
 }
 
 QImage DImageHandler::changeBrightness(const QImage &img, int brightness)
 {
-    QImage imgCopy;
-
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    uint8_t *rgb = imgCopy.bits();
-    int size = img.width() * img.height();
-
-#pragma omp parallel for
-    for (int i = 0; i < size; i++) {
-        int r = rgb[i * 3] + brightness;
-        int g = rgb[i * 3 + 1] + brightness;
-        int b = rgb[i * 3 + 2] + brightness;
-        r = qBound(0, r, 255);
-        g = qBound(0, g, 255);
-        b = qBound(0, b, 255);
-        rgb[i * 3] = r;
-        rgb[i * 3 + 1] = g;
-        rgb[i * 3 + 2] = b;
-    }
-
-    return imgCopy;
+    return mapRgb888Channels(img, [brightness](int value) { return value + brightness; });
 }
 
 QImage DImageHandler::changeTransparency(const QImage &img, int transparency)
 {
-    QImage newImage(img.width(), img.height(), QImage::Format_ARGB32);
-    QColor oldColor;
-    int r, g, b;
-    for (int x = 0; x < newImage.width(); x++) {
-        for (int y = 0; y < newImage.height(); y++) {
-            oldColor = QColor(img.pixel(x, y));
+    QImage newImage = img.convertToFormat(QImage::Format_ARGB32);
+    if (newImage.isNull()) {
+        return newImage;
+    }
 
-            r = oldColor.red();
-            g = oldColor.green();
-            b = oldColor.blue();
+    const int width = newImage.width();
+    const int height = newImage.height();
+    uint8_t *bits = newImage.bits();
+    const auto bytesPerLine = newImage.bytesPerLine();
 
-            newImage.setPixel(x, y, qRgba(r, g, b, transparency));
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        QRgb *line = reinterpret_cast<QRgb *>(bits + y * bytesPerLine);
+        for (int x = 0; x < width; x++) {
+            line[x] = qRgba(qRed(line[x]), qGreen(line[x]), qBlue(line[x]), transparency);
         }
     }
 
@@ -1457,29 +1580,35 @@ QImage DImageHandler::changeTransparency(const QImage &img, int transparency)
 
 QImage DImageHandler::changeStauration(const QImage &img, int saturation)
 {
-    int r, g, b, rgbMin, rgbMax;
-    float k = saturation / 100.0f * 128;
-    int alpha = 0;
-
-    QImage newImage(img);
-    QColor tmpColor;
-
-    for (int x = 0; x < newImage.width(); x++) {
-        for (int y = 0; y < newImage.height(); y++) {
-            tmpColor = QColor(img.pixel(x, y));
-            r = tmpColor.red();
-            g = tmpColor.green();
-            b = tmpColor.blue();
-
-            rgbMin = qMin(qMin(r, g), b);
-            rgbMax = qMax(qMax(r, g), b);
-
-            int delta = (rgbMax - rgbMin);
-            int value = (rgbMax + rgbMin);
+    QImage newImage = img.convertToFormat(QImage::Format_ARGB32);
+    if (newImage.isNull()) {
+        return newImage;
+    }
+
+    const float k = saturation / 100.0f * 128;
+    const int width = newImage.width();
+    const int height = newImage.height();
+    uint8_t *bits = newImage.bits();
+    const auto bytesPerLine = newImage.bytesPerLine();
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; y++) {
+        QRgb *line = reinterpret_cast<QRgb *>(bits + y * bytesPerLine);
+        for (int x = 0; x < width; x++) {
+            int r = qRed(line[x]);
+            int g = qGreen(line[x]);
+            int b = qBlue(line[x]);
+
+            const int rgbMin = qMin(qMin(r, g), b);
+            const int rgbMax = qMax(qMax(r, g), b);
+            const int delta = (rgbMax - rgbMin);
+            const int value = (rgbMax + rgbMin);
             if (delta == 0) {
                 continue;
             }
-            int L = value >> 1;
+
+            const int L = value >> 1;
+            int alpha = 0;
             if (k >= 0) {
                 int S = L < 128 ? (delta << 7) / value : (delta << 7) / (510 - value);
                 alpha = k + S >= 128 ? S : 128 - k;
@@ -1490,39 +1619,34 @@ QImage DImageHandler::changeStauration(const QImage &img, int saturation)
             r = r + ((r - L) * alpha >> 7);
             g = g + ((g - L) * alpha >> 7);
             b = b + ((b - L) * alpha >> 7);
-            r = qBound(0, r, 255);
-            g = qBound(0, g, 255);
-            b = qBound(0, b, 255);
-            newImage.setPixel(x, y, qRgb(r, g, b));
+            line[x] = qRgba(qBound(0, r, 255), qBound(0, g, 255), qBound(0, b, 255), qAlpha(line[x]));
         }
     }
 
-    return newImage;
+    return newImage.convertToFormat(img.format());
 }
 
 QImage DImageHandler::replacePointColor(const QImage &img, QColor oldColor, QColor newColor)
 {
-    QImage imgCopy = img;
-    if (img.format() != QImage::Format_RGB888) {
-        imgCopy = QImage(img).convertToFormat(QImage::Format_RGB888);
-    } else {
-        imgCopy = QImage(img);
-    }
-    uint8_t *rgb = imgCopy.bits();
-    if (nullptr == rgb) {
-        return QImage();
-    }
-    QColor frontColor;
-
-    for (int x = 0; x < img.width(); ++x) {
-        for (int y = 0; y < img.height(); ++y) {
-            if (imgCopy.pixelColor(x, y) == oldColor) {
-                imgCopy.setPixelColor(x, y, newColor);
-            }
+    // The RGB888 pixels are opaque.
+    if (oldColor.alpha() != 255) {
+        return toRgb888(img);
+    }
+
+    const int oldRed = oldColor.red();
+    const int oldGreen = oldColor.green();
+    const int oldBlue = oldColor.blue();
+    const uint8_t newRed = newColor.red();
+    const uint8_t newGreen = newColor.green();
+    const uint8_t newBlue = newColor.blue();
+
+    return mapRgb888(img, [=](uint8_t *rgb) {
+        if (rgb[0] == oldRed && rgb[1] == oldGreen && rgb[2] == oldBlue) {
+            rgb[0] = newRed;
+            rgb[1] = newGreen;
+            rgb[2] = newBlue;
         }
-    }
-
-    return imgCopy;
+    });
 }
 
 QImage DImageHandler::flipHorizontal(const QImage &img)
@@ -10,6 +10,7 @@
 #include <QFileInfo>
 #include <QDateTime>
 #include <QImageReader>
+#include <QBuffer>
 
 DLibFreeImage::DLibFreeImage()
 {
@@ -106,11 +107,32 @@ bool DLibFreeImage::findMetaData(FREE_IMAGE_MDMODEL model, FIBITMAP *dib, QHash<
 
 QHash<QString, QString> DLibFreeImage::findAllMetaData(const QString &fileName)
 {
-    FIBITMAP *dib = readFileToFIBITMAP(fileName, FIF_LOAD_NOPIXELS);
-    QHash<QString, QString> admMap;
+    DImageHeaderInfo header;
+    readHeaderInfo(fileName, header);
+    return findAllMetaData(fileName, header);
+}
+
+bool DLibFreeImage::readHeaderInfo(const QString &fileName, DImageHeaderInfo &header, FREE_IMAGE_FORMAT fif)
+{
+    // Only the header and the meta data are parsed, one open answers all of them.
+    FIBITMAP *dib = readFileToFIBITMAP(fileName, FIF_LOAD_NOPIXELS, fif, &header.format);
+    if (!dib) {
+        return false;
+    }
+
+    header.size = QSize(static_cast<int>(FreeImage_GetWidth(dib)), static_cast<int>(FreeImage_GetHeight(dib)));
     for (int i = FIMD_EXIF_MAIN; i <= FIMD_IPTC; ++i) {
-        findMetaData(FREE_IMAGE_MDMODEL(i), dib, admMap);
+        findMetaData(FREE_IMAGE_MDMODEL(i), dib, header.metaData);
     }
+    header.orientation = findOrientation(dib);
+
+    FreeImage_Unload(dib);
+    return true;
+}
+
+QHash<QString, QString> DLibFreeImage::findAllMetaData(const QString &fileName, const DImageHeaderInfo &header)
+{
+    QHash<QString, QString> admMap = header.metaData;
 
     QFileInfo info(fileName);
     if (admMap.contains("DateTime")) {
@@ -123,11 +145,11 @@ QHash<QString, QString> DLibFreeImage::findAllMetaData(const QString &fileName)
     admMap.insert("DateTimeDigitized", info.lastModified().toString("yyyy/MM/dd HH:mm"));
 
     // The value of width and height might incorrect
-    QImageReader reader(fileName);
-    int w = reader.size().width();
-    w = w > 0 ? w : static_cast<int>(FreeImage_GetWidth(dib));
-    int h = reader.size().height();
-    h = h > 0 ? h : static_cast<int>(FreeImage_GetHeight(dib));
+    const QSize readerSize = QImageReader(fileName).size();
+    int w = readerSize.width();
+    w = w > 0 ? w : header.size.width();
+    int h = readerSize.height();
+    h = h > 0 ? h : header.size.height();
     admMap.insert("Dimension", QString::number(w) + "x" + QString::number(h));
     admMap.insert("FileName", info.fileName());
     admMap.insert("FileFormat", info.suffix());
@@ -144,11 +166,10 @@ QHash<QString, QString> DLibFreeImage::findAllMetaData(const QString &fileName)
     };
     admMap.insert("FileSize", formatDataSize(info.size()));
 
-    FreeImage_Unload(dib);
     return admMap;
 }
 
-FIBITMAP *DLibFreeImage::readFileToFIBITMAP(const QString &fileName, int flags, FREE_IMAGE_FORMAT fif)
+FIBITMAP *DLibFreeImage::readFileToFIBITMAP(const QString &fileName, int flags, FREE_IMAGE_FORMAT fif, FREE_IMAGE_FORMAT *detectedFif)
 {
     QByteArray b = fileName.toUtf8();
     const char *pc = b.data();
@@ -161,6 +182,10 @@ FIBITMAP *DLibFreeImage::readFileToFIBITMAP(const QString &fileName, int flags,
         }
     }
 
+    if (detectedFif) {
+        *detectedFif = fif;
+    }
+
     if ((fif != FIF_UNKNOWN) && FreeImage_FIFSupportsReading(fif)) {
         FIBITMAP *dib = FreeImage_Load(fif, pc, flags);
         return dib;
@@ -279,13 +304,19 @@ QImage DLibFreeImage::FIBITMAPToQImage(FIBITMAP *dib) const
 }
 
 ExifImageOrientation DLibFreeImage::imageOrientation(const QString &fileName)
+{
+    FIBITMAP *dib = readFileToFIBITMAP(fileName, FIF_LOAD_NOPIXELS);
+    ExifImageOrientation oreintation = findOrientation(dib);
+    FreeImage_Unload(dib);
+    return oreintation;
+}
+
+ExifImageOrientation DLibFreeImage::findOrientation(FIBITMAP *dib)
 {
     ExifImageOrientation oreintation = Undefined;
 
-    FIBITMAP *dib = readFileToFIBITMAP(fileName, FIF_LOAD_NOPIXELS);
     // Metadata may be null sometimes, check if metadata exist.
     if (0 == FreeImage_GetMetadataCount(FIMD_EXIF_MAIN, dib)) {
-        FreeImage_Unload(dib);
         return oreintation;
     }
 
@@ -302,7 +333,6 @@ ExifImageOrientation DLibFreeImage::imageOrientation(const QString &fileName)
         FreeImage_FindCloseMetadata(mdhandle);
     }
 
-    FreeImage_Unload(dib);
     return oreintation;
 }
 
@@ -350,11 +380,16 @@ bool DLibFreeImage::rotateImageFile(const QString &fileName, int angle, QString
 
 DLibRaw::DLibRaw()
 {
-    libraw = new QLibrary("libraw");
-    if (!libraw->load()) {
-        delete libraw;
-        libraw = nullptr;
-        return;
+    // Prefer the thread safe build, the thumbnails are created in several threads.
+    libraw = new QLibrary("libraw_r");
+    reentrant = libraw->load();
+    if (!reentrant) {
+        libraw->setFileName("libraw");
+        if (!libraw->load()) {
+            delete libraw;
+            libraw = nullptr;
+            return;
+        }
     }
 
     auto initFunctionError = [this]() {
@@ -390,6 +425,13 @@ DLibRaw::~DLibRaw()
     }
 }
 
+Q_GLOBAL_STATIC(DLibRaw, _libRaw)
+
+DLibRaw *DLibRaw::instance()
+{
+    return _libRaw();
+}
+
 bool DLibRaw::isValid()
 {
     return libraw;
@@ -397,6 +439,7 @@ bool DLibRaw::isValid()
 
 QImage DLibRaw::loadImage(const QString &fileName, QString &errString, QSize requestSize)
 {
+    QMutexLocker locker(reentrant ? nullptr : &apiMutex);
     QImage image;
     libraw_data_t *rawData = libraw_init(0);
     if (!rawData) {
@@ -418,6 +461,7 @@ QImage DLibRaw::loadImage(const QString &fileName, QString &errString, QSize req
 
 QImage DLibRaw::loadImage(QByteArray &data, QString &errString, QSize requestSize)
 {
+    QMutexLocker locker(reentrant ? nullptr : &apiMutex);
     QImage image;
     libraw_data_t *rawData = libraw_init(0);
     if (!rawData) {
@@ -437,6 +481,32 @@ QImage DLibRaw::loadImage(QByteArray &data, QString &errString, QSize requestSiz
     return image;
 }
 
+QSize DLibRaw::imageSize(const QString &fileName, QString &errString)
+{
+    QMutexLocker locker(reentrant ? nullptr : &apiMutex);
+    QSize size;
+    libraw_data_t *rawData = libraw_init(0);
+    if (!rawData) {
+        errString = QStringLiteral("Create new libraw object failed!");
+        return size;
+    }
+
+    // Only the header is parsed, the image data is not unpacked.
+    int ret = libraw_open_file(rawData, fileName.toUtf8().data());
+    if (LIBRAW_SUCCESS == ret) {
+        size = QSize(rawData->sizes.width, rawData->sizes.height);
+        // Rotated 90 degrees.
+        if (5 == rawData->sizes.flip || 6 == rawData->sizes.flip) {
+            size.transpose();
+        }
+    } else {
+        errString = errorString(ret);
+    }
+    libraw_close(rawData);
+
+    return size;
+}
+
 int DLibRaw::readImage(libraw_data_t *rawData, QImage &image, QSize requestSize)
 {
     if (!rawData) {
@@ -454,6 +524,7 @@ int DLibRaw::readImage(libraw_data_t *rawData, QImage &image, QSize requestSize)
             output = libraw_dcraw_make_mem_thumb(rawData, &errCode);
             if (LIBRAW_SUCCESS != errCode && output) {
                 libraw_dcraw_clear_mem(output);
+                output = nullptr;
             }
         }
     }
@@ -481,7 +552,22 @@ int DLibRaw::readImage(libraw_data_t *rawData, QImage &image, QSize requestSize)
     }
 
     if (LIBRAW_IMAGE_JPEG == output->type) {
-        image.loadFromData(output->data, static_cast<int>(output->data_size), "JPEG");
+        QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char *>(output->data),
+                                                  static_cast<int>(output->data_size));
+        QBuffer buffer(&data);
+        QImageReader reader(&buffer, "JPEG");
+        if (!requestSize.isEmpty()) {
+            // The embedded preview may be as large as the raw image, let the jpeg decoder
+            // scale it down. The request size is applied to the image before rotation.
+            const bool transposed = (5 == rawData->sizes.flip || 6 == rawData->sizes.flip);
+            const QSize boundSize = transposed ? requestSize.transposed() : requestSize;
+            const QSize size = reader.size();
+            if (size.width() > boundSize.width() || size.height() > boundSize.height()) {
+                reader.setScaledSize(size.scaled(boundSize, Qt::KeepAspectRatio));
+            }
+        }
+        image = reader.read();
+
         if (rawData->sizes.flip) {
             QTransform rotation;
             int angle = 0;
@@ -12,13 +12,27 @@
 
 #include "dsvgrenderer.h"
 #include "dobject_p.h"
+#include "private/dcachestatisticscounter_p.h"
+#include "private/dsvghrefrewriter_p.h"
+#include "dtrace_p.h"
 
 #include <QPainter>
 #include <QFile>
 #include <QDebug>
 #include <QGuiApplication>
 #include <QLibrary>
-#include <QXmlStreamReader>
+#include <QCache>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QSharedPointer>
+#include <QThread>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <vector>
 
 DCORE_USE_NAMESPACE
 
@@ -94,20 +108,164 @@ private:
 };
 #endif
 
+// The serial identifies the document loaded by a renderer, it's never reused.
+struct DSvgImageCacheKey {
+    quint64 serial;
+    QSize size;
+    QString elementId;
+    QRectF viewBox;
+};
+
+static inline bool operator==(const DSvgImageCacheKey &k1, const DSvgImageCacheKey &k2)
+{
+    return k1.serial == k2.serial && k1.size == k2.size && k1.elementId == k2.elementId
+            && k1.viewBox == k2.viewBox;
+}
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+static inline size_t qHash(const DSvgImageCacheKey &key, size_t seed = 0)
+#else
+static inline uint qHash(const DSvgImageCacheKey &key, uint seed = 0)
+#endif
+{
+    return ::qHash(key.serial, seed) ^ ::qHash(key.elementId) ^ (::qHash(key.size.width()) * 31 + key.size.height())
+            ^ (::qHash(key.viewBox.x()) * 131 + ::qHash(key.viewBox.y()))
+            ^ (::qHash(key.viewBox.width()) * 1031 + ::qHash(key.viewBox.height()));
+}
+
+// The rendered images of all renderers share one budget, the images of a renderer are
+// removed when it loads another document or it's destroyed, the keys of each serial are
+// listed so that only its entries are visited. The limit is in kilobytes, it can be
+// changed by D_DTK_SVG_IMAGE_CACHE_LIMIT, 0 disables the cache.
+class DSvgImageCache
+{
+public:
+    DSvgImageCache()
+    {
+        bool ok = false;
+        int limit = qEnvironmentVariableIntValue("D_DTK_SVG_IMAGE_CACHE_LIMIT", &ok);
+        if (!ok || limit < 0)
+            limit = 10240;
+        cache.setMaxCost(limit * 1024);
+    }
+
+    bool find(const DSvgImageCacheKey &key, QImage *image)
+    {
+        QMutexLocker locker(&mutex);
+        const QImage *cached = cache.object(key);
+        if (!cached) {
+            statistics.miss();
+            return false;
+        }
+        statistics.hit();
+        *image = *cached;
+        return true;
+    }
+
+    void insert(const DSvgImageCacheKey &key, const QImage &image)
+    {
+        QMutexLocker locker(&mutex);
+        if (image.isNull() || cache.maxCost() <= 0)
+            return;
+
+        const int size = cache.size();
+        const bool replaced = cache.contains(key);
+        if (!cache.insert(key, new QImage(image), static_cast<int>(image.sizeInBytes())))
+            return;
+        statistics.countInsertion(size, replaced, cache.size());
+        if (replaced)
+            return;
+
+        // The keys evicted by QCache are left in the list, the list is pruned when it
+        // doubles, so it's bounded by twice the entries of the serial.
+        SerialKeys &serialKeys = keysOfSerial[key.serial];
+        serialKeys.keys.append(key);
+        if (serialKeys.keys.size() >= serialKeys.pruneSize) {
+            QSet<DSvgImageCacheKey> seen;
+            serialKeys.keys.erase(std::remove_if(serialKeys.keys.begin(), serialKeys.keys.end(),
+                                                 [this, &seen](const DSvgImageCacheKey &key) {
+                if (!cache.contains(key) || seen.contains(key))
+                    return true;
+                seen.insert(key);
+                return false;
+            }), serialKeys.keys.end());
+            serialKeys.pruneSize = qMax(16, serialKeys.keys.size() * 2);
+        }
+    }
+
+    void remove(quint64 serial)
+    {
+        QMutexLocker locker(&mutex);
+        const auto it = keysOfSerial.find(serial);
+        if (it == keysOfSerial.end())
+            return;
+
+        for (const DSvgImageCacheKey &key : std::as_const(it->keys)) {
+            if (cache.remove(key))
+                statistics.evict();
+        }
+        keysOfSerial.erase(it);
+    }
+
+private:
+    struct SerialKeys {
+        QVector<DSvgImageCacheKey> keys;
+        int pruneSize = 16;
+    };
+
+    QMutex mutex;
+    QCache<DSvgImageCacheKey, QImage> cache;
+    QHash<quint64, SerialKeys> keysOfSerial;
+    // Declared last, it's unregistered before the cache is destroyed.
+    DCacheStatisticsCounter statistics { "svgrenderer.image", [this](DCacheStatistics::Cache *statistics) {
+        QMutexLocker locker(&mutex);
+        statistics->bytes = cache.totalCost();
+        statistics->entries = cache.size();
+        statistics->maxBytes = cache.maxCost();
+    }};
+};
+Q_GLOBAL_STATIC(DSvgImageCache, _imageCache)
+
+static inline quint64 nextImageSerial()
+{
+    static QAtomicInteger<quint64> serial(0);
+    return ++serial;
+}
+
 class DSvgRendererPrivate : public DObjectPrivate
 {
 public:
     explicit DSvgRendererPrivate(DSvgRenderer *qq);
+    ~DSvgRendererPrivate();
 
     QImage getImage(const QSize &size, const QString &elementId) const;
+    QList<QImage> getImages(const QVector<DSvgImageCacheKey> &keys) const;
+    QRectF currentViewBox() const;
+    bool findImage(const DSvgImageCacheKey &key, QImage *image) const;
+    void insertImage(const DSvgImageCacheKey &key, const QImage &image) const;
+    void clearImages();
 
 #ifndef DTK_DISABLE_LIBRSVG
+    static QImage renderImage(RsvgHandle *handle, const DSvgImageCacheKey &key);
+
     RsvgHandle *handle = nullptr;
+    // The workers of getImages() load their own handles from it.
+    QByteArray contents;
     QSize defaultSize;
     mutable QRectF viewBox;
 #else
+    QImage renderImage(const DSvgImageCacheKey &key) const;
+
     QSvgRenderer *qRenderer = nullptr;
 #endif
+
+    // Guards the rendering, a RsvgHandle can't be used in several threads at once.
+    mutable QMutex mutex;
+    // The key of the rendered images of the current document in _imageCache.
+    quint64 imageSerial;
+    // The images are cached from the second rendering of a document, the renderers
+    // created for one painting don't fill the shared cache.
+    mutable bool rendered = false;
 };
 
 DSvgRendererPrivate::DSvgRendererPrivate(DSvgRenderer *qq)
@@ -115,44 +273,249 @@ DSvgRendererPrivate::DSvgRendererPrivate(DSvgRenderer *qq)
 #ifdef DTK_DISABLE_LIBRSVG
     , qRenderer(new QSvgRenderer(qq)) // qq ==> QObject
 #endif
+    , imageSerial(nextImageSerial())
 {
-
 }
 
-QImage DSvgRendererPrivate::getImage(const QSize &size, const QString &elementId) const
+DSvgRendererPrivate::~DSvgRendererPrivate()
 {
+    if (rendered && !_imageCache.isDestroyed())
+        _imageCache->remove(imageSerial);
+}
+
 #ifndef DTK_DISABLE_LIBRSVG
-    if (!RSvg::instance()->isValid())
-        return QImage();
+QImage DSvgRendererPrivate::renderImage(RsvgHandle *handle, const DSvgImageCacheKey &key)
+{
+    D_TRACE_SCOPE("DSvgRenderer::renderImage", "dtkgui", key.elementId);
 
-    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+    QImage image(key.size, QImage::Format_ARGB32_Premultiplied);
 
     image.fill(Qt::transparent);
 
+    const QRectF &viewBox = key.viewBox;
     cairo_surface_t *surface = RSvg::instance()->cairo_image_surface_create_for_data(image.bits(), CAIRO_FORMAT_ARGB32, image.width(), image.height(), image.bytesPerLine());
     cairo_t *cairo = RSvg::instance()->cairo_create(surface);
     RSvg::instance()->cairo_scale(cairo, image.width() / viewBox.width(), image.height() / viewBox.height());
     RSvg::instance()->cairo_translate(cairo, -viewBox.x(), -viewBox.y());
 
-    if (elementId.isEmpty())
+    if (key.elementId.isEmpty())
         RSvg::instance()->rsvg_handle_render_cairo(handle, cairo);
     else
-        RSvg::instance()->rsvg_handle_render_cairo_sub(handle, cairo, elementId.toUtf8().constData());
+        RSvg::instance()->rsvg_handle_render_cairo_sub(handle, cairo, key.elementId.toUtf8().constData());
 
     RSvg::instance()->cairo_destroy(cairo);
     RSvg::instance()->cairo_surface_destroy(surface);
 
     return image;
+}
+
+// The images of a DSvgRenderer::toImages() call, they are rendered by the calling thread
+// and the workers in the global thread pool. The jobs are taken one by one, every worker
+// renders with its own RsvgHandle and cairo context.
+class DSvgRenderBatch
+{
+public:
+    DSvgRenderBatch(const QByteArray &contents, const QVector<DSvgImageCacheKey> &keys)
+        : contents(contents)
+        , keys(keys)
+        , images(static_cast<size_t>(keys.size()))
+    {
+    }
+
+    void run(RsvgHandle *handle)
+    {
+        for (int i = next.fetchAndAddRelaxed(1); i < keys.size(); i = next.fetchAndAddRelaxed(1)) {
+            images[static_cast<size_t>(i)] = DSvgRendererPrivate::renderImage(handle, keys.at(i));
+            done.release();
+        }
+    }
+
+    void runInWorker()
+    {
+        // All the jobs are taken before the worker is started.
+        if (next.loadAcquire() >= keys.size())
+            return;
+
+        GError *error = nullptr;
+        RsvgHandle *handle = RSvg::instance()->rsvg_handle_new_from_data(reinterpret_cast<const guint8 *>(contents.constData()),
+                                                                          static_cast<gsize>(contents.size()), &error);
+        if (error) {
+            // The remaining jobs are rendered by the calling thread.
+            g_error_free(error);
+            if (handle)
+                RSvg::instance()->g_object_unref(handle);
+            return;
+        }
+
+        run(handle);
+        RSvg::instance()->g_object_unref(handle);
+    }
+
+    void waitForDone()
+    {
+        done.acquire(keys.size());
+    }
+
+    const QByteArray contents;
+    const QVector<DSvgImageCacheKey> keys;
+    // Every job writes its own element, it's read after waitForDone().
+    std::vector<QImage> images;
+
+private:
+    QAtomicInt next;
+    QSemaphore done;
+};
+
+class DSvgRenderWorker : public QRunnable
+{
+public:
+    explicit DSvgRenderWorker(const QSharedPointer<DSvgRenderBatch> &batch)
+        : batch(batch) {}
+
+    void run() override {
+        batch->runInWorker();
+    }
+
+private:
+    QSharedPointer<DSvgRenderBatch> batch;
+};
 #else
-    QImage image(size, QImage::Format_ARGB32_Premultiplied);
+QImage DSvgRendererPrivate::renderImage(const DSvgImageCacheKey &key) const
+{
+    QImage image(key.size, QImage::Format_ARGB32_Premultiplied);
     image.fill(Qt::transparent);
     QPainter pa(&image);
-    if (elementId.isEmpty())
+    if (key.elementId.isEmpty())
         qRenderer->render(&pa);
     else
-        qRenderer->render(&pa, elementId);
+        qRenderer->render(&pa, key.elementId);
+    return image;
+}
+#endif
+
+QRectF DSvgRendererPrivate::currentViewBox() const
+{
+#ifndef DTK_DISABLE_LIBRSVG
+    return viewBox;
+#else
+    return qRenderer->viewBoxF();
+#endif
+}
+
+bool DSvgRendererPrivate::findImage(const DSvgImageCacheKey &key, QImage *image) const
+{
+    // Nothing is cached before the document is rendered.
+    if (!rendered)
+        return false;
+
+#ifdef DTK_DISABLE_LIBRSVG
+    // The frames of an animated document change with time.
+    if (qRenderer->animated())
+        return false;
+#endif
+
+    return _imageCache->find(key, image);
+}
+
+void DSvgRendererPrivate::insertImage(const DSvgImageCacheKey &key, const QImage &image) const
+{
+    if (rendered)
+        _imageCache->insert(key, image);
+}
+
+void DSvgRendererPrivate::clearImages()
+{
+    QMutexLocker locker(&mutex);
+    // Nothing is cached if the document isn't rendered.
+    if (rendered)
+        _imageCache->remove(imageSerial);
+    imageSerial = nextImageSerial();
+    rendered = false;
+}
+
+QImage DSvgRendererPrivate::getImage(const QSize &size, const QString &elementId) const
+{
+#ifndef DTK_DISABLE_LIBRSVG
+    if (!RSvg::instance()->isValid())
+        return QImage();
+#endif
+
+    const DSvgImageCacheKey key {imageSerial, size, elementId, currentViewBox()};
+    QImage image;
+
+    QMutexLocker locker(&mutex);
+    if (findImage(key, &image))
+        return image;
+
+#ifndef DTK_DISABLE_LIBRSVG
+    image = renderImage(handle, key);
+#else
+    image = renderImage(key);
+#endif
+    insertImage(key, image);
+    rendered = true;
+
     return image;
+}
+
+QList<QImage> DSvgRendererPrivate::getImages(const QVector<DSvgImageCacheKey> &keys) const
+{
+    QList<QImage> result;
+#ifndef DTK_DISABLE_LIBRSVG
+    if (!RSvg::instance()->isValid()) {
+        for (int i = 0; i < keys.size(); ++i)
+            result.append(QImage());
+        return result;
+    }
+#endif
+
+    QVector<int> missingIndexes;
+    QVector<DSvgImageCacheKey> missingKeys;
+    QMutexLocker locker(&mutex);
+    for (int i = 0; i < keys.size(); ++i) {
+        QImage image;
+        if (!findImage(keys.at(i), &image)) {
+            missingIndexes.append(i);
+            missingKeys.append(keys.at(i));
+        }
+        result.append(image);
+    }
+
+    if (missingKeys.isEmpty())
+        return result;
+
+    D_TRACE_SCOPE("DSvgRenderer::toImages", "dtkgui", QString::number(missingKeys.size()));
+
+#ifndef DTK_DISABLE_LIBRSVG
+    auto batch = QSharedPointer<DSvgRenderBatch>::create(contents, missingKeys);
+    // Parsing the document again costs about as much as rendering a small image, so
+    // a worker is started for every job but the one rendered by this thread.
+    const int workers = handle ? qMin(missingKeys.size(), QThread::idealThreadCount()) - 1 : 0;
+    for (int i = 0; i < workers; ++i) {
+        if (!QThreadPool::globalInstance()->tryStart(new DSvgRenderWorker(batch)))
+            break;
+    }
+
+    // The jobs not taken by the workers are rendered with the handle of the renderer.
+    batch->run(handle);
+    batch->waitForDone();
+
+    for (int i = 0; i < missingIndexes.size(); ++i) {
+        const QImage &image = batch->images.at(static_cast<size_t>(i));
+        result[missingIndexes.at(i)] = image;
+        insertImage(missingKeys.at(i), image);
+    }
+#else
+    // QSvgRenderer can't be shared between threads, the images are rendered serially.
+    for (int i = 0; i < missingIndexes.size(); ++i) {
+        const QImage image = renderImage(missingKeys.at(i));
+        result[missingIndexes.at(i)] = image;
+        insertImage(missingKeys.at(i), image);
+    }
 #endif
+    rendered = true;
+
+    return result;
 }
 
 /*!
@@ -292,6 +655,14 @@ bool DSvgRenderer::elementExists(const QString &id) const
 #endif
 }
 
+/*!
+  \brief 将 \a elementId 指定的元素(为空时为整个文档)绘制为 \a sz 大小的图片.
+
+  绘制的结果按 (文档, 大小, 元素, viewBox) 缓存, 重复获取时不会重新绘制. 文档第一次绘制的
+  结果不缓存, 从第二次绘制开始缓存, 加载新的文档或对象被销毁后其缓存被清除. 所有对象共用一个进程内的缓存, 默认最多占用 10240 KB, 可以通过
+  环境变量 D_DTK_SVG_IMAGE_CACHE_LIMIT 修改(单位为 KB, 为 0 时不缓存).
+  \sa toImages()
+ */
 QImage DSvgRenderer::toImage(const QSize sz, const QString &elementId) const
 {
     Q_D(const DSvgRenderer);
@@ -299,47 +670,42 @@ QImage DSvgRenderer::toImage(const QSize sz, const QString &elementId) const
     return d->getImage(sz, elementId);
 }
 
-#ifndef DTK_DISABLE_LIBRSVG
-static QByteArray updateXmlAttribute(const QString &contents)
-{
-    QByteArray data;
-    QXmlStreamWriter writer(&data);
-    QXmlStreamReader reader(contents);
-    while(reader.readNext() != QXmlStreamReader::Invalid && !reader.atEnd()) {
-        if (reader.tokenType() != QXmlStreamReader::StartElement ||
-                !reader.attributes().hasAttribute("href")) {
-            writer.writeCurrentToken(reader);
-            continue;
-        }
-
-        for (const auto &nd : reader.namespaceDeclarations())
-            writer.writeNamespace(nd.namespaceUri().toString(), nd.prefix().toString());
+/*!
+  \brief 将 \a elementId 指定的元素分别绘制为 \a sizes 中各个大小的图片, 返回的图片与 \a sizes 一一对应.
 
-        writer.writeStartElement(reader.namespaceUri().toString(), reader.name().toString());
+  未缓存的图片在全局线程池中并行绘制, 每个线程使用独立的 librsvg 句柄和 cairo 上下文,
+  适用于一次需要多个尺寸的场景, 如主题切换后重新生成图标. 没有 librsvg 时依次绘制.
+  \sa toImage()
+ */
+QList<QImage> DSvgRenderer::toImages(const QList<QSize> &sizes, const QString &elementId) const
+{
+    Q_D(const DSvgRenderer);
 
-        for (const auto &attr : reader.attributes()) {
-            if (attr.name() == QStringLiteral("href")) {
-                writer.writeAttribute("xlink:href", attr.value().toString());
-                continue;
-            }
-            writer.writeAttribute(attr);
-        }
-    }
+    const QRectF viewBox = d->currentViewBox();
+    QVector<DSvgImageCacheKey> keys;
+    keys.reserve(sizes.size());
+    for (const QSize &size : sizes)
+        keys.append({d->imageSerial, size, elementId, viewBox});
 
-    return data;
+    return d->getImages(keys);
 }
 
-static QByteArray format(const QByteArray &contents)
+/*!
+  \brief 将 \a elementIds 中的各个元素分别绘制为 \a sz 大小的图片, 返回的图片与 \a elementIds 一一对应.
+  \overload
+ */
+QList<QImage> DSvgRenderer::toImages(const QSize sz, const QStringList &elementIds) const
 {
-    QXmlStreamReader reader(contents);
-    while (reader.readNextStartElement()) {
-        if (reader.attributes().hasAttribute("href"))
-            return updateXmlAttribute(contents);
-    }
+    Q_D(const DSvgRenderer);
 
-    return contents;
+    const QRectF viewBox = d->currentViewBox();
+    QVector<DSvgImageCacheKey> keys;
+    keys.reserve(elementIds.size());
+    for (const QString &elementId : elementIds)
+        keys.append({d->imageSerial, sz, elementId, viewBox});
+
+    return d->getImages(keys);
 }
-#endif
 
 bool DSvgRenderer::load(const QString &filename)
 {
@@ -348,12 +714,13 @@ bool DSvgRenderer::load(const QString &filename)
 
     if (file.open(QIODevice::ReadOnly)) {
         // TODO: if `href` attribute is adapted after librsvg upgrade revert me
-        return load(format(file.readAll()));
+        return load(DSvgHrefRewriter::rewrite(file.readAll()));
     }
 
     return false;
 #else
     D_D(DSvgRenderer);
+    d->clearImages();
     return d->qRenderer->load(filename);
 #endif
 }
@@ -365,6 +732,8 @@ bool DSvgRenderer::load(const QByteArray &contents)
     if (!RSvg::instance()->isValid())
         return false;
 
+    d->clearImages();
+    d->contents.clear();
     if (d->handle) {
         RSvg::instance()->g_object_unref(d->handle);
         d->handle = nullptr;
@@ -387,9 +756,11 @@ bool DSvgRenderer::load(const QByteArray &contents)
     d->defaultSize.setWidth(rsvg_data.width);
     d->defaultSize.setHeight(rsvg_data.height);
     d->viewBox = QRectF(QPointF(0, 0), d->defaultSize);
+    d->contents = contents;
 
     return true;
 #else
+    d->clearImages();
     return d->qRenderer->load(contents);
 #endif
 }
@@ -3,17 +3,17 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include "dthumbnailprovider.h"
-#include <DObjectPrivate>
+#include "dthumbnailprovider_p.h"
+#include "private/dimagehandlerlibs_p.h"
 
 #include <QCryptographicHash>
 #include <QDir>
 #include <QDateTime>
+#include <QFile>
 #include <QImageReader>
-#include <QQueue>
+#include <QtEndian>
 #include <QMimeType>
-#include <QMimeDatabase>
-#include <QReadWriteLock>
-#include <QWaitCondition>
+#include <QRunnable>
 #include <QPainter>
 #include <QUrl>
 #include <QDebug>
@@ -29,50 +29,157 @@ DGUI_BEGIN_NAMESPACE
 #define THUMBNAIL_LARGE_PATH THUMBNAIL_PATH"/large"
 #define THUMBNAIL_NORMAL_PATH THUMBNAIL_PATH"/normal"
 #define THUMBNAIL_SMALL_PATH THUMBNAIL_PATH"/small"
+// The camera raw formats in shared-mime-info are all sub classes of it.
+#define RAW_MIME_TYPE "image/x-dcraw"
+#define JPEG_MIME_TYPE "image/jpeg"
 
 inline QByteArray dataToMd5Hex(const QByteArray &data)
 {
     return QCryptographicHash::hash(data, QCryptographicHash::Md5).toHex();
 }
 
-#ifndef UT_DThumbnailProviderPrivate
-class DThumbnailProviderPrivate : public DTK_CORE_NAMESPACE::DObjectPrivate
+template<typename T>
+static inline T readExifValue(const uchar *data, bool littleEndian)
 {
-public:
-    explicit DThumbnailProviderPrivate(DThumbnailProvider *qq);
+    return littleEndian ? qFromLittleEndian<T>(data) : qFromBigEndian<T>(data);
+}
 
-    void init();
+// Returns the jpeg data of the thumbnail in the EXIF IFD1 of a jpeg file.
+static QByteArray exifThumbnailData(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+
+    uchar marker[4];
+    if (file.read(reinterpret_cast<char *>(marker), 2) != 2 || marker[0] != 0xff || marker[1] != 0xd8)
+        return QByteArray();
+
+    QByteArray exif;
+    // The APP1 segment is always in front of the image data.
+    while (file.read(reinterpret_cast<char *>(marker), 4) == 4 && marker[0] == 0xff) {
+        // Start of scan or end of image.
+        if (marker[1] == 0xda || marker[1] == 0xd9)
+            break;
+
+        const quint16 length = qFromBigEndian<quint16>(marker + 2);
+        if (length < 2)
+            break;
+
+        if (marker[1] == 0xe1) {
+            exif = file.read(length - 2);
+            if (exif.startsWith(QByteArrayLiteral("Exif\0\0")))
+                break;
+            exif.clear();
+        } else if (!file.seek(file.pos() + length - 2)) {
+            break;
+        }
+    }
 
-    QString sizeToFilePath(DThumbnailProvider::Size size) const;
+    // Skip the "Exif\0\0" header, the offsets are relative to the TIFF header.
+    if (exif.size() < 6 + 8)
+        return QByteArray();
+    const uchar *tiff = reinterpret_cast<const uchar *>(exif.constData()) + 6;
+    const quint32 tiffSize = static_cast<quint32>(exif.size() - 6);
+
+    bool littleEndian = false;
+    if (tiff[0] == 'I' && tiff[1] == 'I')
+        littleEndian = true;
+    else if (tiff[0] != 'M' || tiff[1] != 'M')
+        return QByteArray();
+
+    auto ifdEntryCount = [&](quint32 offset) -> int {
+        if (offset < 8 || offset + 2 > tiffSize)
+            return -1;
+        const quint16 count = readExifValue<quint16>(tiff + offset, littleEndian);
+        // Followed by the offset of the next IFD.
+        if (offset + 2 + count * 12u + 4 > tiffSize)
+            return -1;
+        return count;
+    };
 
-    QString errorString;
-    // MAX
-    qint64 defaultSizeLimit = INT64_MAX;
-    QHash<QMimeType, qint64> sizeLimitHash;
-    QMimeDatabase mimeDatabase;
+    const quint32 ifd0 = readExifValue<quint32>(tiff + 4, littleEndian);
+    const int ifd0Count = ifdEntryCount(ifd0);
+    if (ifd0Count < 0)
+        return QByteArray();
+
+    const quint32 ifd1 = readExifValue<quint32>(tiff + ifd0 + 2 + ifd0Count * 12, littleEndian);
+    const int ifd1Count = ifdEntryCount(ifd1);
+    if (ifd1Count < 0)
+        return QByteArray();
+
+    quint32 thumbOffset = 0;
+    quint32 thumbLength = 0;
+    for (int i = 0; i < ifd1Count; ++i) {
+        const uchar *entry = tiff + ifd1 + 2 + i * 12;
+        const quint16 tag = readExifValue<quint16>(entry, littleEndian);
+        // JPEGInterchangeFormat and JPEGInterchangeFormatLength, both are LONG.
+        if (tag == 0x0201)
+            thumbOffset = readExifValue<quint32>(entry + 8, littleEndian);
+        else if (tag == 0x0202)
+            thumbLength = readExifValue<quint32>(entry + 8, littleEndian);
+    }
 
-    static QSet<QString> hasThumbnailMimeHash;
+    if (thumbOffset == 0 || thumbLength == 0 || quint64(thumbOffset) + thumbLength > tiffSize)
+        return QByteArray();
 
-    struct ProduceInfo
-    {
-        QFileInfo fileInfo;
-        DThumbnailProvider::Size size;
-        DThumbnailProvider::CallBack callback;
-    };
+    return exif.mid(static_cast<int>(6 + thumbOffset), static_cast<int>(thumbLength));
+}
 
-    QQueue<ProduceInfo> produceQueue;
-    QSet<QPair<QString, DThumbnailProvider::Size>> discardedProduceInfos;
+// The EXIF thumbnail is stored in the same orientation as the primary image, it can
+// be used in place of it if it's large enough and isn't letterboxed.
+static bool readExifThumbnail(const QString &fileName, const QSize &imageSize, const QSize &scaledSize, QImage &image)
+{
+    const QByteArray data = exifThumbnailData(fileName);
+    if (data.isEmpty())
+        return false;
 
-    bool running = true;
+    const QImage thumbnail = QImage::fromData(data, "JPEG");
+    if (thumbnail.width() < scaledSize.width() || thumbnail.height() < scaledSize.height())
+        return false;
 
-    QWaitCondition waitCondition;
-    QReadWriteLock dataReadWriteLock;
+    const qreal imageRatio = qreal(imageSize.width()) / imageSize.height();
+    const qreal thumbnailRatio = qreal(thumbnail.width()) / thumbnail.height();
+    if (qAbs(imageRatio - thumbnailRatio) > 0.02 * imageRatio)
+        return false;
 
-    D_DECLARE_PUBLIC(DThumbnailProvider)
-};
+    image = thumbnail.size() == scaledSize
+            ? thumbnail
+            : thumbnail.scaled(scaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    return true;
+}
+
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+// LibRaw uses the embedded preview when it's larger than the request size.
+static bool readRawThumbnail(const QString &fileName, int size, QImage &image, QString &errorString)
+{
+    QString error;
+    image = DLibRaw::instance()->loadImage(fileName, error, QSize(size, size));
+    if (image.isNull()) {
+        errorString = error.isEmpty() ? QStringLiteral("Fail to read raw image file:") + fileName : error;
+        return false;
+    }
+
+    if (image.width() > size || image.height() > size)
+        image = image.scaled(size, size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return true;
+}
 #endif
 
-QSet<QString> DThumbnailProviderPrivate::hasThumbnailMimeHash;
+class DThumbnailProduceWorker : public QRunnable
+{
+public:
+    explicit DThumbnailProduceWorker(DThumbnailProviderPrivate *d)
+        : d(d) {}
+
+    void run() override
+    {
+        d->processProduceQueue();
+    }
+
+private:
+    DThumbnailProviderPrivate *d;
+};
 
 DThumbnailProviderPrivate::DThumbnailProviderPrivate(DThumbnailProvider *qq)
     : DObjectPrivate(qq)
@@ -82,7 +189,112 @@ DThumbnailProviderPrivate::DThumbnailProviderPrivate(DThumbnailProvider *qq)
 
 void DThumbnailProviderPrivate::init()
 {
+    threadPool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+bool DThumbnailProviderPrivate::hasThumbnailMimeType(const QString &mime)
+{
+    // Initialized once, createThumbnail is called from the worker threads at the same time.
+    static const QSet<QString> mimeTypes = [] {
+        QSet<QString> types;
+        const QList<QByteArray> &supportedTypes = QImageReader::supportedMimeTypes();
+        types.reserve(supportedTypes.size());
+        for (const QByteArray &t : supportedTypes)
+            types.insert(QString::fromLocal8Bit(t));
+        return types;
+    }();
+
+    return mimeTypes.contains(mime);
+}
+
+void DThumbnailProviderPrivate::appendToProduceQueue(const QFileInfo &info, DThumbnailProvider::Size size,
+                                                     DThumbnailProvider::CallBack callback, int priority)
+{
+    const ProduceKey key(info.absoluteFilePath(), size);
+    QMutexLocker locker(&mutex);
+
+    // The same file is producing, only need to be notified when it's finished.
+    if (auto runningInfo = runningProduceInfos.value(key)) {
+        if (callback)
+            runningInfo->callbacks << callback;
+        return;
+    }
+
+    ProduceInfoPointer produceInfo = pendingProduceInfos.value(key);
+    if (produceInfo) {
+        if (callback)
+            produceInfo->callbacks << callback;
+        // The outdated item with the lower priority will be dropped when it's taken.
+        if (priority <= produceInfo->priority)
+            return;
+    } else {
+        produceInfo.reset(new ProduceInfo);
+        produceInfo->fileInfo = info;
+        produceInfo->size = size;
+        if (callback)
+            produceInfo->callbacks << callback;
+        pendingProduceInfos.insert(key, produceInfo);
+    }
+
+    produceInfo->priority = priority;
+    produceQueue.push({priority, produceSequence++, produceInfo});
+    startWorkers();
+}
+
+void DThumbnailProviderPrivate::startWorkers()
+{
+    // Must be called with the mutex locked.
+    while (running && activeWorkers < threadPool.maxThreadCount()
+           && activeWorkers < pendingProduceInfos.size()) {
+        ++activeWorkers;
+        threadPool.start(new DThumbnailProduceWorker(this));
+    }
+}
+
+DThumbnailProviderPrivate::ProduceInfoPointer DThumbnailProviderPrivate::takeProduceInfo()
+{
+    // Must be called with the mutex locked.
+    while (running && !produceQueue.empty()) {
+        const QueueItem item = produceQueue.top();
+        produceQueue.pop();
+
+        const ProduceKey key(item.info->fileInfo.absoluteFilePath(), item.info->size);
+        auto it = pendingProduceInfos.find(key);
+        // Removed from the queue or the priority has been raised.
+        if (it == pendingProduceInfos.end() || it.value() != item.info || item.info->priority != item.priority)
+            continue;
 
+        pendingProduceInfos.erase(it);
+        runningProduceInfos.insert(key, item.info);
+        return item.info;
+    }
+
+    return nullptr;
+}
+
+void DThumbnailProviderPrivate::processProduceQueue()
+{
+    D_Q(DThumbnailProvider);
+
+    Q_FOREVER {
+        QMutexLocker locker(&mutex);
+        const ProduceInfoPointer task = takeProduceInfo();
+        if (!task) {
+            --activeWorkers;
+            return;
+        }
+        locker.unlock();
+
+        const QString &thumbnail = q->createThumbnail(task->fileInfo, task->size);
+
+        locker.relock();
+        runningProduceInfos.remove(qMakePair(task->fileInfo.absoluteFilePath(), task->size));
+        const auto callbacks = task->callbacks;
+        locker.unlock();
+
+        for (const auto &callback : callbacks)
+            callback(thumbnail);
+    }
 }
 
 QString DThumbnailProviderPrivate::sizeToFilePath(DThumbnailProvider::Size size) const
@@ -143,26 +355,14 @@ bool DThumbnailProvider::hasThumbnail(const QMimeType &mimeType) const
 {
     const QString &mime = mimeType.name();
 
-    if (DThumbnailProviderPrivate::hasThumbnailMimeHash.isEmpty())
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+    if (mimeType.inherits(RAW_MIME_TYPE) && DLibRaw::instance()->isValid())
     {
-        const QList<QByteArray> &mimeTypes = QImageReader::supportedMimeTypes();
-
-        if (mimeTypes.isEmpty())
-        {
-            DThumbnailProviderPrivate::hasThumbnailMimeHash.insert("");
-
-            return false;
-        }
-
-        DThumbnailProviderPrivate::hasThumbnailMimeHash.reserve(mimeTypes.size());
-
-        for (const QByteArray &t : mimeTypes)
-        {
-            DThumbnailProviderPrivate::hasThumbnailMimeHash.insert(QString::fromLocal8Bit(t));
-        }
+        return true;
     }
+#endif
 
-    return DThumbnailProviderPrivate::hasThumbnailMimeHash.contains(mime);
+    return DThumbnailProviderPrivate::hasThumbnailMimeType(mime);
 }
 
 /*!
@@ -218,7 +418,9 @@ QString DThumbnailProvider::createThumbnail(const QFileInfo &info, DThumbnailPro
 {
     Q_D(DThumbnailProvider);
 
-    d->errorString.clear();
+    // The thumbnails are created in the worker threads at the same time, keep the error per thread.
+    QString &errorString = d->errorString.localData();
+    errorString.clear();
 
     const QString &absolutePath = info.absolutePath();
     const QString &absoluteFilePath = info.absoluteFilePath();
@@ -233,7 +435,7 @@ QString DThumbnailProvider::createThumbnail(const QFileInfo &info, DThumbnailPro
 
     if (!hasThumbnail(info))
     {
-        d->errorString = QStringLiteral("This file has not support thumbnail: ") + absoluteFilePath;
+        errorString = QStringLiteral("This file has not support thumbnail: ") + absoluteFilePath;
 
         //!Warnning: Do not store thumbnails to the fail path
         return QString();
@@ -260,42 +462,61 @@ QString DThumbnailProvider::createThumbnail(const QFileInfo &info, DThumbnailPro
     }// end
 
     QScopedPointer<QImage> image(new QImage(QSize(size, size), QImage::Format_ARGB32_Premultiplied));
-    QImageReader reader(absoluteFilePath);
+    const QMimeType &mime = d->mimeDatabase.mimeTypeForFile(info);
 
-    if (!reader.canRead())
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+    if (mime.inherits(RAW_MIME_TYPE) && DLibRaw::instance()->isValid())
     {
-        reader.setFormat(d->mimeDatabase.mimeTypeForFile(info).name().toLocal8Bit());
+        readRawThumbnail(absoluteFilePath, size, *image, errorString);
+    }
+    else
+#endif
+    {
+        QImageReader reader(absoluteFilePath);
 
         if (!reader.canRead())
         {
-            d->errorString = reader.errorString();
-        }
-    }
+            reader.setFormat(mime.name().toLocal8Bit());
 
-    if (d->errorString.isEmpty())
-    {
-        const QSize &imageSize = reader.size();
+            if (!reader.canRead())
+            {
+                errorString = reader.errorString();
+            }
+        }
 
-        if (imageSize.isValid())
+        if (errorString.isEmpty())
         {
-            if (imageSize.width() >= size || imageSize.height() >= size)
+            const QSize &imageSize = reader.size();
+
+            if (imageSize.isValid())
             {
-                reader.setScaledSize(reader.size().scaled(size, size, Qt::KeepAspectRatio));
+                QSize scaledSize = imageSize;
+
+                if (imageSize.width() >= size || imageSize.height() >= size)
+                {
+                    scaledSize = imageSize.scaled(size, size, Qt::KeepAspectRatio);
+                    // The jpeg handler decodes with the reduced DCT scale for the scaled size.
+                    reader.setScaledSize(scaledSize);
+                }
+
+                // Avoid decoding the whole photo if it carries a large enough thumbnail.
+                const bool exifThumbnail = mime.inherits(JPEG_MIME_TYPE) && scaledSize != imageSize
+                        && readExifThumbnail(absoluteFilePath, imageSize, scaledSize, *image);
+
+                if (!exifThumbnail && !reader.read(image.data()))
+                {
+                    errorString = reader.errorString();
+                }
             }
-
-            if (!reader.read(image.data()))
+            else
             {
-                d->errorString = reader.errorString();
+                errorString = "Fail to read image file attribute data:" + info.absoluteFilePath();
             }
         }
-        else
-        {
-            d->errorString = "Fail to read image file attribute data:" + info.absoluteFilePath();
-        }
     }
 
     // successful
-    if (d->errorString.isEmpty())
+    if (errorString.isEmpty())
     {
         thumbnail = d->sizeToFilePath(size) + QDir::separator() + thumbnailName;
     }
@@ -313,10 +534,10 @@ QString DThumbnailProvider::createThumbnail(const QFileInfo &info, DThumbnailPro
 
     if (!image->save(thumbnail, Q_NULLPTR, 80))
     {
-        d->errorString = QStringLiteral("Can not save image to ") + thumbnail;
+        errorString = QStringLiteral("Can not save image to ") + thumbnail;
     }
 
-    if (d->errorString.isEmpty())
+    if (errorString.isEmpty())
     {
         Q_EMIT createThumbnailFinished(absoluteFilePath, thumbnail);
         Q_EMIT thumbnailChanged(absoluteFilePath, thumbnail);
@@ -332,44 +553,46 @@ QString DThumbnailProvider::createThumbnail(const QFileInfo &info, DThumbnailPro
 
 void DThumbnailProvider::appendToProduceQueue(const QFileInfo &info, DThumbnailProvider::Size size, DThumbnailProvider::CallBack callback)
 {
-    DThumbnailProviderPrivate::ProduceInfo produceInfo;
+    appendToProduceQueue(info, size, callback, 0);
+}
 
-    produceInfo.fileInfo = info;
-    produceInfo.size = size;
-    produceInfo.callback = callback;
+/*!
+  \brief DThumbnailProvider::appendToProduceQueue将缩略图加入生成队列，由线程池按优先级生成
+  \a info 文件信息
+  \a size 缩略图大小
+  \a callback 生成结束后在工作线程中调用
+  \a priority 优先级，值越大越先生成，如可见项使用更高的优先级
 
+  相同文件和大小的请求会被合并，再次加入时只追加回调，并可提高其优先级
+ */
+void DThumbnailProvider::appendToProduceQueue(const QFileInfo &info, DThumbnailProvider::Size size,
+                                              DThumbnailProvider::CallBack callback, int priority)
+{
     Q_D(DThumbnailProvider);
 
-    if (isRunning())
-    {
-        QWriteLocker locker(&d->dataReadWriteLock);
-        d->produceQueue.append(std::move(produceInfo));
-        locker.unlock();
-        d->waitCondition.wakeAll();
-    }
-    else
-    {
-        d->produceQueue.append(std::move(produceInfo));
-        start();
-    }
+    d->appendToProduceQueue(info, size, callback, priority);
 }
 
 /*!
   \brief DThumbnailProvider::removeInProduceQueue将缩略图从列表中删除
   \a info 缩略图文件
   \a size 缩略图大小
+
+  \note 正在生成的缩略图不会被中断，但不再调用其回调
  */
 void DThumbnailProvider::removeInProduceQueue(const QFileInfo &info, DThumbnailProvider::Size size)
 {
     Q_D(DThumbnailProvider);
 
-    if (isRunning())
-    {
-        QWriteLocker locker(&d->dataReadWriteLock);
-        Q_UNUSED(locker)
-    }
+    const DThumbnailProviderPrivate::ProduceKey key(info.absoluteFilePath(), size);
+    QMutexLocker locker(&d->mutex);
 
-    d->discardedProduceInfos.insert(qMakePair(info.absoluteFilePath(), size));
+    // The item left in the queue is dropped when it's taken.
+    if (d->pendingProduceInfos.remove(key) > 0)
+        return;
+
+    if (auto runningInfo = d->runningProduceInfos.value(key))
+        runningInfo->callbacks.clear();
 }
 
 /*!
@@ -380,7 +603,7 @@ QString DThumbnailProvider::errorString() const
 {
     Q_D(const DThumbnailProvider);
 
-    return d->errorString;
+    return d->errorString.localData();
 }
 
 /*!
@@ -451,48 +674,31 @@ DThumbnailProvider::~DThumbnailProvider()
 {
     Q_D(DThumbnailProvider);
 
-    d->running = false;
-    d->waitCondition.wakeAll();
+    {
+        QMutexLocker locker(&d->mutex);
+        d->running = false;
+        d->pendingProduceInfos.clear();
+        d->produceQueue = {};
+    }
+
+    d->threadPool.waitForDone();
     wait();
 }
 
+/*!
+  \brief DThumbnailProvider::run在当前线程中生成队列中的缩略图
+  \note 缩略图默认由线程池生成，保留此函数用于兼容
+ */
 void DThumbnailProvider::run()
 {
     Q_D(DThumbnailProvider);
 
-    Q_FOREVER
     {
-        QWriteLocker locker(&d->dataReadWriteLock);
-
-        if (d->produceQueue.isEmpty())
-        {
-            d->waitCondition.wait(&d->dataReadWriteLock);
-        }
-
-        if (!d->running)
-        {
-            return;
-        }
-
-        const DThumbnailProviderPrivate::ProduceInfo &task = d->produceQueue.dequeue();
-        const QPair<QString, DThumbnailProvider::Size> &tmpKey = qMakePair(task.fileInfo.absoluteFilePath(), task.size);
-
-        if (d->discardedProduceInfos.contains(tmpKey))
-        {
-            d->discardedProduceInfos.remove(tmpKey);
-            locker.unlock();
-            continue;
-        }
-
-        locker.unlock();
-
-        const QString &thumbnail = createThumbnail(task.fileInfo, task.size);
-
-        if (task.callback)
-        {
-            task.callback(thumbnail);
-        }
+        QMutexLocker locker(&d->mutex);
+        ++d->activeWorkers;
     }
+
+    d->processProduceQueue();
 }
 
 DGUI_END_NAMESPACE
@@ -2,6 +2,7 @@
 //
 // SPDX-License-Identifier: LGPL-3.0-or-later
 #include "dbuiltiniconengine_p.h"
+#include "diconpixmapdiskcache_p.h"
 
 #include <DGuiApplicationHelper>
 
@@ -86,12 +87,26 @@ public:
             reader.setFileName(filename);
         }
 
+        // The mode and state are applied on the pixmap later, they aren't a part of the key.
+        if (!diskFileKeyLoaded) {
+            diskFileKey = DIconPixmapDiskCache::fileKey(reader.fileName());
+            diskFileKeyLoaded = true;
+        }
+        const QByteArray diskKey = DIconPixmapDiskCache::key(diskFileKey, pixmapSize, 1.0);
+        if (DIconPixmapDiskCache::find(diskKey, &pm)) {
+            QPixmapCache::insert(pmckey, pm);
+            genIconTypeIcon(pm, mode);
+            return pm;
+        }
+
         if (dir.type == QIconDirInfo::Scalable)
             reader.setScaledSize(pixmapSize);
 
         pm = QPixmap::fromImageReader(&reader);
-        if (!pm.isNull())
+        if (!pm.isNull()) {
             QPixmapCache::insert(pmckey, pm);
+            DIconPixmapDiskCache::insert(diskKey, pm);
+        }
 
         genIconTypeIcon(pm, mode);
         return pm;
@@ -99,6 +114,9 @@ public:
 
     Type type;
     QImageReader reader;
+    // the identity of the file for the disk cache keys, loaded once
+    QByteArray diskFileKey;
+    bool diskFileKeyLoaded = false;
 };
 
 static QPixmap compositedPixmap(QIcon::Mode mode, QPixmap &pm, QIconLoaderEngineEntry *entry, QPainter *painter = nullptr) {
@@ -0,0 +1,85 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#ifndef DCACHESTATISTICSCOUNTER_P_H
+#define DCACHESTATISTICSCOUNTER_P_H
+
+#include "dcachestatistics.h"
+#include "dtrace_p.h"
+
+#include <QAtomicInteger>
+
+#include <functional>
+
+DGUI_BEGIN_NAMESPACE
+
+/*
+ * The counters of a cache, they are registered in DCacheStatistics while the
+ * object is alive. The counters of the same name are summed, so every instance
+ * of a cache (e.g. DIconTheme::Cached) can own one.
+ *
+ * The bytes and entries are either counted by addEntries(), or reported by
+ * the probe when the statistics are queried. The probe is called with the
+ * registry locked, so it must not create or destroy a DCacheStatisticsCounter, and it's
+ * unregistered before the other members of the cache are destroyed if the
+ * counter is declared as the last member.
+ */
+class DCacheStatisticsCounter
+{
+public:
+    // Fills the entries, bytes and limits of the cache, they are -1 (unknown) when it's called.
+    using Probe = std::function<void(DCacheStatistics::Cache *cache)>;
+
+    explicit DCacheStatisticsCounter(const char *name, const Probe &probe = Probe());
+    ~DCacheStatisticsCounter();
+
+    inline void hit()
+    {
+        const qint64 value = m_hits.fetchAndAddRelaxed(1) + 1;
+        if (DTrace::isEnabled())
+            DTrace::addCounter(m_name, "hits", value);
+    }
+
+    inline void miss()
+    {
+        const qint64 value = m_misses.fetchAndAddRelaxed(1) + 1;
+        if (DTrace::isEnabled())
+            DTrace::addCounter(m_name, "misses", value);
+    }
+
+    inline void evict(qint64 count = 1)
+    {
+        if (count > 0)
+            m_evictions.fetchAndAddRelaxed(count);
+    }
+
+    inline void addEntries(qint64 entries, qint64 bytes)
+    {
+        m_entries.fetchAndAddRelaxed(entries);
+        m_bytes.fetchAndAddRelaxed(bytes);
+    }
+
+    // Counts the entries evicted by an insertion into a QCache like container,
+    // the sizes are taken before and after the insertion.
+    inline void countInsertion(int sizeBefore, bool replaced, int sizeAfter)
+    {
+        evict(sizeBefore + (replaced ? 0 : 1) - sizeAfter);
+    }
+
+private:
+    Q_DISABLE_COPY(DCacheStatisticsCounter)
+    friend class DCacheStatisticsRegistry;
+
+    const char *m_name;
+    const Probe m_probe;
+    QAtomicInteger<qint64> m_hits;
+    QAtomicInteger<qint64> m_misses;
+    QAtomicInteger<qint64> m_evictions;
+    QAtomicInteger<qint64> m_entries;
+    QAtomicInteger<qint64> m_bytes;
+};
+
+DGUI_END_NAMESPACE
+
+#endif // DCACHESTATISTICSCOUNTER_P_H
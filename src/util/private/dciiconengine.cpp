@@ -3,18 +3,64 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include "dciiconengine_p.h"
+#include "diconpixmapdiskcache_p.h"
+#include "diconcachekey_p.h"
+#include "dcachestatisticscounter_p.h"
+#include "dtrace_p.h"
 #include "dguiapplicationhelper.h"
 #include "dplatformtheme.h"
+#include "dicontheme.h"
 
 #include <QPainter>
 #include <QPixmap>
 #include <QPixmapCache>
+#include <QRunnable>
+#include <QThreadPool>
 
 #include <private/qhexstring_p.h>
 #include <private/qiconloader_p.h>
 
 DGUI_BEGIN_NAMESPACE
 
+// Maps the compact keys to the keys of QPixmapCache, finding a pixmap by
+// QPixmapCache::Key doesn't need to build a string key.
+class DDciIconPixmapKeys
+{
+public:
+    QHash<DIconCacheKey, QPixmapCache::Key> keys;
+    int pruneThreshold = 1024;
+
+    void insert(const DIconCacheKey &key, const QPixmapCache::Key &pixmapKey) {
+        if (keys.size() >= pruneThreshold) {
+            // Drop the keys of the pixmaps removed by QPixmapCache.
+            for (auto it = keys.begin(); it != keys.end();) {
+                if (it.value().isValid())
+                    ++it;
+                else
+                    it = keys.erase(it);
+            }
+            pruneThreshold = qMax(1024, keys.size() * 2);
+        }
+        keys.insert(key, pixmapKey);
+    }
+
+    // QPixmapCache can only be used in the GUI thread, so are the statistics.
+    DCacheStatisticsCounter statistics { "dciiconengine.pixmap", [this](DCacheStatistics::Cache *statistics) {
+        statistics->bytes = 0;
+        statistics->entries = 0;
+        // shared with the other pixmaps of the application
+        statistics->maxBytes = qint64(QPixmapCache::cacheLimit()) * 1024;
+        QPixmap pixmap;
+        for (const QPixmapCache::Key &pixmapKey : std::as_const(keys)) {
+            if (!QPixmapCache::find(pixmapKey, &pixmap))
+                continue;
+            statistics->bytes += qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+            ++statistics->entries;
+        }
+    }};
+};
+Q_GLOBAL_STATIC(DDciIconPixmapKeys, _pixmapKeys)
+
 static inline DDciIcon::Theme dciTheme()
 {
     auto theme = DGuiApplicationHelper::instance()->themeType();
@@ -58,7 +104,11 @@ static inline qreal deviceRadio(QPaintDevice *paintDevice = nullptr)
 DDciIconEngine::DDciIconEngine(const QString &iconName)
     : m_iconName(iconName)
     , m_iconThemeName(DGuiApplicationHelper::instance()->applicationTheme()->iconThemeName())
-    , m_dciIcon(DDciIcon::fromTheme(iconName))
+    , m_iconNameAtom(DIconNameAtoms::atom(m_iconName))
+    , m_iconThemeNameAtom(DIconNameAtoms::atom(m_iconThemeName))
+    , m_iconPath(dciIconFilePath(iconName))
+    , m_dciIcon(m_iconPath.isEmpty() ? DDciIcon() : DDciIcon(m_iconPath))
+    , m_iconFileKey(DIconPixmapDiskCache::fileKey(m_iconPath))
 {
 
 }
@@ -67,7 +117,11 @@ DDciIconEngine::DDciIconEngine(const DDciIconEngine &other)
     : QIconEngine(other)
     , m_iconName(other.m_iconName)
     , m_iconThemeName(other.m_iconThemeName)
+    , m_iconNameAtom(other.m_iconNameAtom)
+    , m_iconThemeNameAtom(other.m_iconThemeNameAtom)
+    , m_iconPath(other.m_iconPath)
     , m_dciIcon(other.m_dciIcon)
+    , m_iconFileKey(other.m_iconFileKey)
 {
 
 }
@@ -99,26 +153,142 @@ QPixmap DDciIconEngine::pixmap(const QSize &size, QIcon::Mode mode, QIcon::State
     const int s = qMin(size.width(), size.height());
     const DDciIcon::Theme theme = dciTheme();
     const DDciIconPalette pa = dciPalettle();
-
-    QString key = QLatin1String("dci_") + m_iconName + m_iconThemeName +
-            DDciIconPalette::convertToString(pa)
-            % HexString<uint>(mode)
-            % HexString<int>(theme)
-            % HexString<int>(s)
-            % HexString<uint>(uint(radio * 100));
+    const DIconCacheKey key = pixmapCacheKey(m_iconNameAtom, m_iconThemeNameAtom, s, radio, mode, theme, pa);
 
     QPixmap pix;
-    if (QPixmapCache::find(key, &pix))
-        return pix;
+    auto it = _pixmapKeys->keys.constFind(key);
+    if (it != _pixmapKeys->keys.constEnd()) {
+        if (QPixmapCache::find(it.value(), &pix)) {
+            _pixmapKeys->statistics.hit();
+            return pix;
+        }
+        // removed by QPixmapCache
+        _pixmapKeys->statistics.evict();
+    }
+    _pixmapKeys->statistics.miss();
 
+    D_TRACE_SCOPE("DDciIconEngine::pixmap", "icon", m_iconName);
     ensureIconTheme();
+    const QByteArray diskKey = pixmapDiskCacheKey(m_iconFileKey, s, radio, mode, theme, pa);
+    if (DIconPixmapDiskCache::find(diskKey, &pix)) {
+        _pixmapKeys->insert(key, QPixmapCache::insert(pix));
+        return pix;
+    }
+
     pix = m_dciIcon.pixmap(radio, s, theme, dciMode(mode), pa);
-    if (!pix.isNull())
-        QPixmapCache::insert(key, pix);
+    if (!pix.isNull()) {
+        _pixmapKeys->insert(key, QPixmapCache::insert(pix));
+        DIconPixmapDiskCache::insert(diskKey, pix);
+    }
 
     return pix;
 }
 
+DIconCacheKey DDciIconEngine::pixmapCacheKey(quint32 iconNameAtom, quint32 iconThemeNameAtom, int size, qreal radio,
+                                              QIcon::Mode mode, DDciIcon::Theme theme, const DDciIconPalette &palette)
+{
+    return DIconCacheKey {
+        DIconCacheKey::pack(iconNameAtom, iconThemeNameAtom),
+        DIconCacheKey::pack(static_cast<quint32>(size),
+                            (static_cast<quint32>(qRound(radio * 100)) << 8) | (uint(mode) << 4) | uint(theme)),
+        DIconCacheKey::hash(palette)
+    };
+}
+
+QByteArray DDciIconEngine::pixmapDiskCacheKey(const QByteArray &iconFileKey, int size, qreal radio,
+                                              QIcon::Mode mode, DDciIcon::Theme theme, const DDciIconPalette &palette)
+{
+    return DIconPixmapDiskCache::key(iconFileKey, QSize(size, size), radio,
+                                     DDciIconPalette::convertToString(palette)
+                                     % HexString<uint>(mode)
+                                     % HexString<int>(theme));
+}
+
+// Rasterises the icons in the normal mode, the images are the same as
+// DDciIconEngine::pixmap(size, QIcon::Normal, QIcon::Off) returns.
+class DDciIconPrefetchWorker : public QRunnable
+{
+public:
+    struct Result {
+        int size;
+        QImage image;
+    };
+
+    DDciIconPrefetchWorker(const QString &iconName, const QString &lookupName, const QString &iconThemeName,
+                           const QList<int> &sizes, DDciIcon::Theme theme, const DDciIconPalette &palette,
+                           const std::function<void(bool)> &finished)
+        : iconName(iconName), lookupName(lookupName), iconThemeName(iconThemeName)
+        , sizes(sizes), theme(theme), palette(palette), finished(finished)
+    {
+    }
+
+    void run() override;
+
+private:
+    const QString iconName;
+    const QString lookupName;
+    const QString iconThemeName;
+    const QList<int> sizes;
+    const DDciIcon::Theme theme;
+    const DDciIconPalette palette;
+    const std::function<void(bool)> finished;
+};
+
+void DDciIconPrefetchWorker::run()
+{
+    // Only the uncached lookup is thread safe, DIconTheme::Cached is used in the gui thread.
+    const QString iconPath = DIconTheme::findDciIconFile(lookupName, iconThemeName);
+    const DDciIcon icon = iconPath.isEmpty() ? DDciIcon() : DDciIcon(iconPath);
+
+    QList<Result> results;
+    if (!icon.isNull()) {
+        const QByteArray iconFileKey = DIconPixmapDiskCache::fileKey(iconPath);
+        for (int s : sizes) {
+            const auto matched = icon.matchIcon(s, theme, DDciIcon::Normal);
+            if (!matched)
+                continue;
+
+            QImage image = icon.image(matched, s, 1.0).toImage(palette);
+            if (image.isNull())
+                continue;
+
+            const QByteArray diskKey = DDciIconEngine::pixmapDiskCacheKey(iconFileKey, s, 1.0, QIcon::Normal,
+                                                                          theme, palette);
+            DIconPixmapDiskCache::insert(diskKey, image);
+            results.append({s, image});
+        }
+    }
+
+    if (!qApp)
+        return;
+
+    // QPixmap and QPixmapCache are only used in the gui thread.
+    QMetaObject::invokeMethod(qApp, [iconName = this->iconName, iconThemeName = this->iconThemeName,
+                                     theme = this->theme, palette = this->palette,
+                                     finished = this->finished, found = !icon.isNull(), results] {
+        const quint32 iconNameAtom = DIconNameAtoms::atom(iconName);
+        const quint32 iconThemeNameAtom = DIconNameAtoms::atom(iconThemeName);
+        for (const Result &result : results) {
+            const DIconCacheKey key = DDciIconEngine::pixmapCacheKey(iconNameAtom, iconThemeNameAtom, result.size, 1.0,
+                                                     QIcon::Normal, theme, palette);
+            _pixmapKeys->insert(key, QPixmapCache::insert(QPixmap::fromImage(result.image)));
+        }
+
+        if (finished)
+            finished(found);
+    }, Qt::QueuedConnection);
+}
+
+void DDciIconEngine::prefetch(const QString &iconName, const QList<int> &sizes,
+                              const std::function<void(bool)> &finished)
+{
+    // The state of the application is captured in the gui thread.
+    auto worker = new DDciIconPrefetchWorker(iconName, dciIconLookupName(iconName),
+                                             DGuiApplicationHelper::instance()->applicationTheme()->iconThemeName(),
+                                             sizes, dciTheme(), dciPalettle(), finished);
+    QThreadPool::globalInstance()->start(worker);
+}
+
 void DDciIconEngine::paint(QPainter *painter, const QRect &rect, QIcon::Mode mode, QIcon::State state)
 {
     Q_UNUSED(state);
@@ -141,6 +311,10 @@ bool DDciIconEngine::read(QDataStream &in)
 {
     ensureIconTheme();
     in >> m_iconThemeName >> m_iconName >> m_dciIcon;
+    m_iconNameAtom = DIconNameAtoms::atom(m_iconName);
+    m_iconThemeNameAtom = DIconNameAtoms::atom(m_iconThemeName);
+    m_iconPath.clear();
+    m_iconFileKey.clear();
     return true;
 }
 
@@ -222,8 +396,11 @@ void DDciIconEngine::ensureIconTheme()
     QString iconThemeName = DGuiApplicationHelper::instance()->applicationTheme()->iconThemeName();
     if (m_iconThemeName != iconThemeName) {
         m_iconThemeName = iconThemeName;
+        m_iconThemeNameAtom = DIconNameAtoms::atom(m_iconThemeName);
         // update dci icon when icon theme name changed.
-        m_dciIcon = DDciIcon::fromTheme(m_iconName);
+        m_iconPath = dciIconFilePath(m_iconName);
+        m_dciIcon = m_iconPath.isEmpty() ? DDciIcon() : DDciIcon(m_iconPath);
+        m_iconFileKey = DIconPixmapDiskCache::fileKey(m_iconPath);
     }
 }
 
@@ -11,8 +11,17 @@
 
 #include <QIconEngine>
 
+#include <functional>
+
 DGUI_BEGIN_NAMESPACE
 
+// Defined in ddciicon.cpp, returns the file path used by DDciIcon::fromTheme.
+QString dciIconFilePath(const QString &name);
+// Defined in ddciicon.cpp, returns the name looked up in the icon themes for the icon.
+QString dciIconLookupName(const QString &name);
+
+struct DIconCacheKey;
+
 class Q_DECL_HIDDEN DDciIconEngine : public QIconEngine
 {
 public:
@@ -34,6 +43,17 @@ public:
 #else
     QString iconName() const override;
 #endif
+
+    static DIconCacheKey pixmapCacheKey(quint32 iconNameAtom, quint32 iconThemeNameAtom, int size, qreal radio,
+                                        QIcon::Mode mode, DDciIcon::Theme theme, const DDciIconPalette &palette);
+    static QByteArray pixmapDiskCacheKey(const QByteArray &iconFileKey, int size, qreal radio,
+                                         QIcon::Mode mode, DDciIcon::Theme theme, const DDciIconPalette &palette);
+    // Rasterises the icon in the sizes (in device pixels) in the global thread pool, and
+    // inserts the pixmaps into the cache, the finished is called in the gui thread with
+    // whether the dci icon is found.
+    static void prefetch(const QString &iconName, const QList<int> &sizes,
+                         const std::function<void(bool)> &finished);
+
 private:
     void virtual_hook(int id, void *data) override;
     void ensureIconTheme();
@@ -41,7 +61,14 @@ private:
     DDciIconEngine(const DDciIconEngine &other);
     QString m_iconName;
     QString m_iconThemeName;
+    // the atoms of the names for the pixmap cache key
+    quint32 m_iconNameAtom;
+    quint32 m_iconThemeNameAtom;
+    // empty if the icon isn't loaded from a file, like reading from QDataStream
+    QString m_iconPath;
     DDciIcon m_dciIcon;
+    // the identity of the icon file when it's loaded, for the disk cache keys
+    QByteArray m_iconFileKey;
 };
 
 DGUI_END_NAMESPACE
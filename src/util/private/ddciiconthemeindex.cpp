@@ -0,0 +1,320 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "ddciiconthemeindex_p.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QHash>
+#include <QMutex>
+#include <QDebug>
+
+DGUI_BEGIN_NAMESPACE
+
+#define INDEX_FILE_NAME "dci-icon-theme.index"
+#define INDEX_MAGIC "DCII"
+#define INDEX_VERSION 1
+#define DCI_SUFFIX ".dci"
+
+/*
+ *  The layout of the index file, all numbers are in host byte order:
+ *
+ *  IndexHeader
+ *  quint32     buckets[bucketCount]    // index of the first entry, or InvalidIndex
+ *  IndexEntry  entries[entryCount]     // chained by IndexEntry::next
+ *  IndexDir    dirs[dirCount]          // subdirectories covered by the index
+ *  char        strings[stringsSize]    // UTF-8 names, not null terminated
+ */
+struct IndexHeader {
+    char magic[4];
+    quint32 version;
+    quint32 bucketCount;
+    quint32 entryCount;
+    quint32 dirCount;
+    quint32 stringsSize;
+};
+
+struct IndexEntry {
+    quint32 hash;
+    quint32 nameOffset;
+    quint32 nameLength;
+    quint32 next;
+};
+
+struct IndexDir {
+    quint32 nameOffset;
+    quint32 nameLength;
+};
+
+static const quint32 InvalidIndex = 0xffffffff;
+
+// FNV-1a, qHash can't be used because it's seeded per process.
+static inline quint32 nameHash(const char *data, int length)
+{
+    quint32 hash = 2166136261u;
+    for (int i = 0; i < length; ++i) {
+        hash ^= static_cast<uchar>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static inline const IndexHeader *header(const uchar *data)
+{
+    return reinterpret_cast<const IndexHeader *>(data);
+}
+
+static inline const quint32 *buckets(const uchar *data)
+{
+    return reinterpret_cast<const quint32 *>(data + sizeof(IndexHeader));
+}
+
+static inline const IndexEntry *entries(const uchar *data)
+{
+    return reinterpret_cast<const IndexEntry *>(buckets(data) + header(data)->bucketCount);
+}
+
+static inline const IndexDir *dirs(const uchar *data)
+{
+    return reinterpret_cast<const IndexDir *>(entries(data) + header(data)->entryCount);
+}
+
+static inline const char *strings(const uchar *data)
+{
+    return reinterpret_cast<const char *>(dirs(data) + header(data)->dirCount);
+}
+
+DDciIconThemeIndex::~DDciIconThemeIndex()
+{
+    if (data)
+        file.unmap(const_cast<uchar *>(data));
+}
+
+bool DDciIconThemeIndex::contains(const QString &iconName) const
+{
+    const QByteArray name = iconName.toUtf8();
+    const quint32 hash = nameHash(name.constData(), name.size());
+    const IndexHeader *h = header(data);
+    const IndexEntry *entryList = entries(data);
+    const char *stringPool = strings(data);
+
+    quint32 i = buckets(data)[hash % h->bucketCount];
+    // Limit the steps, a broken file must not lead to an endless loop.
+    for (quint32 step = 0; i < h->entryCount && step < h->entryCount; ++step) {
+        const IndexEntry &entry = entryList[i];
+        if (entry.hash == hash && entry.nameLength == static_cast<quint32>(name.size())
+                && quint64(entry.nameOffset) + entry.nameLength <= h->stringsSize
+                && memcmp(stringPool + entry.nameOffset, name.constData(), entry.nameLength) == 0) {
+            return true;
+        }
+        i = entry.next;
+    }
+
+    return false;
+}
+
+int DDciIconThemeIndex::count() const
+{
+    return static_cast<int>(header(data)->entryCount);
+}
+
+QString DDciIconThemeIndex::indexFilePath(const QString &themeDir)
+{
+    return themeDir + QLatin1Char('/') + QLatin1String(INDEX_FILE_NAME);
+}
+
+bool DDciIconThemeIndex::isUpToDate(const QString &dirPath) const
+{
+    QFileInfo info(dirPath);
+    return info.isDir() && info.lastModified() <= time;
+}
+
+QSharedPointer<const DDciIconThemeIndex> DDciIconThemeIndex::open(const QString &themeDir)
+{
+    // The resource files are not indexed.
+    if (themeDir.isEmpty() || themeDir.startsWith(QLatin1Char(':')))
+        return nullptr;
+
+    QSharedPointer<DDciIconThemeIndex> index(new DDciIconThemeIndex);
+    index->file.setFileName(indexFilePath(themeDir));
+    if (!index->file.open(QIODevice::ReadOnly))
+        return nullptr;
+
+    index->size = index->file.size();
+    if (index->size < qint64(sizeof(IndexHeader)))
+        return nullptr;
+
+    index->data = index->file.map(0, index->size);
+    if (!index->data)
+        return nullptr;
+
+    const IndexHeader *h = header(index->data);
+    if (memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) != 0 || h->version != INDEX_VERSION
+            || h->bucketCount == 0) {
+        qWarning() << "Ignore the invalid dci icon theme index:" << index->file.fileName();
+        return nullptr;
+    }
+
+    const quint64 expectedSize = sizeof(IndexHeader) + quint64(h->bucketCount) * sizeof(quint32)
+            + quint64(h->entryCount) * sizeof(IndexEntry) + quint64(h->dirCount) * sizeof(IndexDir)
+            + h->stringsSize;
+    if (expectedSize != quint64(index->size)) {
+        qWarning() << "Ignore the broken dci icon theme index:" << index->file.fileName();
+        return nullptr;
+    }
+
+    // The index is out of date if any covered directory is modified after it's generated.
+    index->time = QFileInfo(index->file).lastModified();
+    if (!index->isUpToDate(themeDir))
+        return nullptr;
+
+    const IndexDir *dirList = dirs(index->data);
+    const char *stringPool = strings(index->data);
+    for (quint32 i = 0; i < h->dirCount; ++i) {
+        const IndexDir &dir = dirList[i];
+        if (quint64(dir.nameOffset) + dir.nameLength > h->stringsSize)
+            return nullptr;
+        const QString dirName = QString::fromUtf8(stringPool + dir.nameOffset, static_cast<int>(dir.nameLength));
+        if (!index->isUpToDate(themeDir + QLatin1Char('/') + dirName))
+            return nullptr;
+    }
+
+    return index;
+}
+
+class DDciIconThemeIndexCache
+{
+public:
+    struct Entry {
+        QSharedPointer<const DDciIconThemeIndex> index;
+        // The modification time of the directory when the index is missing or invalid.
+        QDateTime dirTime;
+    };
+
+    QMutex mutex;
+    QHash<QString, Entry> indexes;
+};
+Q_GLOBAL_STATIC(DDciIconThemeIndexCache, _indexCache)
+
+QSharedPointer<const DDciIconThemeIndex> DDciIconThemeIndex::cached(const QString &themeDir, bool watched)
+{
+    QMutexLocker locker(&_indexCache->mutex);
+    auto it = _indexCache->indexes.constFind(themeDir);
+    if (it != _indexCache->indexes.constEnd()) {
+        // A valid index is checked against the directory of every lookup by the caller
+        // if the directories aren't watched.
+        if (it->index || watched)
+            return it->index;
+        // Writing an index file modifies the directory, the missing index isn't opened
+        // again until then.
+        if (QFileInfo(themeDir).lastModified() == it->dirTime)
+            return nullptr;
+    }
+
+    DDciIconThemeIndexCache::Entry entry;
+    entry.index = open(themeDir);
+    if (!entry.index)
+        entry.dirTime = QFileInfo(themeDir).lastModified();
+    _indexCache->indexes.insert(themeDir, entry);
+    return entry.index;
+}
+
+void DDciIconThemeIndex::clearCache()
+{
+    if (!_indexCache.exists())
+        return;
+
+    QMutexLocker locker(&_indexCache->mutex);
+    _indexCache->indexes.clear();
+}
+
+bool DDciIconThemeIndex::build(const QString &themeDir, QString *errorString)
+{
+    auto setError = [errorString](const QString &error) {
+        if (errorString)
+            *errorString = error;
+        return false;
+    };
+
+    QDir dir(themeDir);
+    if (!dir.exists())
+        return setError(QLatin1String("The directory is not exists"));
+
+    QList<QByteArray> names;
+    QDirIterator fileIter(dir.absolutePath(), {QLatin1String("*" DCI_SUFFIX)}, QDir::Files,
+                          QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+    while (fileIter.hasNext()) {
+        const QString relativePath = dir.relativeFilePath(fileIter.next());
+        names << relativePath.left(relativePath.size() - int(strlen(DCI_SUFFIX))).toUtf8();
+    }
+
+    QList<QByteArray> subdirs;
+    QDirIterator dirIter(dir.absolutePath(), QDir::Dirs | QDir::NoDotAndDotDot,
+                         QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+    while (dirIter.hasNext())
+        subdirs << dir.relativeFilePath(dirIter.next()).toUtf8();
+
+    IndexHeader h;
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.version = INDEX_VERSION;
+    h.bucketCount = static_cast<quint32>(qMax(1, names.size()));
+    h.entryCount = static_cast<quint32>(names.size());
+    h.dirCount = static_cast<quint32>(subdirs.size());
+    h.stringsSize = 0;
+
+    QByteArray stringPool;
+    QVector<quint32> bucketList(static_cast<int>(h.bucketCount), InvalidIndex);
+    QVector<IndexEntry> entryList;
+    entryList.reserve(names.size());
+    for (const QByteArray &name : std::as_const(names)) {
+        IndexEntry entry;
+        entry.hash = nameHash(name.constData(), name.size());
+        entry.nameOffset = static_cast<quint32>(stringPool.size());
+        entry.nameLength = static_cast<quint32>(name.size());
+        const quint32 bucket = entry.hash % h.bucketCount;
+        entry.next = bucketList[bucket];
+        bucketList[bucket] = static_cast<quint32>(entryList.size());
+        entryList << entry;
+        stringPool += name;
+    }
+
+    QVector<IndexDir> dirList;
+    dirList.reserve(subdirs.size());
+    for (const QByteArray &name : std::as_const(subdirs)) {
+        dirList << IndexDir { static_cast<quint32>(stringPool.size()), static_cast<quint32>(name.size()) };
+        stringPool += name;
+    }
+    h.stringsSize = static_cast<quint32>(stringPool.size());
+
+    const QString indexPath = indexFilePath(dir.absolutePath());
+    QSaveFile file(indexPath);
+    if (!file.open(QIODevice::WriteOnly))
+        return setError(file.errorString());
+
+    file.write(reinterpret_cast<const char *>(&h), sizeof(h));
+    file.write(reinterpret_cast<const char *>(bucketList.constData()), bucketList.size() * sizeof(quint32));
+    file.write(reinterpret_cast<const char *>(entryList.constData()), entryList.size() * sizeof(IndexEntry));
+    file.write(reinterpret_cast<const char *>(dirList.constData()), dirList.size() * sizeof(IndexDir));
+    file.write(stringPool);
+    if (!file.commit())
+        return setError(file.errorString());
+
+    // Saving the index modifies the directory, align the time of the index with the
+    // newest directory, so it's only invalidated by the later changes.
+    QDateTime newestTime = QFileInfo(dir.absolutePath()).lastModified();
+    for (const QByteArray &name : std::as_const(subdirs))
+        newestTime = qMax(newestTime, QFileInfo(dir.absoluteFilePath(QString::fromUtf8(name))).lastModified());
+
+    QFile indexFile(indexPath);
+    if (!indexFile.open(QIODevice::ReadWrite)
+            || !indexFile.setFileTime(newestTime, QFileDevice::FileModificationTime))
+        return setError(indexFile.errorString());
+
+    return true;
+}
+
+DGUI_END_NAMESPACE
@@ -0,0 +1,63 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#ifndef DDCIICONTHEMEINDEX_P_H
+#define DDCIICONTHEMEINDEX_P_H
+
+#include <dtkgui_global.h>
+
+#include <QDateTime>
+#include <QFile>
+#include <QSharedPointer>
+
+DGUI_BEGIN_NAMESPACE
+
+/*
+ * A prebuilt index of the dci icons in a theme directory, it's generated by
+ * `dci-icon-theme --build-index` and saved as "dci-icon-theme.index" in the
+ * directory. The file is mapped in memory and the lookup is a hash probe, so
+ * that DIconTheme::findDciIconFile does not need to stat every candidate file.
+ *
+ * The index is only used when its modification time is not older than the theme
+ * directory and all the subdirectories (icon groups) it covers, it's checked when the
+ * index is opened. If the directories are watched, the cached index is trusted until
+ * the cache is cleared, otherwise the icons installed later are found by checking the
+ * directory of the looked up icon with isUpToDate().
+ */
+class LIBDTKGUISHARED_EXPORT DDciIconThemeIndex
+{
+public:
+    ~DDciIconThemeIndex();
+
+    // The icon name is relative to the theme directory and without ".dci" suffix.
+    bool contains(const QString &iconName) const;
+    int count() const;
+    // Whether the directory (the theme directory or an icon group) isn't modified after
+    // the index is generated, the index can't be trusted for the icons in it otherwise.
+    bool isUpToDate(const QString &dirPath) const;
+
+    static QString indexFilePath(const QString &themeDir);
+    static QSharedPointer<const DDciIconThemeIndex> open(const QString &themeDir);
+    // Returns the cached index of the directory, a null pointer means there is no valid index.
+    // If the directories are \a watched, the result is kept without stat() until clearCache()
+    // is called on the changes. Otherwise a missing index is opened again after the directory
+    // is modified.
+    static QSharedPointer<const DDciIconThemeIndex> cached(const QString &themeDir, bool watched = false);
+    static void clearCache();
+
+    static bool build(const QString &themeDir, QString *errorString = nullptr);
+
+private:
+    DDciIconThemeIndex() = default;
+    Q_DISABLE_COPY(DDciIconThemeIndex)
+
+    QFile file;
+    const uchar *data = nullptr;
+    qint64 size = 0;
+    QDateTime time;
+};
+
+DGUI_END_NAMESPACE
+
+#endif // DDCIICONTHEMEINDEX_P_H
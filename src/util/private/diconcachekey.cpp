@@ -0,0 +1,65 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "diconcachekey_p.h"
+#include "ddciiconpalette.h"
+
+#include <QReadWriteLock>
+
+DGUI_BEGIN_NAMESPACE
+
+class DIconNameAtomTable
+{
+public:
+    QReadWriteLock lock;
+    QHash<QString, quint32> atoms;
+};
+Q_GLOBAL_STATIC(DIconNameAtomTable, _atomTable)
+
+quint32 DIconNameAtoms::atom(const QString &name)
+{
+    if (name.isEmpty())
+        return 0;
+
+    {
+        QReadLocker locker(&_atomTable->lock);
+        auto it = _atomTable->atoms.constFind(name);
+        if (it != _atomTable->atoms.constEnd())
+            return it.value();
+    }
+
+    QWriteLocker locker(&_atomTable->lock);
+    auto it = _atomTable->atoms.constFind(name);
+    if (it != _atomTable->atoms.constEnd())
+        return it.value();
+
+    const quint32 atom = static_cast<quint32>(_atomTable->atoms.size()) + 1;
+    _atomTable->atoms.insert(name, atom);
+    return atom;
+}
+
+// The finalizer of SplitMix64, a 64-bit mixing function.
+static inline quint64 mix(quint64 value)
+{
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+}
+
+static inline quint64 colorValue(const QColor &color)
+{
+    // Distinguish the invalid color with the transparent black.
+    return color.isValid() ? static_cast<quint64>(color.rgba64()) : ~quint64(0);
+}
+
+quint64 DIconCacheKey::hash(const DDciIconPalette &palette)
+{
+    quint64 hash = mix(colorValue(palette.foreground()));
+    hash = mix(hash ^ colorValue(palette.background()));
+    hash = mix(hash ^ colorValue(palette.highlightForeground()));
+    hash = mix(hash ^ colorValue(palette.highlight()));
+    return hash;
+}
+
+DGUI_END_NAMESPACE
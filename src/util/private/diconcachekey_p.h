@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#ifndef DICONCACHEKEY_P_H
+#define DICONCACHEKEY_P_H
+
+#include <dtkgui_global.h>
+
+#include <QHash>
+#include <QString>
+
+DGUI_BEGIN_NAMESPACE
+
+class DDciIconPalette;
+
+/*
+ * Interns the names (icon names, theme names) as 32-bit atoms, the same name
+ * always gets the same atom in the process. The atom 0 is the empty name.
+ * The table is never shrunk, the count of the names used by the icons is limited.
+ */
+class Q_DECL_HIDDEN DIconNameAtoms
+{
+public:
+    static quint32 atom(const QString &name);
+};
+
+// A fixed size key of the icon caches, building it doesn't allocate memory.
+struct Q_DECL_HIDDEN DIconCacheKey
+{
+    // the atoms of the icon name and the theme name
+    quint64 name = 0;
+    // the size, scale, mode and the other options
+    quint64 variant = 0;
+    // the hash of the data can't be packed in the key, like a palette
+    quint64 extra = 0;
+
+    static inline quint64 pack(quint32 high, quint32 low) {
+        return (quint64(high) << 32) | low;
+    }
+    static quint64 hash(const DDciIconPalette &palette);
+
+    inline bool operator==(const DIconCacheKey &other) const {
+        return name == other.name && variant == other.variant && extra == other.extra;
+    }
+    inline bool operator!=(const DIconCacheKey &other) const {
+        return !operator==(other);
+    }
+};
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+inline size_t qHash(const DIconCacheKey &key, size_t seed = 0)
+#else
+inline uint qHash(const DIconCacheKey &key, uint seed = 0)
+#endif
+{
+    return ::qHash(key.name, seed) ^ (::qHash(key.variant) * 31) ^ (::qHash(key.extra) * 131);
+}
+
+DGUI_END_NAMESPACE
+
+#endif // DICONCACHEKEY_P_H
@@ -0,0 +1,432 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "diconpixmapdiskcache_p.h"
+#include "dcachestatisticscounter_p.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QMutex>
+#include <QRunnable>
+#include <QTemporaryFile>
+#include <QThreadPool>
+
+#include <algorithm>
+#include <cstdio>
+
+#include <DStandardPaths>
+
+DGUI_BEGIN_NAMESPACE
+
+#define ENTRY_MAGIC "DIPC"
+#define ENTRY_VERSION 1
+#define DISABLE_ENV "D_DTK_DISABLE_ICON_DISK_CACHE"
+#define LIMIT_ENV "D_DTK_ICON_DISK_CACHE_LIMIT"
+// in kilobytes
+#define DEFAULT_LIMIT (64 * 1024)
+// The access time of an entry is updated by find() at most once in this interval.
+#define ACCESS_TIME_INTERVAL 3600
+// The unfinished temporary files of the insertions are removed after this time.
+#define STALE_TEMP_FILE_TIME (24 * 3600)
+
+/*
+ *  The layout of an entry file, all numbers are in host byte order:
+ *
+ *  EntryHeader
+ *  char        key[keySize]
+ *  uchar       pixels[height * bytesPerLine]   // aligned to 16 bytes
+ */
+struct EntryHeader {
+    char magic[4];
+    quint32 version;
+    quint32 keySize;
+    qint32 width;
+    qint32 height;
+    quint32 bytesPerLine;
+    double devicePixelRatio;
+};
+
+static inline qint64 pixelsOffset(quint32 keySize)
+{
+    return (qint64(sizeof(EntryHeader)) + keySize + 15) & ~qint64(15);
+}
+
+class DIconPixmapDiskCacheConfig
+{
+public:
+    DIconPixmapDiskCacheConfig()
+        : enabled(!qEnvironmentVariableIsSet(DISABLE_ENV))
+        , maxBytes([] {
+            bool ok = false;
+            const int limit = qEnvironmentVariableIntValue(LIMIT_ENV, &ok);
+            return qint64(ok && limit > 0 ? limit : DEFAULT_LIMIT) * 1024;
+        }())
+        , directory(DCORE_NAMESPACE::DStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)
+                    + QLatin1String("/deepin/dtkgui/icon-pixmaps/v") + QString::number(ENTRY_VERSION))
+    {
+    }
+
+    QMutex mutex;
+    const bool enabled;
+    const qint64 maxBytes;
+    QString directory;
+    bool directoryCreated = false;
+    // The bytes written since the last trimming.
+    qint64 pendingBytes = 0;
+    bool trimmed = false;
+    bool trimming = false;
+
+    // The entries are counted by listing the directory when the statistics are queried.
+    DCacheStatisticsCounter statistics { "icon.diskcache", [this](DCacheStatistics::Cache *statistics) {
+        QDir dir(DIconPixmapDiskCache::cacheDirectory());
+        if (!enabled || !dir.exists())
+            return;
+
+        statistics->maxBytes = maxBytes;
+        statistics->bytes = 0;
+        statistics->entries = 0;
+        const QFileInfoList files = dir.entryInfoList(QDir::Files | QDir::NoDotAndDotDot);
+        for (const QFileInfo &file : files) {
+            statistics->bytes += file.size();
+            ++statistics->entries;
+        }
+    }};
+};
+Q_GLOBAL_STATIC(DIconPixmapDiskCacheConfig, _config)
+
+static QString entryFilePath(const QByteArray &key, bool ensureDirectory)
+{
+    const QByteArray name = QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex();
+
+    QMutexLocker locker(&_config->mutex);
+    if (ensureDirectory && !_config->directoryCreated)
+        _config->directoryCreated = QDir().mkpath(_config->directory);
+    return _config->directory + QLatin1Char('/') + QString::fromLatin1(name);
+}
+
+class DIconPixmapDiskCacheTrimWorker : public QRunnable
+{
+public:
+    void run() override
+    {
+        DIconPixmapDiskCache::trim(DIconPixmapDiskCache::maxBytes());
+
+        QMutexLocker locker(&_config->mutex);
+        _config->trimming = false;
+        _config->trimmed = true;
+    }
+};
+
+class DIconPixmapDiskCacheWriteWorker : public QRunnable
+{
+public:
+    DIconPixmapDiskCacheWriteWorker(const QByteArray &key, const QImage &image)
+        : key(key)
+        , image(image)
+    {
+    }
+
+    void run() override
+    {
+        DIconPixmapDiskCache::insert(key, image);
+    }
+
+private:
+    const QByteArray key;
+    const QImage image;
+};
+
+// Trims the cache of the previous runs once, then after a quarter of the limit is written.
+static void scheduleTrim(qint64 writtenBytes)
+{
+    QMutexLocker locker(&_config->mutex);
+    _config->pendingBytes += writtenBytes;
+    if (_config->trimming || (_config->trimmed && _config->pendingBytes < _config->maxBytes / 4))
+        return;
+
+    _config->trimming = true;
+    _config->pendingBytes = 0;
+    locker.unlock();
+    QThreadPool::globalInstance()->start(new DIconPixmapDiskCacheTrimWorker);
+}
+
+static bool isEntryFileName(const QString &name)
+{
+    if (name.size() != 40)
+        return false;
+    for (const QChar c : name) {
+        if (!((c >= QLatin1Char('0') && c <= QLatin1Char('9')) || (c >= QLatin1Char('a') && c <= QLatin1Char('f'))))
+            return false;
+    }
+    return true;
+}
+
+// An entry is valid if it's complete and its icon file isn't changed or removed.
+static bool isEntryValid(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    EntryHeader header;
+    if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != qint64(sizeof(header)))
+        return false;
+    if (memcmp(header.magic, ENTRY_MAGIC, sizeof(header.magic)) != 0
+            || header.version != ENTRY_VERSION
+            || header.keySize > 0xffff
+            || header.width <= 0 || header.height <= 0
+            || pixelsOffset(header.keySize) + qint64(header.height) * header.bytesPerLine != file.size()) {
+        return false;
+    }
+
+    // See DIconPixmapDiskCache::key().
+    const QList<QByteArray> key = file.read(header.keySize).split('\n');
+    if (key.size() < 3)
+        return false;
+
+    const QString iconFile = QString::fromUtf8(key.at(0));
+    // The resource files of the other applications can't be checked.
+    if (iconFile.startsWith(QLatin1Char(':')))
+        return true;
+
+    const QFileInfo info(iconFile);
+    return info.isFile()
+            && QByteArray::number(info.lastModified().toMSecsSinceEpoch()) == key.at(1)
+            && QByteArray::number(info.size()) == key.at(2);
+}
+
+QByteArray DIconPixmapDiskCache::fileKey(const QString &iconFile)
+{
+    if (!isEnabled() || iconFile.isEmpty())
+        return QByteArray();
+
+    // Works for the resource files too, rcc records the modification time.
+    const QFileInfo info(iconFile);
+    if (!info.isFile())
+        return QByteArray();
+
+    QByteArray key = info.absoluteFilePath().toUtf8();
+    key += '\n' + QByteArray::number(info.lastModified().toMSecsSinceEpoch());
+    key += '\n' + QByteArray::number(info.size());
+    return key;
+}
+
+QByteArray DIconPixmapDiskCache::key(const QString &iconFile, const QSize &size, qreal scale, const QString &extra)
+{
+    if (size.isEmpty())
+        return QByteArray();
+
+    return key(fileKey(iconFile), size, scale, extra);
+}
+
+QByteArray DIconPixmapDiskCache::key(const QByteArray &fileKey, const QSize &size, qreal scale, const QString &extra)
+{
+    if (fileKey.isEmpty() || size.isEmpty())
+        return QByteArray();
+
+    QByteArray key = fileKey;
+    key += '\n' + QByteArray::number(size.width()) + 'x' + QByteArray::number(size.height());
+    key += '@' + QByteArray::number(qRound(scale * 100));
+    if (!extra.isEmpty())
+        key += '\n' + extra.toUtf8();
+
+    return key;
+}
+
+bool DIconPixmapDiskCache::find(const QByteArray &key, QPixmap *pixmap)
+{
+    if (key.isEmpty())
+        return false;
+
+    QFile file(entryFilePath(key, false));
+    if (!file.open(QIODevice::ReadOnly)) {
+        _config->statistics.miss();
+        return false;
+    }
+
+    const qint64 fileSize = file.size();
+    if (fileSize < qint64(sizeof(EntryHeader))) {
+        _config->statistics.miss();
+        return false;
+    }
+
+    const uchar *data = file.map(0, fileSize);
+    if (!data) {
+        _config->statistics.miss();
+        return false;
+    }
+
+    const EntryHeader *header = reinterpret_cast<const EntryHeader *>(data);
+    const qint64 offset = pixelsOffset(header->keySize);
+    if (memcmp(header->magic, ENTRY_MAGIC, sizeof(header->magic)) != 0
+            || header->version != ENTRY_VERSION
+            || header->keySize != static_cast<quint32>(key.size())
+            || header->width <= 0 || header->height <= 0
+            || header->bytesPerLine < static_cast<quint32>(header->width) * 4
+            || offset + qint64(header->height) * header->bytesPerLine != fileSize
+            // The file name is a hash of the key, ensure it's not a collision.
+            || memcmp(data + sizeof(EntryHeader), key.constData(), header->keySize) != 0) {
+        file.unmap(const_cast<uchar *>(data));
+        _config->statistics.miss();
+        return false;
+    }
+
+    // The pixels are copied to the pixmap, the file can be unmapped after that.
+    const QImage image(data + offset, header->width, header->height,
+                       static_cast<int>(header->bytesPerLine), QImage::Format_ARGB32_Premultiplied);
+    QPixmap pm = QPixmap::fromImage(image);
+    pm.setDevicePixelRatio(header->devicePixelRatio);
+    file.unmap(const_cast<uchar *>(data));
+
+    if (pm.isNull()) {
+        _config->statistics.miss();
+        return false;
+    }
+
+    // The access time orders the entries for trimming, it's not updated on reading
+    // if the file system is mounted with "noatime".
+    const QDateTime now = QDateTime::currentDateTime();
+    if (file.fileTime(QFileDevice::FileAccessTime).secsTo(now) > ACCESS_TIME_INTERVAL)
+        file.setFileTime(now, QFileDevice::FileAccessTime);
+
+    _config->statistics.hit();
+    *pixmap = pm;
+    return true;
+}
+
+bool DIconPixmapDiskCache::insert(const QByteArray &key, const QPixmap &pixmap)
+{
+    if (key.isEmpty() || pixmap.isNull())
+        return false;
+
+    // The writing of a cold cache must not block the gui thread.
+    QThreadPool::globalInstance()->start(new DIconPixmapDiskCacheWriteWorker(key, pixmap.toImage()));
+    return true;
+}
+
+bool DIconPixmapDiskCache::insert(const QByteArray &key, const QImage &source)
+{
+    if (key.isEmpty() || source.isNull())
+        return false;
+
+    QImage image = source;
+    if (image.format() != QImage::Format_ARGB32_Premultiplied)
+        image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+    EntryHeader header;
+    memcpy(header.magic, ENTRY_MAGIC, sizeof(header.magic));
+    header.version = ENTRY_VERSION;
+    header.keySize = static_cast<quint32>(key.size());
+    header.width = image.width();
+    header.height = image.height();
+    header.bytesPerLine = static_cast<quint32>(image.bytesPerLine());
+    header.devicePixelRatio = source.devicePixelRatio();
+
+    // Another process may write the same entry, the readers never see a partial file
+    // since it's renamed after written. Unlike QSaveFile, it isn't synced to the disk,
+    // and it never falls back to writing the entry directly.
+    const QString filePath = entryFilePath(key, true);
+    QTemporaryFile file(filePath + QLatin1String(".XXXXXX"));
+    if (!file.open())
+        return false;
+
+    const qint64 padding = pixelsOffset(header.keySize) - qint64(sizeof(header)) - key.size();
+    bool ok = file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == qint64(sizeof(header));
+    ok = ok && file.write(key) == key.size();
+    ok = ok && file.write(QByteArray(static_cast<int>(padding), '\0')) == padding;
+    ok = ok && file.write(reinterpret_cast<const char *>(image.constBits()), image.sizeInBytes()) == image.sizeInBytes();
+    file.close();
+    // The temporary file is removed if it fails, rename() replaces the entry atomically.
+    if (!ok || file.error() != QFileDevice::NoError
+            || std::rename(QFile::encodeName(file.fileName()).constData(), QFile::encodeName(filePath).constData()) != 0)
+        return false;
+    file.setAutoRemove(false);
+
+    scheduleTrim(pixelsOffset(header.keySize) + image.sizeInBytes());
+    return true;
+}
+
+int DIconPixmapDiskCache::trim(qint64 maxBytes)
+{
+    QDir dir(cacheDirectory());
+    if (!dir.exists())
+        return 0;
+
+    struct Entry {
+        QString filePath;
+        qint64 size;
+        qint64 lastUsed;
+    };
+    QVector<Entry> entries;
+    qint64 totalBytes = 0;
+    int removed = 0;
+
+    const qint64 staleTime = QDateTime::currentDateTime().addSecs(-STALE_TEMP_FILE_TIME).toMSecsSinceEpoch();
+    const QFileInfoList files = dir.entryInfoList(QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot);
+    for (const QFileInfo &info : files) {
+        const qint64 lastUsed = qMax(info.lastRead(), info.lastModified()).toMSecsSinceEpoch();
+        if (!isEntryFileName(info.fileName())) {
+            // The temporary file of an insertion, it's removed only if it's abandoned.
+            if (lastUsed < staleTime && QFile::remove(info.absoluteFilePath()))
+                ++removed;
+            continue;
+        }
+
+        if (!isEntryValid(info.absoluteFilePath())) {
+            if (QFile::remove(info.absoluteFilePath()))
+                ++removed;
+            continue;
+        }
+
+        entries.append({info.absoluteFilePath(), info.size(), lastUsed});
+        totalBytes += info.size();
+    }
+
+    if (totalBytes > maxBytes) {
+        std::sort(entries.begin(), entries.end(), [](const Entry &e1, const Entry &e2) {
+            return e1.lastUsed < e2.lastUsed;
+        });
+
+        for (const Entry &entry : std::as_const(entries)) {
+            if (totalBytes <= maxBytes)
+                break;
+            if (QFile::remove(entry.filePath)) {
+                totalBytes -= entry.size;
+                ++removed;
+            }
+        }
+    }
+
+    _config->statistics.evict(removed);
+    return removed;
+}
+
+qint64 DIconPixmapDiskCache::maxBytes()
+{
+    return _config->maxBytes;
+}
+
+bool DIconPixmapDiskCache::isEnabled()
+{
+    return _config->enabled;
+}
+
+QString DIconPixmapDiskCache::cacheDirectory()
+{
+    QMutexLocker locker(&_config->mutex);
+    return _config->directory;
+}
+
+void DIconPixmapDiskCache::setCacheDirectory(const QString &path)
+{
+    QMutexLocker locker(&_config->mutex);
+    _config->directory = path;
+    _config->directoryCreated = false;
+}
+
+DGUI_END_NAMESPACE
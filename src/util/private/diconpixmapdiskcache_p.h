@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#ifndef DICONPIXMAPDISKCACHE_P_H
+#define DICONPIXMAPDISKCACHE_P_H
+
+#include <dtkgui_global.h>
+
+#include <QPixmap>
+
+DGUI_BEGIN_NAMESPACE
+
+/*
+ * A persistent cache of the rasterised icon pixmaps, shared by all applications
+ * of the user. Each entry is a file under "$XDG_CACHE_HOME/deepin/dtkgui/icon-pixmaps",
+ * it stores the raw premultiplied pixels, and it's mapped in memory to read.
+ *
+ * The key contains the identity (path, modification time and size) of the icon
+ * file, so an entry is never used after the icon file is changed. The cache is
+ * disabled when "D_DTK_DISABLE_ICON_DISK_CACHE" is set. An entry is written to
+ * a temporary file and renamed, the readers never see a partial file, and it's not
+ * synced to the disk, a lost entry is rasterised again.
+ *
+ * The cache is trimmed in a worker thread after the first insertion of the process,
+ * and again after a quarter of the limit is written. The entries of the changed
+ * or removed icon files are removed, then the least recently used entries until
+ * the cache fits in the limit, which can be changed by "D_DTK_ICON_DISK_CACHE_LIMIT"
+ * (in kilobytes).
+ */
+class Q_DECL_HIDDEN DIconPixmapDiskCache
+{
+public:
+    // The identity of the icon file, the keys of its pixmaps start with it. It's
+    // empty if the file isn't found. The callers keep it to avoid the stat().
+    static QByteArray fileKey(const QString &iconFile);
+    // The extra is used to distinguish the pixmaps of a file in the same size,
+    // like the icon mode or the palette.
+    static QByteArray key(const QByteArray &fileKey, const QSize &size, qreal scale,
+                          const QString &extra = QString());
+    static QByteArray key(const QString &iconFile, const QSize &size, qreal scale,
+                          const QString &extra = QString());
+
+    static bool find(const QByteArray &key, QPixmap *pixmap);
+    // The pixmap is converted in the current thread and written in a worker thread,
+    // returns whether the writing is scheduled.
+    static bool insert(const QByteArray &key, const QPixmap &pixmap);
+    // Writes in the current thread, it can be used in any thread, unlike the QPixmap.
+    static bool insert(const QByteArray &key, const QImage &image);
+
+    // Runs in the current thread, returns the number of the removed entries.
+    static int trim(qint64 maxBytes);
+    static qint64 maxBytes();
+
+    static bool isEnabled();
+    static QString cacheDirectory();
+    static void setCacheDirectory(const QString &path);
+};
+
+DGUI_END_NAMESPACE
+
+#endif // DICONPIXMAPDISKCACHE_P_H
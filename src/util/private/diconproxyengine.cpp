@@ -6,6 +6,7 @@
 #include "dciiconengine_p.h"
 #include "dbuiltiniconengine_p.h"
 #include "xdgiconproxyengine_p.h"
+#include "dtrace_p.h"
 
 #include <DGuiApplicationHelper>
 #include <DPlatformTheme>
@@ -223,6 +224,7 @@ void DIconProxyEngine::ensureEngine()
     if (theme == m_iconThemeName && m_iconEngine)
         return;
 
+    D_TRACE_SCOPE("DIconProxyEngine::ensureEngine", "icon", m_iconName);
     static QMap<QString, QSet<QString>> nonCache;
     if (Q_UNLIKELY(!m_option.testFlag(DIconTheme::IgnoreIconCache)))
     {
@@ -29,6 +29,15 @@ enum ExifImageOrientation {
 };
 
 #ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+// The information read from the header of the image file, the pixels are not loaded.
+struct DImageHeaderInfo
+{
+    FREE_IMAGE_FORMAT format = FIF_UNKNOWN;
+    QSize size;
+    ExifImageOrientation orientation = Undefined;
+    QHash<QString, QString> metaData;
+};
+
 class DLibFreeImage
 {
 public:
@@ -39,11 +48,15 @@ public:
 
     bool findMetaData(FREE_IMAGE_MDMODEL model, FIBITMAP *dib, QHash<QString, QString> &data);
     QHash<QString, QString> findAllMetaData(const QString &fileName);
-    FIBITMAP *readFileToFIBITMAP(const QString &fileName, int flags = 0, FREE_IMAGE_FORMAT fif = FIF_UNKNOWN);
+    QHash<QString, QString> findAllMetaData(const QString &fileName, const DImageHeaderInfo &header);
+    bool readHeaderInfo(const QString &fileName, DImageHeaderInfo &header, FREE_IMAGE_FORMAT fif = FIF_UNKNOWN);
+    FIBITMAP *readFileToFIBITMAP(const QString &fileName, int flags = 0, FREE_IMAGE_FORMAT fif = FIF_UNKNOWN,
+                                 FREE_IMAGE_FORMAT *detectedFif = nullptr);
     bool writeFIBITMAPToFile(FIBITMAP *dib, const QString &fileName, int flags = 0);
     QImage FIBITMAPToQImage(FIBITMAP *dib) const;
 
     ExifImageOrientation imageOrientation(const QString &fileName);
+    ExifImageOrientation findOrientation(FIBITMAP *dib);
     bool rotateImageFile(const QString &fileName, int angle, QString &errorString);
 
     FIBITMAP *(*FreeImage_Load)(FREE_IMAGE_FORMAT fif, const char *filename, int flags);
@@ -90,16 +103,22 @@ private:
     Q_DISABLE_COPY(DLibFreeImage)
 };
 
+// Every call uses its own libraw_data_t, the calls are serialised unless the
+// thread safe build of LibRaw (libraw_r) is loaded.
 class DLibRaw
 {
 public:
     DLibRaw();
     ~DLibRaw();
 
+    // The instance shared by DImageHandler and DThumbnailProvider.
+    static DLibRaw *instance();
+
     bool isValid();
     QImage loadImage(const QString &fileName, QString &errString, QSize requestSize = QSize());
     QImage loadImage(QByteArray &data, QString &errString, QSize requestSize = QSize());
     int readImage(libraw_data_t *rawData, QImage &image, QSize requestSize = QSize());
+    QSize imageSize(const QString &fileName, QString &errString);
     QString errorString(int errorCode);
 
     const char *(*libraw_strerror)(int errorcode);
@@ -116,6 +135,8 @@ public:
 
 private:
     QLibrary *libraw = nullptr;
+    bool reentrant = false;
+    QMutex apiMutex;
 
     Q_DISABLE_COPY(DLibRaw)
 };
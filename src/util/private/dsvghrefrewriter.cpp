@@ -0,0 +1,165 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "dsvghrefrewriter_p.h"
+
+#include <QVector>
+
+DGUI_BEGIN_NAMESPACE
+
+static inline bool isXmlSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// A cheap check before the document is scanned, it's true if an "href" follows a
+// space, so the documents using "xlink:href" only are skipped.
+static bool mayHaveHrefAttribute(const QByteArray &contents)
+{
+    for (qsizetype i = contents.indexOf("href"); i >= 0; i = contents.indexOf("href", i + 4)) {
+        if (i > 0 && isXmlSpace(contents.at(i - 1)))
+            return true;
+    }
+
+    return false;
+}
+
+// Finds the offsets of the unprefixed href attributes of the start tags in one pass,
+// the comments, CDATA sections, processing instructions, declarations and attribute
+// values are skipped. Returns false if the document is malformed, it's left unchanged.
+static bool findHrefAttributes(const QByteArray &contents, QVector<qsizetype> *offsets)
+{
+    const char *data = contents.constData();
+    const qsizetype size = contents.size();
+    qsizetype pos = 0;
+
+    const auto startsWith = [&](const char *str) {
+        // The data of QByteArray is null terminated.
+        return qstrncmp(data + pos, str, qstrlen(str)) == 0;
+    };
+    const auto skipPast = [&](const char *str) {
+        const qsizetype index = contents.indexOf(str, pos);
+        if (index < 0)
+            return false;
+        pos = index + qstrlen(str);
+        return true;
+    };
+    const auto skipSpaces = [&] {
+        while (pos < size && isXmlSpace(data[pos]))
+            ++pos;
+    };
+
+    while (true) {
+        pos = contents.indexOf('<', pos);
+        if (pos < 0)
+            return true;
+
+        if (startsWith("<!--")) {
+            if (!skipPast("-->"))
+                return false;
+            continue;
+        }
+
+        if (startsWith("<![CDATA[")) {
+            if (!skipPast("]]>"))
+                return false;
+            continue;
+        }
+
+        if (startsWith("<?")) {
+            if (!skipPast("?>"))
+                return false;
+            continue;
+        }
+
+        if (startsWith("<!") || startsWith("</")) {
+            // The quoted strings and the internal subset of DOCTYPE may contain '>'.
+            char quote = 0;
+            int depth = 0;
+            for (++pos; pos < size; ++pos) {
+                const char c = data[pos];
+                if (quote) {
+                    if (c == quote)
+                        quote = 0;
+                } else if (c == '"' || c == '\'') {
+                    quote = c;
+                } else if (c == '[') {
+                    ++depth;
+                } else if (c == ']') {
+                    --depth;
+                } else if (c == '>' && depth <= 0) {
+                    break;
+                }
+            }
+            if (pos >= size)
+                return false;
+            ++pos;
+            continue;
+        }
+
+        // A start tag, skips the element name.
+        ++pos;
+        while (pos < size && !isXmlSpace(data[pos]) && data[pos] != '>' && data[pos] != '/')
+            ++pos;
+
+        while (true) {
+            skipSpaces();
+            if (pos >= size)
+                return false;
+            if (data[pos] == '>') {
+                ++pos;
+                break;
+            }
+            if (data[pos] == '/') {
+                ++pos;
+                continue;
+            }
+
+            const qsizetype name = pos;
+            while (pos < size && !isXmlSpace(data[pos]) && data[pos] != '=' && data[pos] != '>' && data[pos] != '/')
+                ++pos;
+            if (pos - name == 4 && qstrncmp(data + name, "href", 4) == 0)
+                offsets->append(name);
+
+            skipSpaces();
+            if (pos >= size || data[pos] != '=')
+                return false;
+            ++pos;
+            skipSpaces();
+            if (pos >= size || (data[pos] != '"' && data[pos] != '\''))
+                return false;
+
+            const qsizetype end = contents.indexOf(data[pos], pos + 1);
+            if (end < 0)
+                return false;
+            pos = end + 1;
+        }
+    }
+}
+
+QByteArray DSvgHrefRewriter::rewrite(const QByteArray &contents)
+{
+    if (!mayHaveHrefAttribute(contents))
+        return contents;
+
+    QVector<qsizetype> offsets;
+    if (!findHrefAttributes(contents, &offsets) || offsets.isEmpty())
+        return contents;
+
+    static const QByteArray prefix("xlink:");
+    QByteArray data;
+    data.reserve(contents.size() + offsets.size() * prefix.size());
+
+    qsizetype pos = 0;
+    for (const qsizetype offset : std::as_const(offsets)) {
+        data.append(contents.constData() + pos, offset - pos);
+        data.append(prefix);
+        pos = offset;
+    }
+    data.append(contents.constData() + pos, contents.size() - pos);
+
+    return data;
+}
+
+DGUI_END_NAMESPACE
@@ -0,0 +1,31 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#ifndef DSVGHREFREWRITER_P_H
+#define DSVGHREFREWRITER_P_H
+
+#include <dtkgui_global.h>
+
+#include <QByteArray>
+
+DGUI_BEGIN_NAMESPACE
+
+/*
+ * The old librsvg only knows "xlink:href", DSvgRenderer renames the unprefixed
+ * href attributes of the start tags before a file is loaded. The comments, CDATA
+ * sections, processing instructions, declarations (with the internal subset of
+ * DOCTYPE) and the attribute values are skipped. A malformed document, like the
+ * one having an unquoted attribute value, is returned unchanged, the unchanged
+ * spans are copied verbatim. Only the ASCII compatible encodings (e.g. UTF-8)
+ * are handled.
+ */
+class Q_DECL_HIDDEN DSvgHrefRewriter
+{
+public:
+    static QByteArray rewrite(const QByteArray &contents);
+};
+
+DGUI_END_NAMESPACE
+
+#endif // DSVGHREFREWRITER_P_H
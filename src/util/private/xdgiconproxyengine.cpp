@@ -3,8 +3,12 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include "xdgiconproxyengine_p.h"
+#include "dcachestatisticscounter_p.h"
 
+#include <QCache>
+#include <QDateTime>
 #include <QFile>
+#include <QFileInfo>
 #include <QIconEngine>
 #include <QThreadStorage>
 #include <QXmlStreamReader>
@@ -12,6 +16,8 @@
 #include <QPainter>
 #include <QPalette>
 #include <QGuiApplication>
+#include <QMutex>
+#include <QSharedPointer>
 #include <DSvgRenderer>
 
 #include <cxxabi.h>
@@ -73,6 +79,56 @@ static inline QPixmap entryPixmap(ScalableEntry *color_entry, const QSize &size,
     return color_entry->svgIcon.pixmap(size, mode, state);
 }
 
+// The renderers are kept by the identity (name, modification time and size) of
+// the file, so the images rendered by them (see DSvgRenderer::toImage) are reused
+// by the following paints of the same icon instead of parsing and rasterising the
+// file again, and a changed file is loaded again. The images of all renderers
+// share the budget of the DSvgRenderer image cache.
+class XdgSvgRendererCache
+{
+public:
+    using Renderer = QSharedPointer<DTK_GUI_NAMESPACE::DSvgRenderer>;
+
+    Renderer renderer(const QString &fileName)
+    {
+        const QFileInfo info(fileName);
+        const QString key = fileName + QLatin1Char('\n') + QString::number(info.lastModified().toMSecsSinceEpoch())
+                + QLatin1Char('\n') + QString::number(info.size());
+        {
+            QMutexLocker locker(&mutex);
+            if (const Renderer *cached = cache.object(key)) {
+                statistics.hit();
+                return *cached;
+            }
+            statistics.miss();
+        }
+
+        // Loaded without the lock, the renderer of another thread wins if they are raced.
+        Renderer renderer(new DTK_GUI_NAMESPACE::DSvgRenderer(fileName));
+
+        QMutexLocker locker(&mutex);
+        if (const Renderer *cached = cache.object(key))
+            return *cached;
+
+        const int size = cache.size();
+        cache.insert(key, new Renderer(renderer));
+        statistics.countInsertion(size, false, cache.size());
+        return renderer;
+    }
+
+private:
+    QMutex mutex;
+    QCache<QString, Renderer> cache { 32 };
+    // Declared last, it's unregistered before the cache is destroyed.
+    DTK_GUI_NAMESPACE::DCacheStatisticsCounter statistics { "xdgicon.svgrenderer", [this](DTK_GUI_NAMESPACE::DCacheStatistics::Cache *statistics) {
+        QMutexLocker locker(&mutex);
+        statistics->entries = cache.size();
+        statistics->maxEntries = cache.maxCost();
+    }};
+};
+
+Q_GLOBAL_STATIC(XdgSvgRendererCache, _svgRendererCache)
+
 // Render a scalable SVG entry using DSvgRenderer (backed by librsvg) when available.
 //
 // This is a workaround for a long-standing Qt SVG rendering bug: QSvgRenderer
@@ -90,15 +146,15 @@ static QPixmap renderSvgWithLibrsvg(ScalableEntry *entry, const QSize &size,
                                      QIcon::Mode mode, QIcon::State state)
 {
     DGUI_USE_NAMESPACE
-    DSvgRenderer renderer(entry->filename);
-    if (renderer.isValid()) {
-        QSize actualSize = renderer.defaultSize();
+    const XdgSvgRendererCache::Renderer renderer = _svgRendererCache->renderer(entry->filename);
+    if (renderer->isValid()) {
+        QSize actualSize = renderer->defaultSize();
         if (!size.isEmpty() && !actualSize.isEmpty()) {
             if (actualSize.width() < size.width())
                 actualSize.scale(size, Qt::KeepAspectRatio);
         }
         if (!actualSize.isEmpty()) {
-            const QImage img = renderer.toImage(actualSize);
+            const QImage img = renderer->toImage(actualSize);
             if (!img.isNull())
                 return QPixmap::fromImage(
                     img.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation));
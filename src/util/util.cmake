@@ -14,6 +14,15 @@ if(NOT DTK_DISABLE_LIBXDG)
         ${CMAKE_CURRENT_LIST_DIR}/private/dciiconengine.cpp
         ${CMAKE_CURRENT_LIST_DIR}/private/diconproxyengine_p.h
         ${CMAKE_CURRENT_LIST_DIR}/private/diconproxyengine.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/private/ddciiconthemeindex_p.h
+        ${CMAKE_CURRENT_LIST_DIR}/private/ddciiconthemeindex.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/private/diconpixmapdiskcache_p.h
+        ${CMAKE_CURRENT_LIST_DIR}/private/diconpixmapdiskcache.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/private/diconcachekey_p.h
+        ${CMAKE_CURRENT_LIST_DIR}/private/diconcachekey.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/private/dcachestatisticscounter_p.h
+        ${CMAKE_CURRENT_LIST_DIR}/private/dsvghrefrewriter_p.h
+        ${CMAKE_CURRENT_LIST_DIR}/private/dsvghrefrewriter.cpp
     )
 else()
     message("Disable libxdg!")
@@ -26,6 +35,15 @@ else()
         ${CMAKE_CURRENT_LIST_DIR}/private/dciiconengine.cpp
         ${CMAKE_CURRENT_LIST_DIR}/private/diconproxyengine_p.h
         ${CMAKE_CURRENT_LIST_DIR}/private/diconproxyengine.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/private/ddciiconthemeindex_p.h
+        ${CMAKE_CURRENT_LIST_DIR}/private/ddciiconthemeindex.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/private/diconpixmapdiskcache_p.h
+        ${CMAKE_CURRENT_LIST_DIR}/private/diconpixmapdiskcache.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/private/diconcachekey_p.h
+        ${CMAKE_CURRENT_LIST_DIR}/private/diconcachekey.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/private/dcachestatisticscounter_p.h
+        ${CMAKE_CURRENT_LIST_DIR}/private/dsvghrefrewriter_p.h
+        ${CMAKE_CURRENT_LIST_DIR}/private/dsvghrefrewriter.cpp
     )
 endif()
 
@@ -0,0 +1,65 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "benchmark.h"
+
+#include <DDciIcon>
+#include <DDciIconPalette>
+
+#include <QFile>
+#include <QImage>
+#include <QPainter>
+
+DGUI_USE_NAMESPACE
+
+#define DCI_FILE ":/dsg/built-in-icons/test_selected_indicator.dci"
+
+D_BENCHMARK(DDciIcon, pixmap)
+{
+    const DDciIcon icon(QStringLiteral(DCI_FILE));
+    if (icon.isNull())
+        return state.skip("can't load " DCI_FILE);
+
+    while (state.keepRunning())
+        dDoNotOptimize(icon.pixmap(1.25, 32, DDciIcon::Light));
+}
+
+D_BENCHMARK(DDciIcon, pixmapWithPalette)
+{
+    const DDciIcon icon(QStringLiteral(DCI_FILE));
+    if (icon.isNull())
+        return state.skip("can't load " DCI_FILE);
+
+    const DDciIconPalette palette(Qt::black, Qt::white, QColor(0, 129, 255), Qt::white);
+    while (state.keepRunning())
+        dDoNotOptimize(icon.pixmap(2, 32, DDciIcon::Dark, DDciIcon::Hover, palette));
+}
+
+// A new icon for every iteration, the data is parsed and rasterised each time.
+D_BENCHMARK(DDciIcon, pixmapUncached)
+{
+    QFile file(QStringLiteral(DCI_FILE));
+    if (!file.open(QIODevice::ReadOnly))
+        return state.skip("can't open " DCI_FILE);
+    const QByteArray data = file.readAll();
+
+    while (state.keepRunning()) {
+        const DDciIcon icon(data);
+        dDoNotOptimize(icon.pixmap(1.25, 32, DDciIcon::Light));
+    }
+}
+
+D_BENCHMARK(DDciIcon, paint)
+{
+    const DDciIcon icon(QStringLiteral(DCI_FILE));
+    if (icon.isNull())
+        return state.skip("can't load " DCI_FILE);
+
+    QImage target(64, 64, QImage::Format_ARGB32_Premultiplied);
+    target.fill(Qt::transparent);
+    QPainter painter(&target);
+
+    while (state.keepRunning())
+        icon.paint(&painter, QRect(0, 0, 32, 32), 1.0, DDciIcon::Light);
+}
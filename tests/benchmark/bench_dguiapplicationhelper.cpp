@@ -0,0 +1,42 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "benchmark.h"
+
+#include <DGuiApplicationHelper>
+
+#include <QImage>
+
+DGUI_USE_NAMESPACE
+
+D_BENCHMARK(DGuiApplicationHelper, adjustColor)
+{
+    const QColor color(0, 129, 255, 200);
+    while (state.keepRunning())
+        dDoNotOptimize(DGuiApplicationHelper::adjustColor(color, 0, 0, -10, 0, 0, 0, -20));
+}
+
+D_BENCHMARK(DGuiApplicationHelper, adjustColorImage)
+{
+    const QImage image = QImage(":/images/logo_icon.png").convertToFormat(QImage::Format_ARGB32_Premultiplied)
+            .scaled(256, 256);
+    if (image.isNull())
+        return state.skip("can't load the image");
+
+    while (state.keepRunning())
+        dDoNotOptimize(DGuiApplicationHelper::adjustColor(image, 0, 0, -10, 0, 0, 0, -20));
+}
+
+D_BENCHMARK(DGuiApplicationHelper, standardPalette)
+{
+    while (state.keepRunning())
+        dDoNotOptimize(DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::DarkType));
+}
+
+D_BENCHMARK(DGuiApplicationHelper, fetchPalette)
+{
+    const DPlatformTheme *theme = DGuiApplicationHelper::instance()->systemTheme();
+    while (state.keepRunning())
+        dDoNotOptimize(DGuiApplicationHelper::fetchPalette(theme));
+}
@@ -0,0 +1,99 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "benchmark.h"
+
+#include <DIconTheme>
+
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+
+DGUI_USE_NAMESPACE
+
+// A dci theme "bloom" with some icons, the search paths are restored when it's destroyed.
+class DciThemeFixture
+{
+public:
+    DciThemeFixture()
+        : oldPaths(DIconTheme::dciThemeSearchPaths())
+    {
+        if (!searchPath.isValid())
+            return;
+
+        QDir dir(searchPath.path());
+        if (!dir.mkpath("bloom/org.deepin.app"))
+            return;
+
+        for (int i = 0; i < 100; ++i) {
+            if (!QFile::copy(":/images/dci_heart.dci", dir.filePath(QString("bloom/icon%1.dci").arg(i))))
+                return;
+        }
+        if (!QFile::copy(":/images/dci_heart.dci", dir.filePath("bloom/org.deepin.app/accounts.dci")))
+            return;
+
+        DIconTheme::setDciThemeSearchPaths({searchPath.path()});
+        valid = true;
+    }
+
+    ~DciThemeFixture()
+    {
+        DIconTheme::setDciThemeSearchPaths(oldPaths);
+    }
+
+    QTemporaryDir searchPath;
+    const QStringList oldPaths;
+    bool valid = false;
+};
+
+D_BENCHMARK(DIconTheme, findDciIconFile)
+{
+    DciThemeFixture fixture;
+    if (!fixture.valid)
+        return state.skip("can't create the dci theme");
+
+    while (state.keepRunning())
+        dDoNotOptimize(DIconTheme::findDciIconFile("icon42", "bloom"));
+}
+
+D_BENCHMARK(DIconTheme, findDciIconFileMissing)
+{
+    DciThemeFixture fixture;
+    if (!fixture.valid)
+        return state.skip("can't create the dci theme");
+
+    while (state.keepRunning())
+        dDoNotOptimize(DIconTheme::findDciIconFile("missing", "bloom"));
+}
+
+D_BENCHMARK(DIconTheme, cachedFindDciIconFile)
+{
+    DciThemeFixture fixture;
+    if (!fixture.valid)
+        return state.skip("can't create the dci theme");
+
+    DIconTheme::Cached cache;
+    while (state.keepRunning())
+        dDoNotOptimize(cache.findDciIconFile("org.deepin.app/accounts", "bloom"));
+}
+
+D_BENCHMARK(DIconTheme, cachedFindQIcon)
+{
+    DIconTheme::Cached *cache = DIconTheme::cached();
+    while (state.keepRunning())
+        dDoNotOptimize(cache->findQIcon("icon_Layout"));
+}
+
+D_BENCHMARK(DIconTheme, cachedFindQIconMissing)
+{
+    DIconTheme::Cached *cache = DIconTheme::cached();
+    while (state.keepRunning())
+        dDoNotOptimize(cache->findQIcon("dtkgui-benchmark-missing-icon", DIconTheme::DontFallbackToQIconFromTheme));
+}
+
+D_BENCHMARK(DIconTheme, findQIcon)
+{
+    while (state.keepRunning())
+        dDoNotOptimize(DIconTheme::findQIcon("icon_Layout"));
+}
@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "benchmark.h"
+
+#include <DImageHandler>
+
+#include <QImage>
+
+DGUI_USE_NAMESPACE
+
+// A 512x512 photo like image, the filters are slow on the large images only.
+static QImage sourceImage()
+{
+    static const QImage image = [] {
+        QImage image = QImage(":/images/logo_icon.png").convertToFormat(QImage::Format_ARGB32)
+                .scaled(512, 512, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        return image;
+    }();
+    return image;
+}
+
+#define D_IMAGE_FILTER_BENCHMARK(Name, ...) \
+    D_BENCHMARK(DImageHandler, Name) \
+    { \
+        const QImage image = sourceImage(); \
+        if (image.isNull()) \
+            return state.skip("can't load the image"); \
+        while (state.keepRunning()) \
+            dDoNotOptimize(DImageHandler::Name(image, ##__VA_ARGS__)); \
+    }
+
+D_IMAGE_FILTER_BENCHMARK(oldColorFilter)
+D_IMAGE_FILTER_BENCHMARK(warmColorFilter)
+D_IMAGE_FILTER_BENCHMARK(coolColorFilter)
+D_IMAGE_FILTER_BENCHMARK(grayScaleColorFilter)
+D_IMAGE_FILTER_BENCHMARK(antiColorFilter)
+D_IMAGE_FILTER_BENCHMARK(metalColorFilter)
+D_IMAGE_FILTER_BENCHMARK(bilateralFilter)
+D_IMAGE_FILTER_BENCHMARK(contourExtraction)
+D_IMAGE_FILTER_BENCHMARK(binaryzation)
+D_IMAGE_FILTER_BENCHMARK(grayScale)
+D_IMAGE_FILTER_BENCHMARK(laplaceSharpen)
+D_IMAGE_FILTER_BENCHMARK(sobelEdgeDetector)
+D_IMAGE_FILTER_BENCHMARK(changeLightAndContrast)
+D_IMAGE_FILTER_BENCHMARK(changeBrightness, 50)
+D_IMAGE_FILTER_BENCHMARK(changeTransparency, 50)
+D_IMAGE_FILTER_BENCHMARK(changeStauration, 50)
+D_IMAGE_FILTER_BENCHMARK(replacePointColor, QColor(Qt::white), QColor(Qt::red))
+D_IMAGE_FILTER_BENCHMARK(flipHorizontal)
+D_IMAGE_FILTER_BENCHMARK(flipVertical)
@@ -0,0 +1,111 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "benchmark.h"
+
+#include <DSvgRenderer>
+
+#include <QFile>
+#include <QTemporaryDir>
+
+DGUI_USE_NAMESPACE
+
+#define SVG_FILE ":/images/logo_icon.svg"
+
+// The images are cached by the renderer after the first iteration.
+D_BENCHMARK(DSvgRenderer, toImage)
+{
+    const DSvgRenderer renderer(QStringLiteral(SVG_FILE));
+    if (!renderer.isValid())
+        return state.skip("can't load " SVG_FILE);
+
+    while (state.keepRunning())
+        dDoNotOptimize(renderer.toImage(QSize(64, 64)));
+}
+
+// Cached as well.
+D_BENCHMARK(DSvgRenderer, toImageLarge)
+{
+    const DSvgRenderer renderer(QStringLiteral(SVG_FILE));
+    if (!renderer.isValid())
+        return state.skip("can't load " SVG_FILE);
+
+    while (state.keepRunning())
+        dDoNotOptimize(renderer.toImage(QSize(512, 512)));
+}
+
+// Loads the document for every iteration.
+D_BENCHMARK(DSvgRenderer, loadAndToImage)
+{
+    QFile file(QStringLiteral(SVG_FILE));
+    if (!file.open(QIODevice::ReadOnly))
+        return state.skip("can't open " SVG_FILE);
+    const QByteArray data = file.readAll();
+
+    while (state.keepRunning()) {
+        const DSvgRenderer renderer(data);
+        dDoNotOptimize(renderer.toImage(QSize(64, 64)));
+    }
+}
+
+static const QList<QSize> batchSizes {{16, 16}, {24, 24}, {32, 32}, {48, 48}, {64, 64}, {96, 96}, {128, 128}, {256, 256}};
+
+// Renders the sizes of an icon theme one by one, a new renderer is loaded (not measured)
+// for every iteration so that nothing is cached.
+D_BENCHMARK(DSvgRenderer, toImageSizesSerial)
+{
+    QFile file(QStringLiteral(SVG_FILE));
+    if (!file.open(QIODevice::ReadOnly))
+        return state.skip("can't open " SVG_FILE);
+    const QByteArray data = file.readAll();
+
+    while (state.keepRunning()) {
+        state.pause();
+        const DSvgRenderer renderer(data);
+        state.resume();
+        for (const QSize &size : batchSizes)
+            dDoNotOptimize(renderer.toImage(size));
+    }
+}
+
+// The same as toImageSizesSerial, rendered by DSvgRenderer::toImages in the thread pool.
+D_BENCHMARK(DSvgRenderer, toImagesBatch)
+{
+    QFile file(QStringLiteral(SVG_FILE));
+    if (!file.open(QIODevice::ReadOnly))
+        return state.skip("can't open " SVG_FILE);
+    const QByteArray data = file.readAll();
+
+    while (state.keepRunning()) {
+        state.pause();
+        const DSvgRenderer renderer(data);
+        state.resume();
+        dDoNotOptimize(renderer.toImages(batchSizes));
+    }
+}
+
+// Loads a large illustration using href, it's rewritten to xlink:href on load.
+D_BENCHMARK(DSvgRenderer, loadFileWithHref)
+{
+    QByteArray svg = "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\""
+                     " width=\"1000\" height=\"1000\">\n"
+                     "<defs><circle id=\"c\" r=\"4\" fill=\"#0081ff\"/></defs>\n";
+    for (int i = 0; i < 5000; ++i) {
+        svg += QByteArrayLiteral("<path d=\"M0 0L10 10\" stroke=\"#000\"/><use href=\"#c\" x=\"")
+                + QByteArray::number(i % 100 * 10) + "\" y=\"" + QByteArray::number(i / 100 * 10) + "\"/>\n";
+    }
+    svg += "</svg>\n";
+
+    QTemporaryDir dir;
+    QFile file(dir.filePath("href.svg"));
+    if (!dir.isValid() || !file.open(QIODevice::WriteOnly) || file.write(svg) != svg.size())
+        return state.skip("can't write the document");
+    file.close();
+
+    while (state.keepRunning()) {
+        const DSvgRenderer renderer(file.fileName());
+        if (!renderer.isValid())
+            return state.skip("can't load the document");
+    }
+}
@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "benchmark.h"
+
+#include <DThumbnailProvider>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QTemporaryDir>
+
+DGUI_USE_NAMESPACE
+
+static void createThumbnail(DBenchmarkState &state, DThumbnailProvider::Size size)
+{
+    QTemporaryDir dir;
+    if (!dir.isValid())
+        return state.skip("can't create the temporary directory");
+
+    // A large source image, the scaling is the most part of the work.
+    const QString imageFile = QDir(dir.path()).filePath("source.png");
+    const QImage image = QImage(":/images/logo_icon.png").scaled(1024, 1024);
+    if (image.isNull() || !image.save(imageFile))
+        return state.skip("can't create the source image");
+
+    DThumbnailProvider *provider = DThumbnailProvider::instance();
+    const QFileInfo info(imageFile);
+
+    while (state.keepRunning()) {
+        const QString thumbnail = provider->createThumbnail(info, size);
+        if (thumbnail.isEmpty())
+            return state.skip(provider->errorString());
+
+        // The existing thumbnail is returned without creating.
+        state.pause();
+        QFile::remove(thumbnail);
+        state.resume();
+    }
+}
+
+D_BENCHMARK(DThumbnailProvider, createThumbnailSmall)
+{
+    createThumbnail(state, DThumbnailProvider::Small);
+}
+
+D_BENCHMARK(DThumbnailProvider, createThumbnailLarge)
+{
+    createThumbnail(state, DThumbnailProvider::Large);
+}
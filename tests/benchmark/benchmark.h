@@ -0,0 +1,102 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+
+#include <functional>
+
+/*
+ * A minimal benchmark harness, the results are printed as JSON.
+ *
+ *  D_BENCHMARK(DDciIcon, pixmap)
+ *  {
+ *      DDciIcon icon(...);             // setup, not measured
+ *      while (state.keepRunning())
+ *          icon.pixmap(...);           // measured
+ *  }
+ *
+ * Each iteration is measured separately, the work that shouldn't be measured
+ * in an iteration is surrounded by pause() and resume().
+ */
+class DBenchmarkState
+{
+public:
+    DBenchmarkState(qint64 minTimeNs, int minIterations, int maxIterations)
+        : m_minTimeNs(minTimeNs)
+        , m_minIterations(minIterations)
+        , m_maxIterations(maxIterations)
+    {
+    }
+
+    inline bool keepRunning()
+    {
+        if (m_running) {
+            m_current += m_timer.nsecsElapsed();
+            m_samples.append(m_current);
+            m_total += m_current;
+        }
+
+        m_running = m_samples.size() < m_maxIterations
+                && (m_samples.size() < m_minIterations || m_total < m_minTimeNs);
+        if (m_running) {
+            m_current = 0;
+            m_timer.start();
+        }
+
+        return m_running;
+    }
+
+    inline void pause()
+    {
+        m_current += m_timer.nsecsElapsed();
+    }
+
+    inline void resume()
+    {
+        m_timer.start();
+    }
+
+    // The error is reported in the result, the benchmark should return after it.
+    void skip(const QString &reason) { m_skipReason = reason; }
+
+    const QVector<qint64> &samples() const { return m_samples; }
+    QString skipReason() const { return m_skipReason; }
+
+private:
+    const qint64 m_minTimeNs;
+    const int m_minIterations;
+    const int m_maxIterations;
+
+    QElapsedTimer m_timer;
+    QVector<qint64> m_samples;
+    qint64 m_current = 0;
+    qint64 m_total = 0;
+    bool m_running = false;
+    QString m_skipReason;
+};
+
+namespace DBenchmark {
+using Function = std::function<void(DBenchmarkState &)>;
+bool registerBenchmark(const char *group, const char *name, Function function);
+}
+
+#define D_BENCHMARK(Group, Name) \
+    static void dbenchmark_##Group##_##Name(DBenchmarkState &state); \
+    Q_DECL_UNUSED static const bool dbenchmark_##Group##_##Name##_registered \
+        = DBenchmark::registerBenchmark(#Group, #Name, dbenchmark_##Group##_##Name); \
+    static void dbenchmark_##Group##_##Name(DBenchmarkState &state)
+
+// Prevents the compiler from removing the result of the measured code.
+template<typename T>
+inline void dDoNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#endif // BENCHMARK_H
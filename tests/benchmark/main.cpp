@@ -0,0 +1,161 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "benchmark.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRegularExpression>
+#include <QSysInfo>
+#include <QTemporaryDir>
+
+#include <DGuiApplicationHelper>
+
+#include <algorithm>
+#include <cstdio>
+
+DGUI_USE_NAMESPACE
+
+struct BenchmarkEntry
+{
+    QString name;
+    DBenchmark::Function function;
+};
+
+static QVector<BenchmarkEntry> &benchmarks()
+{
+    static QVector<BenchmarkEntry> list;
+    return list;
+}
+
+bool DBenchmark::registerBenchmark(const char *group, const char *name, Function function)
+{
+    benchmarks().append({QLatin1String(group) + QLatin1Char('/') + QLatin1String(name), std::move(function)});
+    return true;
+}
+
+static QJsonObject runBenchmark(const BenchmarkEntry &entry, qint64 minTimeNs, int minIterations, int maxIterations)
+{
+    DBenchmarkState state(minTimeNs, minIterations, maxIterations);
+    entry.function(state);
+
+    QJsonObject result;
+    result.insert("name", entry.name);
+
+    QVector<qint64> samples = state.samples();
+    if (!state.skipReason().isEmpty() || samples.isEmpty()) {
+        result.insert("skipped", state.skipReason().isEmpty() ? QStringLiteral("no iteration") : state.skipReason());
+        return result;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    qint64 total = 0;
+    for (qint64 sample : samples)
+        total += sample;
+
+    const int count = samples.size();
+    const qint64 median = count % 2 ? samples.at(count / 2)
+                                    : (samples.at(count / 2 - 1) + samples.at(count / 2)) / 2;
+    result.insert("iterations", count);
+    result.insert("total_ns", total);
+    result.insert("mean_ns", double(total) / count);
+    result.insert("min_ns", samples.first());
+    result.insert("median_ns", median);
+    result.insert("p90_ns", samples.at(qMin(count - 1, count * 9 / 10)));
+    result.insert("max_ns", samples.last());
+
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    // Runs headless on the minimal platform plugin of the unit tests.
+    qputenv("QT_QPA_PLATFORM", "minimal");
+    QString paths(QFileInfo(QString::fromUtf8(argv[0])).path() + "/../plugins");
+    qputenv("QT_QPA_PLATFORM_PLUGIN_PATH", paths.toLocal8Bit().data());
+    qputenv("D_DXCB_DISABLE_OVERRIDE_HIDPI", "1");
+
+    // Keeps the user's caches (thumbnails, icon pixmaps) untouched and the results
+    // independent of them.
+    QTemporaryDir cacheHome;
+    if (cacheHome.isValid())
+        qputenv("XDG_CACHE_HOME", cacheHome.path().toLocal8Bit());
+
+    DGuiApplicationHelper::instance()->setPaletteType(DGuiApplicationHelper::LightType);
+    QApplication app(argc, argv);
+    app.setApplicationName("dtkgui-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("The micro benchmarks of dtkgui, the results are printed as JSON.");
+    parser.addHelpOption();
+    QCommandLineOption listOption("list", "List the benchmarks.");
+    QCommandLineOption filterOption({"f", "filter"}, "Run the benchmarks matching the <regexp> only.", "regexp");
+    QCommandLineOption outputOption({"o", "output"}, "Write the results to <file> instead of stdout.", "file");
+    QCommandLineOption minTimeOption("min-time", "The minimum measured time of a benchmark, in milliseconds.", "ms", "500");
+    QCommandLineOption minIterationsOption("min-iterations", "The minimum iterations of a benchmark.", "count", "10");
+    QCommandLineOption maxIterationsOption("max-iterations", "The maximum iterations of a benchmark.", "count", "1000000");
+    parser.addOptions({listOption, filterOption, outputOption, minTimeOption, minIterationsOption, maxIterationsOption});
+    parser.process(app);
+
+    std::sort(benchmarks().begin(), benchmarks().end(), [](const BenchmarkEntry &a, const BenchmarkEntry &b) {
+        return a.name < b.name;
+    });
+
+    const QRegularExpression filter(parser.value(filterOption));
+    if (!filter.isValid()) {
+        fprintf(stderr, "Invalid filter: %s\n", qPrintable(filter.errorString()));
+        return 1;
+    }
+
+    if (parser.isSet(listOption)) {
+        for (const BenchmarkEntry &entry : benchmarks()) {
+            if (filter.match(entry.name).hasMatch())
+                printf("%s\n", qPrintable(entry.name));
+        }
+        return 0;
+    }
+
+    const qint64 minTimeNs = parser.value(minTimeOption).toLongLong() * 1000000;
+    const int minIterations = qMax(1, parser.value(minIterationsOption).toInt());
+    const int maxIterations = qMax(minIterations, parser.value(maxIterationsOption).toInt());
+
+    QJsonArray results;
+    for (const BenchmarkEntry &entry : benchmarks()) {
+        if (!filter.match(entry.name).hasMatch())
+            continue;
+
+        fprintf(stderr, "%s\n", qPrintable(entry.name));
+        results.append(runBenchmark(entry, minTimeNs, minIterations, maxIterations));
+    }
+
+    QJsonObject context;
+    context.insert("qt_version", QString::fromLatin1(qVersion()));
+    context.insert("dtkgui_version", QStringLiteral(DTK_GUI_BENCHMARK_VERSION));
+    context.insert("cpu_architecture", QSysInfo::currentCpuArchitecture());
+    context.insert("kernel_version", QSysInfo::kernelVersion());
+    context.insert("product", QSysInfo::prettyProductName());
+    context.insert("min_time_ms", parser.value(minTimeOption).toInt());
+
+    QJsonObject root;
+    root.insert("context", context);
+    root.insert("benchmarks", results);
+    const QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            fprintf(stderr, "Can't write the results to %s\n", qPrintable(file.fileName()));
+            return 1;
+        }
+    } else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "test.h"
+#include "dcachestatisticscounter_p.h"
+
+#include <DDciIcon>
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+DGUI_USE_NAMESPACE
+
+TEST(ut_DCacheStatistics, counter)
+{
+    {
+        DCacheStatisticsCounter counter1("ut_DCacheStatistics.counter");
+        DCacheStatisticsCounter counter2("ut_DCacheStatistics.counter", [](DCacheStatistics::Cache *cache) {
+            cache->entries = 2;
+            cache->bytes = 200;
+            cache->maxEntries = 10;
+        });
+
+        counter1.hit();
+        counter1.hit();
+        counter1.miss();
+        counter1.addEntries(3, 300);
+        counter2.miss();
+        counter2.countInsertion(10, false, 10);
+
+        // The counters of the same name are summed.
+        DCacheStatistics::Cache cache = DCacheStatistics::cache("ut_DCacheStatistics.counter");
+        EXPECT_EQ(cache.hits, 2);
+        EXPECT_EQ(cache.misses, 2);
+        EXPECT_EQ(cache.evictions, 1);
+        EXPECT_EQ(cache.entries, 5);
+        EXPECT_EQ(cache.bytes, 500);
+        EXPECT_EQ(cache.maxEntries, 10);
+        EXPECT_EQ(cache.maxBytes, -1);
+
+        const QJsonArray caches = QJsonDocument::fromJson(DCacheStatistics::toJson()).object().value("caches").toArray();
+        bool found = false;
+        for (const QJsonValue &value : caches) {
+            const QJsonObject object = value.toObject();
+            if (object.value("name").toString() != "ut_DCacheStatistics.counter")
+                continue;
+            found = true;
+            EXPECT_EQ(object.value("hits").toInt(), 2);
+            EXPECT_DOUBLE_EQ(object.value("hitRate").toDouble(), 0.5);
+        }
+        EXPECT_TRUE(found);
+
+        counter1.addEntries(-3, -300);
+        DCacheStatistics::reset();
+        cache = DCacheStatistics::cache("ut_DCacheStatistics.counter");
+        EXPECT_EQ(cache.hits, 0);
+        EXPECT_EQ(cache.misses, 0);
+        EXPECT_EQ(cache.entries, 2);
+    }
+
+    // Unregistered with the counters.
+    const QList<DCacheStatistics::Cache> caches = DCacheStatistics::caches();
+    for (const DCacheStatistics::Cache &cache : caches)
+        EXPECT_NE(cache.name, QStringLiteral("ut_DCacheStatistics.counter"));
+}
+
+TEST(ut_DCacheStatistics, dciIconImage)
+{
+    const DDciIcon icon(QStringLiteral(":/images/dci_heart.dci"));
+    ASSERT_FALSE(icon.isNull());
+
+    const DCacheStatistics::Cache before = DCacheStatistics::cache("dciicon.image");
+    ASSERT_FALSE(icon.toImage(1.0, 64, DDciIcon::Light).isNull());
+    ASSERT_FALSE(icon.toImage(1.0, 64, DDciIcon::Light).isNull());
+    const DCacheStatistics::Cache after = DCacheStatistics::cache("dciicon.image");
+
+    EXPECT_GE(after.hits, before.hits + 1);
+    EXPECT_GE(after.misses, before.misses + 1);
+    EXPECT_GT(after.entries, 0);
+    EXPECT_GT(after.bytes, 0);
+    EXPECT_GT(after.maxBytes, 0);
+}
@@ -4,10 +4,21 @@
 
 #include "test.h"
 #include "ddciicon.h"
+#include "dcachestatistics.h"
+
+#include <DDciFile>
 
 #include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QPainter>
+
+#include <thread>
+#include <vector>
 
 DGUI_USE_NAMESPACE
+DCORE_USE_NAMESPACE
 
 class GTEST_API_ ut_DDciIcon : public DTest
 {
@@ -24,6 +35,30 @@ TEST_F(ut_DDciIcon, isNull)
     ASSERT_FALSE(icon.isNull());
 }
 
+TEST_F(ut_DDciIcon, invalidSizeDirectory)
+{
+    // "200" is empty and "300" has no valid entry, the other sizes are matched.
+    DDciFile file(QStringLiteral(":/images/dci_heart.dci"));
+    ASSERT_TRUE(file.isValid());
+    ASSERT_TRUE(file.mkdir("/200"));
+    ASSERT_TRUE(file.mkdir("/300"));
+    ASSERT_TRUE(file.mkdir("/300/invalid"));
+
+    DDciIcon invalidSizes(file.toData());
+    EXPECT_FALSE(invalidSizes.isNull());
+    EXPECT_EQ(invalidSizes.actualSize(150, DDciIcon::Light), 100);
+    EXPECT_EQ(invalidSizes.actualSize(512, DDciIcon::Light), 100);
+    EXPECT_EQ(invalidSizes.actualSize(512, DDciIcon::Light, DDciIcon::Hover), 100);
+    EXPECT_EQ(invalidSizes.availableSizes(DDciIcon::Light), icon.availableSizes(DDciIcon::Light));
+
+    DDciFile emptyFile;
+    ASSERT_TRUE(emptyFile.mkdir("/16"));
+    DDciIcon empty(emptyFile.toData());
+    EXPECT_TRUE(empty.isNull());
+    EXPECT_EQ(empty.matchIcon(16, DDciIcon::Light, DDciIcon::Normal), nullptr);
+    EXPECT_TRUE(empty.availableSizes(DDciIcon::Light).isEmpty());
+}
+
 TEST_F(ut_DDciIcon, actualSize)
 {
     DDciIconMatchResult res = icon.matchIcon(64, DDciIcon::Light, DDciIcon::Normal);
@@ -32,6 +67,48 @@ TEST_F(ut_DDciIcon, actualSize)
     ASSERT_EQ(size, 100);
 }
 
+TEST_F(ut_DDciIcon, lazyLoad)
+{
+    // The sizes are parsed on demand, each call sees the same entries.
+    DDciIcon fresh(QStringLiteral(":/images/dci_heart.dci"));
+    EXPECT_EQ(fresh.actualSize(64, DDciIcon::Light), icon.actualSize(64, DDciIcon::Light));
+    EXPECT_EQ(fresh.availableSizes(DDciIcon::Light), icon.availableSizes(DDciIcon::Light));
+    EXPECT_FALSE(fresh.availableSizes(DDciIcon::Light).isEmpty());
+
+    DDciIcon painted(QStringLiteral(":/images/dci_heart.dci"));
+    QImage image(64, 64, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painted.paint(&painter, image.rect(), 1, DDciIcon::Light);
+    painter.end();
+    bool drawn = false;
+    for (int y = 0; y < image.height() && !drawn; ++y) {
+        for (int x = 0; x < image.width() && !drawn; ++x)
+            drawn = qAlpha(image.pixel(x, y)) > 0;
+    }
+    EXPECT_TRUE(drawn);
+    EXPECT_EQ(painted.availableSizes(DDciIcon::Light), icon.availableSizes(DDciIcon::Light));
+}
+
+TEST_F(ut_DDciIcon, matchIcon)
+{
+    const DDciIconMatchResult normal = icon.matchIcon(64, DDciIcon::Light, DDciIcon::Normal);
+    ASSERT_TRUE(normal);
+    EXPECT_EQ(icon.matchIcon(64, DDciIcon::Light, DDciIcon::Normal), normal);
+    EXPECT_EQ(icon.matchIcon(64, DDciIcon::Light, DDciIcon::Normal, DDciIcon::DontFallbackMode), normal);
+
+    // A missing mode falls back to the normal mode unless DontFallbackMode.
+    const DDciIconMatchResult pressed = icon.matchIcon(64, DDciIcon::Light, DDciIcon::Pressed);
+    ASSERT_TRUE(pressed);
+    if (pressed == normal)
+        EXPECT_FALSE(icon.matchIcon(64, DDciIcon::Light, DDciIcon::Pressed, DDciIcon::DontFallbackMode));
+
+    // The layer of the device pixel ratio is looked up in a table.
+    EXPECT_EQ(icon.image(normal, 64, 1).toImage().size(), QSize(64, 64));
+    EXPECT_EQ(icon.image(normal, 64, 2).toImage().size(), QSize(128, 128));
+    EXPECT_EQ(icon.image(normal, 64, 4).toImage().size(), QSize(256, 256));
+}
+
 TEST_F(ut_DDciIcon, pixmap)
 {
     EXPECT_EQ(icon.pixmap(1, 0, DDciIcon::Light).size().height(), 100); // invalid size 0
@@ -40,3 +117,88 @@ TEST_F(ut_DDciIcon, pixmap)
     EXPECT_EQ(icon.pixmap(1, 100, DDciIcon::Light).size().height(), 100);
     EXPECT_EQ(icon.pixmap(1, 256, DDciIcon::Light).size().height(), 256);
 }
+
+TEST_F(ut_DDciIcon, cachedLayer)
+{
+    // The second call is served by the decoded layer cache and must render the same image.
+    const QImage first = icon.pixmap(1, 64, DDciIcon::Light).toImage();
+    const QImage second = icon.pixmap(1, 64, DDciIcon::Light).toImage();
+    EXPECT_EQ(first, second);
+
+    const DDciIconPalette palette(Qt::red, Qt::white, Qt::blue, Qt::black);
+    EXPECT_EQ(icon.pixmap(1, 64, DDciIcon::Light, DDciIcon::Normal, palette).size(), first.size());
+}
+
+TEST_F(ut_DDciIcon, toImage)
+{
+    const DDciIconPalette palette(Qt::red, Qt::white, Qt::blue, Qt::black);
+    const QImage expected = icon.pixmap(1.25, 64, DDciIcon::Light, DDciIcon::Normal, palette).toImage();
+    ASSERT_EQ(expected.size(), QSize(80, 80));
+
+    // Rasterises the same icon in multiple threads.
+    std::vector<QImage> images(4);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < images.size(); ++i) {
+        threads.emplace_back([this, &images, i, palette] {
+            images[i] = icon.toImage(1.25, 64, DDciIcon::Light, DDciIcon::Normal, palette);
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    for (const QImage &image : images) {
+        EXPECT_EQ(image.devicePixelRatio(), 1.25);
+        EXPECT_EQ(image.convertToFormat(expected.format()), expected);
+    }
+}
+
+TEST_F(ut_DDciIcon, mappedFile)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QString fileName = QDir(dir.path()).filePath("heart.dci");
+    ASSERT_TRUE(QFile::copy(":/images/dci_heart.dci", fileName));
+
+    const QImage expected = icon.toImage(1, 64, DDciIcon::Light);
+    DDciIcon mapped(fileName);
+    DDciIcon shared(fileName);
+    ASSERT_FALSE(mapped.isNull());
+    EXPECT_EQ(mapped.toImage(1, 64, DDciIcon::Light), expected);
+    EXPECT_EQ(shared.toImage(1, 48, DDciIcon::Light).size(), QSize(48, 48));
+
+    // The image still reads the old mapping after the file is replaced.
+    DDciIconImage image = mapped.image(mapped.matchIcon(32, DDciIcon::Light, DDciIcon::Normal), 32, 1);
+    mapped = DDciIcon();
+    shared = DDciIcon();
+    ASSERT_TRUE(QFile::remove(fileName));
+    ASSERT_TRUE(QFile::copy(":/images/dci_heart.dci", fileName));
+    EXPECT_EQ(image.toImage().size(), QSize(32, 32));
+    EXPECT_EQ(DDciIcon(fileName).toImage(1, 64, DDciIcon::Light), expected);
+}
+
+TEST_F(ut_DDciIcon, sharedCacheOfFile)
+{
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QString fileName = QDir(dir.path()).filePath("heart.dci");
+    ASSERT_TRUE(QFile::copy(":/images/dci_heart.dci", fileName));
+
+    const auto cache = [] { return DCacheStatistics::cache(QStringLiteral("dciicon.image")); };
+    const QImage expected = DDciIcon(fileName).toImage(1, 72, DDciIcon::Light);
+    ASSERT_FALSE(expected.isNull());
+
+    // Another DDciIcon of the same file hits the images of the first one.
+    const DCacheStatistics::Cache before = cache();
+    EXPECT_EQ(DDciIcon(fileName).toImage(1, 72, DDciIcon::Light), expected);
+    EXPECT_EQ(cache().hits, before.hits + 1);
+    EXPECT_EQ(cache().entries, before.entries);
+
+    // The replaced file doesn't match them.
+    QFile file(fileName);
+    ASSERT_TRUE(file.open(QIODevice::Append));
+    file.write(QByteArray(1, '\0'));
+    file.close();
+    const DCacheStatistics::Cache replaced = cache();
+    DDciIcon(fileName).toImage(1, 72, DDciIcon::Light);
+    EXPECT_EQ(cache().hits, replaced.hits);
+}
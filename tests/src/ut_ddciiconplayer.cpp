@@ -11,6 +11,7 @@
 #include <QImageReader>
 #include <QPainter>
 #include <QSignalSpy>
+#include <QThreadPool>
 #include <QTimer>
 
 DGUI_USE_NAMESPACE
@@ -90,6 +91,77 @@ TEST(ut_DDciIconImage, render)
     }
 }
 
+TEST(ut_DDciIconImagePlayer, preDecode)
+{
+    DDciIcon icon(QStringLiteral(":/images/dci_heart.dci"));
+    ASSERT_FALSE(icon.isNull());
+
+    auto result = icon.matchIcon(-1, DDciIcon::Light, DDciIcon::Hover);
+    QImageReader reader(":/images/dci_heart_dci_hover.webp");
+    DDciIconImage image = icon.image(result, reader.size().width(), 1.0);
+    ASSERT_TRUE(image.supportsAnimation());
+
+    DDciIconImagePlayer player;
+    QSignalSpy finished_signal_spy(&player, &DDciIconImagePlayer::finished);
+    player.setImages({image});
+    player.setPreDecodeFrameCount(2);
+    ASSERT_EQ(player.preDecodeFrameCount(), 2);
+    ASSERT_TRUE(player.start(10.0, DDciIconImagePlayer::PreDecode | DDciIconImagePlayer::IgnoreLastImageLoop));
+
+    int frameCount = 0;
+    while (player.state() == DDciIconImagePlayer::WaitingRead) {
+        QImage image1 = player.readImage();
+        QImage image2 = reader.read().convertToFormat(image1.format());
+        ASSERT_EQ(image1, image2);
+        ++frameCount;
+
+        while (player.state() == DDciIconImagePlayer::Running)
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+
+    ASSERT_EQ(frameCount, reader.imageCount());
+    ASSERT_EQ(finished_signal_spy.count(), 1);
+}
+
+TEST(ut_DDciIconImagePlayer, preDecodeWithoutWorker)
+{
+    DDciIcon icon(QStringLiteral(":/images/dci_heart.dci"));
+    ASSERT_FALSE(icon.isNull());
+
+    auto result = icon.matchIcon(-1, DDciIcon::Light, DDciIcon::Hover);
+    QImageReader reader(":/images/dci_heart_dci_hover.webp");
+    DDciIconImage image = icon.image(result, reader.size().width(), 1.0);
+    ASSERT_TRUE(image.supportsAnimation());
+
+    // No worker can be started, the frames are decoded by the decoder in the current thread.
+    QThreadPool *pool = QThreadPool::globalInstance();
+    pool->waitForDone();
+    const int maxThreadCount = pool->maxThreadCount();
+    pool->setMaxThreadCount(1);
+    pool->reserveThread();
+
+    DDciIconImagePlayer player;
+    player.setImages({image});
+    ASSERT_TRUE(player.start(10.0, DDciIconImagePlayer::PreDecode | DDciIconImagePlayer::IgnoreLastImageLoop));
+
+    int frameCount = 0;
+    while (player.state() == DDciIconImagePlayer::WaitingRead) {
+        QImage image1 = player.readImage();
+        QImage image2 = reader.read().convertToFormat(image1.format());
+        EXPECT_EQ(image1, image2);
+        // The image of the player isn't read from the first frame again for each frame.
+        EXPECT_EQ(player.currentImage().currentImageNumber(), 0);
+        ++frameCount;
+
+        while (player.state() == DDciIconImagePlayer::Running)
+            QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+    }
+
+    pool->releaseThread();
+    pool->setMaxThreadCount(maxThreadCount);
+    ASSERT_EQ(frameCount, reader.imageCount());
+}
+
 class GTEST_API_ ut_DDciIconPlayer : public DTest
 {
 protected:
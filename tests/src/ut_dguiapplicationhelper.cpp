@@ -7,9 +7,11 @@
 #include "dguiapplicationhelper_p.h"
 #include "dguiapplicationhelper.h"
 #undef private
+#include "dthemechangetransaction_p.h"
 
 #include <QMap>
 #include <QProcess>
+#include <QTest>
 
 DGUI_BEGIN_NAMESPACE
 
@@ -93,6 +95,34 @@ TEST_F(TDGuiApplicationHelper, adjustColor_NoChange)
     ASSERT_EQ(testColor, adjustedColor);
 }
 
+TEST_F(TDGuiApplicationHelper, adjustColor_Image)
+{
+    QImage image(4, 2, QImage::Format_ARGB32);
+    const QRgb pixels[] = { qRgba(255, 0, 0, 255), qRgba(0, 128, 0, 200), qRgba(30, 60, 90, 50),
+                            qRgba(0, 0, 0, 0), qRgba(255, 255, 255, 255), qRgba(255, 0, 0, 255),
+                            qRgba(10, 20, 30, 40), qRgba(0, 128, 0, 200) };
+    for (int i = 0; i < 8; ++i)
+        image.setPixel(i % 4, i / 4, pixels[i]);
+
+    auto check = [&](qint8 h, qint8 s, qint8 l, qint8 r, qint8 g, qint8 b, qint8 a) {
+        const QImage adjusted = helper->adjustColor(image, h, s, l, r, g, b, a);
+        ASSERT_EQ(adjusted.format(), image.format());
+        for (int i = 0; i < 8; ++i) {
+            const QColor color = QColor::fromRgba(pixels[i]);
+            const QRgb expected = color.alpha() ? helper->adjustColor(color, h, s, l, r, g, b, a).rgba() : pixels[i];
+            ASSERT_EQ(adjusted.pixel(i % 4, i / 4), expected);
+        }
+    };
+
+    // Only the RGB and alpha channels.
+    check(0, 0, 0, 20, -30, 40, -20);
+    // With the HSL channels.
+    check(10, -20, 30, 0, 10, 0, -20);
+
+    const QImage premultiplied = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    ASSERT_EQ(helper->adjustColor(premultiplied, 0, 0, 0, 0, 0, 0, -20).format(), premultiplied.format());
+}
+
 TEST_F(TDGuiApplicationHelper, AttributeReadWrite)
 {
     QMap<DGuiApplicationHelper::Attribute, bool> oldData;
@@ -121,6 +151,27 @@ TEST_F(TDGuiApplicationHelper, AttributeReadOnly)
     }
 }
 
+TEST_F(TDGuiApplicationHelper, standardPalette)
+{
+    const DPalette light = DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::LightType);
+    const DPalette dark = DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::DarkType);
+    EXPECT_EQ(light, DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::LightType));
+    EXPECT_EQ(dark, DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::DarkType));
+    EXPECT_NE(light.color(QPalette::Window), dark.color(QPalette::Window));
+    EXPECT_EQ(DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::UnknownType), DPalette());
+
+    // The cached palette follows the ColorCompositing attribute.
+    const bool compositing = DGuiApplicationHelper::testAttribute(DGuiApplicationHelper::ColorCompositing);
+    DGuiApplicationHelper::setAttribute(DGuiApplicationHelper::ColorCompositing, !compositing);
+    EXPECT_NE(light.color(QPalette::Window),
+              DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::LightType).color(QPalette::Window));
+    DGuiApplicationHelper::setAttribute(DGuiApplicationHelper::ColorCompositing, compositing);
+    EXPECT_EQ(light, DGuiApplicationHelper::standardPalette(DGuiApplicationHelper::LightType));
+
+    const DPlatformTheme *theme = helper->systemTheme();
+    EXPECT_EQ(DGuiApplicationHelper::fetchPalette(theme), DGuiApplicationHelper::fetchPalette(theme));
+}
+
 TEST_F(TDGuiApplicationHelper, loadTranslator)
 {
     EXPECT_EQ(QProcess::tr("No program defined"), "No program defined");
@@ -132,4 +183,43 @@ TEST_F(TDGuiApplicationHelper, loadTranslator)
     qInfo() << QCoreApplication::translate("TDGuiApplicationHelper", "test-translation");
 }
 
+TEST(ut_DThemeChangeTransaction, coalesce)
+{
+    auto transaction = DThemeChangeTransaction::instance();
+    ASSERT_TRUE(transaction);
+    const auto oldCommitter = transaction->committer();
+
+    int commits = 0;
+    DThemeChangeTransaction::Changes committed;
+    transaction->setCommitter([&] (DThemeChangeTransaction::Changes changes, const QList<QWindow *> &) {
+        ++commits;
+        committed |= changes;
+    });
+
+    // All changes of a theme switch are committed once.
+    transaction->addChange(DThemeChangeTransaction::ThemeNameChange);
+    transaction->addChange(DThemeChangeTransaction::ActiveColorChange);
+    transaction->addChange(DThemeChangeTransaction::PaletteChange);
+    EXPECT_TRUE(QTest::qWaitFor([&] { return commits > 0; }));
+    QTest::qWait(50);
+    EXPECT_EQ(commits, 1);
+    EXPECT_EQ(committed, DThemeChangeTransaction::ThemeNameChange
+              | DThemeChangeTransaction::ActiveColorChange
+              | DThemeChangeTransaction::PaletteChange);
+
+    // The transaction waits for the holder, e.g. a delayed palette change.
+    QObject holder;
+    commits = 0;
+    transaction->hold(&holder);
+    transaction->addChange(DThemeChangeTransaction::ThemeNameChange);
+    QTest::qWait(50);
+    EXPECT_EQ(commits, 0);
+    transaction->addChange(DThemeChangeTransaction::PaletteChange);
+    transaction->release(&holder);
+    EXPECT_TRUE(QTest::qWaitFor([&] { return commits == 1; }));
+    EXPECT_FALSE(transaction->isPending());
+
+    transaction->setCommitter(oldCommitter);
+}
+
 DGUI_END_NAMESPACE
@@ -0,0 +1,125 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "test.h"
+#include "diconpixmapdiskcache_p.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QTemporaryDir>
+#include <QThreadPool>
+
+DGUI_USE_NAMESPACE
+
+TEST(ut_DIconPixmapDiskCache, findAndInsert)
+{
+    if (!DIconPixmapDiskCache::isEnabled())
+        GTEST_SKIP();
+
+    QTemporaryDir cacheDir;
+    QTemporaryDir iconDir;
+    ASSERT_TRUE(cacheDir.isValid());
+    ASSERT_TRUE(iconDir.isValid());
+
+    const QString oldCacheDir = DIconPixmapDiskCache::cacheDirectory();
+    DIconPixmapDiskCache::setCacheDirectory(cacheDir.path());
+
+    const QString iconFile = QDir(iconDir.path()).filePath("logo_icon.png");
+    ASSERT_TRUE(QFile::copy(":/images/logo_icon.png", iconFile));
+
+    const QPixmap pixmap = QPixmap::fromImage(QImage(":/images/logo_icon.png"));
+    ASSERT_FALSE(pixmap.isNull());
+
+    const QByteArray key = DIconPixmapDiskCache::key(iconFile, pixmap.size(), 1.0, "normal");
+    ASSERT_FALSE(key.isEmpty());
+    EXPECT_EQ(key, DIconPixmapDiskCache::key(DIconPixmapDiskCache::fileKey(iconFile), pixmap.size(), 1.0, "normal"));
+    EXPECT_TRUE(DIconPixmapDiskCache::key(iconDir.path() + "/missing.png", pixmap.size(), 1.0).isEmpty());
+    EXPECT_NE(key, DIconPixmapDiskCache::key(iconFile, pixmap.size(), 2.0, "normal"));
+    EXPECT_NE(key, DIconPixmapDiskCache::key(iconFile, pixmap.size(), 1.0, "disabled"));
+
+    QPixmap cached;
+    EXPECT_FALSE(DIconPixmapDiskCache::find(key, &cached));
+    // The pixmap is written in a worker thread.
+    ASSERT_TRUE(DIconPixmapDiskCache::insert(key, pixmap));
+    QThreadPool::globalInstance()->waitForDone();
+    ASSERT_TRUE(DIconPixmapDiskCache::find(key, &cached));
+    // No temporary file is left.
+    EXPECT_EQ(QDir(cacheDir.path()).entryList(QDir::Files | QDir::Hidden).size(), 1);
+    EXPECT_EQ(cached.toImage().convertToFormat(QImage::Format_ARGB32_Premultiplied),
+              pixmap.toImage().convertToFormat(QImage::Format_ARGB32_Premultiplied));
+
+    // The key is changed with the icon file.
+    QFile file(iconFile);
+    ASSERT_TRUE(file.open(QIODevice::ReadWrite));
+    ASSERT_TRUE(file.setFileTime(QDateTime::currentDateTime().addSecs(-60), QFileDevice::FileModificationTime));
+    file.close();
+    EXPECT_NE(key, DIconPixmapDiskCache::key(iconFile, pixmap.size(), 1.0, "normal"));
+
+    DIconPixmapDiskCache::setCacheDirectory(oldCacheDir);
+}
+
+TEST(ut_DIconPixmapDiskCache, trim)
+{
+    if (!DIconPixmapDiskCache::isEnabled())
+        GTEST_SKIP();
+
+    QTemporaryDir cacheDir;
+    QTemporaryDir iconDir;
+    ASSERT_TRUE(cacheDir.isValid());
+    ASSERT_TRUE(iconDir.isValid());
+
+    const QString oldCacheDir = DIconPixmapDiskCache::cacheDirectory();
+    DIconPixmapDiskCache::setCacheDirectory(cacheDir.path());
+
+    QImage image(16, 16, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::red);
+
+    QStringList iconFiles;
+    QByteArrayList keys;
+    for (int i = 0; i < 3; ++i) {
+        const QString iconFile = QDir(iconDir.path()).filePath(QString("icon%1.png").arg(i));
+        ASSERT_TRUE(image.save(iconFile));
+        iconFiles << iconFile;
+        keys << DIconPixmapDiskCache::key(iconFile, image.size(), 1.0);
+        ASSERT_TRUE(DIconPixmapDiskCache::insert(keys.last(), image));
+    }
+    // The insertion trims the cache in a worker thread.
+    QThreadPool::globalInstance()->waitForDone();
+
+    QDir dir(cacheDir.path());
+    ASSERT_EQ(dir.entryList(QDir::Files).size(), 3);
+    const qint64 entrySize = dir.entryInfoList(QDir::Files).first().size();
+
+    // The temporary file of an insertion is kept until it's abandoned.
+    const QString tempFile = dir.filePath("tempfile.XXXXXX");
+    {
+        QFile file(tempFile);
+        ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+        file.write("DIPC");
+    }
+
+    // The entry of the removed icon file is removed.
+    ASSERT_TRUE(QFile::remove(iconFiles.at(0)));
+    EXPECT_EQ(DIconPixmapDiskCache::trim(3 * entrySize), 1);
+    EXPECT_TRUE(QFile::exists(tempFile));
+
+    // The least recently used entry is removed.
+    const QDateTime past = QDateTime::currentDateTime().addDays(-7);
+    QPixmap pixmap;
+    for (const QString &name : dir.entryList(QDir::Files)) {
+        QFile file(dir.filePath(name));
+        ASSERT_TRUE(file.open(QIODevice::ReadWrite));
+        ASSERT_TRUE(file.setFileTime(past, QFileDevice::FileAccessTime));
+        ASSERT_TRUE(file.setFileTime(past, QFileDevice::FileModificationTime));
+    }
+    ASSERT_TRUE(DIconPixmapDiskCache::find(keys.at(2), &pixmap));
+    EXPECT_EQ(DIconPixmapDiskCache::trim(entrySize), 2);
+    EXPECT_FALSE(DIconPixmapDiskCache::find(keys.at(1), &pixmap));
+    EXPECT_TRUE(DIconPixmapDiskCache::find(keys.at(2), &pixmap));
+    EXPECT_FALSE(QFile::exists(tempFile));
+
+    DIconPixmapDiskCache::setCacheDirectory(oldCacheDir);
+}
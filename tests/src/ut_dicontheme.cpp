@@ -4,8 +4,17 @@
 
 #include "test.h"
 #include "DIconTheme"
+#include "ddciiconthemeindex_p.h"
+#include "diconcachekey_p.h"
+#include "diconpixmapdiskcache_p.h"
+#include "ddciiconpalette.h"
 
 #include <QIcon>
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QDateTime>
+#include <QTest>
 
 DGUI_USE_NAMESPACE
 
@@ -48,3 +57,150 @@ TEST(ut_DIconTheme, cachedTheme)
     const QIcon icon1_cached2 = DIconTheme::cached()->findQIcon("edit");
     ASSERT_NE(icon1_cached2.cacheKey(), icon1.cacheKey());
 }
+
+TEST(ut_DIconTheme, dciThemeIndex)
+{
+    QTemporaryDir searchPath;
+    ASSERT_TRUE(searchPath.isValid());
+    QDir dir(searchPath.path());
+    ASSERT_TRUE(dir.mkpath("bloom/org.deepin.app"));
+    ASSERT_TRUE(QFile::copy(":/images/dci_heart.dci", dir.filePath("bloom/heart.dci")));
+    ASSERT_TRUE(QFile::copy(":/images/dci_heart.dci", dir.filePath("bloom/org.deepin.app/accounts.dci")));
+
+    const QString themeDir = dir.filePath("bloom");
+    // The missing index is opened again after it's generated.
+    EXPECT_FALSE(DDciIconThemeIndex::cached(themeDir));
+    QTest::qWait(20);
+    ASSERT_TRUE(DDciIconThemeIndex::build(themeDir));
+    EXPECT_TRUE(DDciIconThemeIndex::cached(themeDir));
+    auto index = DDciIconThemeIndex::open(themeDir);
+    ASSERT_TRUE(index);
+    EXPECT_EQ(index->count(), 2);
+    EXPECT_TRUE(index->contains("heart"));
+    EXPECT_TRUE(index->contains("org.deepin.app/accounts"));
+    EXPECT_FALSE(index->contains("accounts"));
+
+    const QStringList oldPaths = DIconTheme::dciThemeSearchPaths();
+    DIconTheme::Cached cache;
+    // Creates the watcher, the index is trusted until the directories are changed.
+    cache.findDciIconFile("heart", "bloom");
+    DIconTheme::setDciThemeSearchPaths({searchPath.path()});
+    EXPECT_EQ(DIconTheme::findDciIconFile("heart", "bloom"), dir.filePath("bloom/heart.dci"));
+    EXPECT_EQ(DIconTheme::findDciIconFile("org.deepin.app/accounts", "bloom"),
+              dir.filePath("bloom/org.deepin.app/accounts.dci"));
+    EXPECT_TRUE(DIconTheme::findDciIconFile("missing", "bloom").isEmpty());
+
+    // The icons installed after the index is generated are found after the change is noticed.
+    QTest::qWait(20);
+    const QString addedPath = dir.filePath("bloom/org.deepin.app/added.dci");
+    ASSERT_TRUE(QFile::copy(":/images/dci_heart.dci", addedPath));
+    EXPECT_TRUE(QTest::qWaitFor([&addedPath] {
+        return DIconTheme::findDciIconFile("org.deepin.app/added", "bloom") == addedPath;
+    }));
+
+    // The removed icons too.
+    ASSERT_TRUE(DDciIconThemeIndex::build(themeDir));
+    DIconTheme::setDciThemeSearchPaths({searchPath.path()});
+    ASSERT_TRUE(DDciIconThemeIndex::cached(themeDir, true));
+    QTest::qWait(20);
+    ASSERT_TRUE(QFile::remove(dir.filePath("bloom/heart.dci")));
+    EXPECT_TRUE(QTest::qWaitFor([] {
+        return DIconTheme::findDciIconFile("heart", "bloom").isEmpty();
+    }));
+    DIconTheme::setDciThemeSearchPaths(oldPaths);
+
+    // The index is out of date when the directory is modified after it's generated.
+    QFile indexFile(DDciIconThemeIndex::indexFilePath(themeDir));
+    ASSERT_TRUE(indexFile.open(QIODevice::ReadWrite));
+    ASSERT_TRUE(indexFile.setFileTime(QDateTime::currentDateTime().addSecs(-60), QFileDevice::FileModificationTime));
+    indexFile.close();
+    EXPECT_FALSE(DDciIconThemeIndex::open(themeDir));
+}
+
+TEST(ut_DIconTheme, cachedGeneration)
+{
+    QTemporaryDir searchPath;
+    ASSERT_TRUE(searchPath.isValid());
+    QDir dir(searchPath.path());
+    ASSERT_TRUE(dir.mkpath("bloom"));
+
+    const QStringList oldPaths = DIconTheme::dciThemeSearchPaths();
+    DIconTheme::setDciThemeSearchPaths({searchPath.path()});
+
+    DIconTheme::Cached cache;
+    // The miss is cached, and the fallback is returned for it.
+    EXPECT_TRUE(cache.findDciIconFile("heart", "bloom").isEmpty());
+    EXPECT_EQ(cache.findDciIconFile("heart", "bloom", "fallback"), QStringLiteral("fallback"));
+
+    // The cached miss is invalid after the theme directory is changed.
+    ASSERT_TRUE(QFile::copy(":/images/dci_heart.dci", dir.filePath("bloom/heart.dci")));
+    EXPECT_TRUE(QTest::qWaitFor([&cache] {
+        return !cache.findDciIconFile("heart", "bloom").isEmpty();
+    }));
+
+    DIconTheme::setDciThemeSearchPaths(oldPaths);
+}
+
+TEST(ut_DIconTheme, cachedGenerationOfGroup)
+{
+    QTemporaryDir searchPath;
+    ASSERT_TRUE(searchPath.isValid());
+    QDir dir(searchPath.path());
+    ASSERT_TRUE(dir.mkpath("bloom/org.deepin.app"));
+
+    const QStringList oldPaths = DIconTheme::dciThemeSearchPaths();
+    DIconTheme::Cached cache;
+    // Creates the watcher before the search paths are changed.
+    cache.findDciIconFile("heart", "bloom");
+    DIconTheme::setDciThemeSearchPaths({searchPath.path()});
+
+    EXPECT_TRUE(cache.findDciIconFile("org.deepin.app/heart", "bloom").isEmpty());
+
+    // The group directories are watched too.
+    ASSERT_TRUE(QFile::copy(":/images/dci_heart.dci", dir.filePath("bloom/org.deepin.app/heart.dci")));
+    EXPECT_TRUE(QTest::qWaitFor([&cache] {
+        return !cache.findDciIconFile("org.deepin.app/heart", "bloom").isEmpty();
+    }));
+
+    DIconTheme::setDciThemeSearchPaths(oldPaths);
+}
+
+TEST(ut_DIconTheme, cacheKey)
+{
+    EXPECT_EQ(DIconNameAtoms::atom(QString()), 0u);
+    EXPECT_EQ(DIconNameAtoms::atom("edit"), DIconNameAtoms::atom(QString("ed") + QString("it")));
+    EXPECT_NE(DIconNameAtoms::atom("edit"), DIconNameAtoms::atom("edit-copy"));
+
+    const DDciIconPalette palette(Qt::red, Qt::white);
+    EXPECT_EQ(DIconCacheKey::hash(palette), DIconCacheKey::hash(DDciIconPalette(Qt::red, Qt::white)));
+    EXPECT_NE(DIconCacheKey::hash(palette), DIconCacheKey::hash(DDciIconPalette(Qt::red, Qt::black)));
+    // An invalid color is not the same as a transparent color.
+    EXPECT_NE(DIconCacheKey::hash(DDciIconPalette()), DIconCacheKey::hash(DDciIconPalette(Qt::transparent)));
+}
+
+TEST(ut_DIconTheme, prefetch)
+{
+    if (!DIconPixmapDiskCache::isEnabled())
+        GTEST_SKIP();
+
+    QTemporaryDir searchPath;
+    QTemporaryDir cacheDir;
+    ASSERT_TRUE(searchPath.isValid());
+    ASSERT_TRUE(cacheDir.isValid());
+    ASSERT_TRUE(QFile::copy(":/images/dci_heart.dci", QDir(searchPath.path()).filePath("heart.dci")));
+
+    const QStringList oldPaths = DIconTheme::dciThemeSearchPaths();
+    const QString oldCacheDir = DIconPixmapDiskCache::cacheDirectory();
+    DIconTheme::setDciThemeSearchPaths({searchPath.path()});
+    DIconPixmapDiskCache::setCacheDirectory(cacheDir.path());
+
+    // The icon is rasterised in the worker thread for each device pixel ratio.
+    DIconTheme::prefetch({"heart"}, {QSize(16, 16)}, {1.0, 2.0});
+    EXPECT_TRUE(QTest::qWaitFor([&cacheDir] {
+        return QDir(cacheDir.path()).entryList(QDir::Files).size() == 2;
+    }));
+    EXPECT_FALSE(DIconTheme::cached()->findQIcon("heart").isNull());
+
+    DIconPixmapDiskCache::setCacheDirectory(oldCacheDir);
+    DIconTheme::setDciThemeSearchPaths(oldPaths);
+}
@@ -4,12 +4,19 @@
 
 #include "test.h"
 #include "dimagehandler.h"
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+#include "dimagehandlerlibs_p.h"
+#endif
 
 #include <QLibrary>
 #include <QFile>
 #include <QUrl>
 #include <QPainter>
 #include <QImageReader>
+#include <QSignalSpy>
+
+#include <cmath>
+#include <functional>
 
 DGUI_USE_NAMESPACE
 
@@ -133,6 +140,30 @@ TEST_F(TDImageHandler, testImageSizeWithSVG)
     tmpFile.remove();
 }
 
+TEST_F(TDImageHandler, testReadImageAsync)
+{
+    QSignalSpy sizeSpy(handler, &DImageHandler::imageSizeReady);
+    QSignalSpy previewSpy(handler, &DImageHandler::previewImageReady);
+    QSignalSpy loadedSpy(handler, &DImageHandler::imageLoaded);
+    QSignalSpy failedSpy(handler, &DImageHandler::loadImageFailed);
+
+    handler->readImageAsync();
+    ASSERT_TRUE(failedSpy.wait());
+    ASSERT_TRUE(loadedSpy.isEmpty());
+
+    handler->setFileName(tmpFileName);
+    handler->readImageAsync(QSize(30, 20));
+    ASSERT_TRUE(loadedSpy.wait());
+    ASSERT_EQ(sizeSpy.count(), 1);
+    ASSERT_EQ(sizeSpy.first().first().toSize(), QSize(tmpImageWidth, tmpImageHeight));
+    ASSERT_EQ(previewSpy.count(), 1);
+    ASSERT_EQ(previewSpy.first().first().value<QImage>().size(), QSize(30, 20));
+    ASSERT_EQ(loadedSpy.first().first().value<QImage>().size(), QSize(tmpImageWidth, tmpImageHeight));
+
+    // The image is cached after loaded.
+    ASSERT_EQ(handler->readImage().size(), QSize(tmpImageWidth, tmpImageHeight));
+}
+
 TEST_F(TDImageHandler, testFindAllMetaData)
 {
     handler->setFileName(tmpFileName);
@@ -152,6 +183,54 @@ TEST_F(TDImageHandler, testClearCache)
     ASSERT_TRUE(handler->lastError().isEmpty());
 }
 
+TEST_F(TDImageHandler, testReadHeaderInfo)
+{
+#ifndef DTK_DISABLE_EX_IMAGE_FORMAT
+    DLibFreeImage freeImage;
+    if (!canLoadFreeImage || !freeImage.isValid()) {
+        GTEST_SKIP();
+    }
+
+    // The size and the format are read without decoding the pixels.
+    DImageHeaderInfo header;
+    ASSERT_TRUE(freeImage.readHeaderInfo(tmpFileName, header));
+    EXPECT_EQ(QSize(tmpImageWidth, tmpImageHeight), header.size);
+    EXPECT_EQ(FIF_PNG, header.format);
+
+    DImageHeaderInfo missing;
+    EXPECT_FALSE(freeImage.readHeaderInfo("/tmp/TDImageHandler_testReadHeaderInfo_missing.png", missing));
+    EXPECT_TRUE(missing.size.isEmpty());
+#else
+    GTEST_SKIP();
+#endif
+}
+
+TEST_F(TDImageHandler, testImageSizeCache)
+{
+    const QString fileName("/tmp/TDImageHandler_testImageSizeCache.png");
+    QImage image(40, 10, QImage::Format_ARGB32);
+    image.fill(Qt::blue);
+    ASSERT_TRUE(image.save(fileName));
+
+    handler->setFileName(fileName);
+    ASSERT_EQ(QSize(40, 10), handler->imageSize());
+
+    // The header is cached, the file changed behind the handler isn't read again.
+    ASSERT_TRUE(QImage(30, 20, QImage::Format_ARGB32).save(fileName));
+    EXPECT_EQ(QSize(40, 10), handler->imageSize());
+
+    // Reset by clearCache.
+    handler->clearCache();
+    EXPECT_EQ(QSize(30, 20), handler->imageSize());
+
+    // Reset by rotating the current file.
+    ASSERT_TRUE(handler->rotateImageFile(fileName, 90));
+    EXPECT_EQ(QSize(20, 30), handler->imageSize());
+    EXPECT_EQ(QSize(20, 30), handler->readImage().size());
+
+    QFile::remove(fileName);
+}
+
 TEST_F(TDImageHandler, testSaveImage)
 {
     QString tmpSaveFileName("/tmp/TDImageHandler_testSaveImage.jpg");
@@ -245,6 +324,25 @@ TEST_F(TDImageHandler, testColorFilter)
     ASSERT_NE(image, DImageHandler::metalColorFilter(image));
 }
 
+TEST_F(TDImageHandler, testFilterUnalignedRows)
+{
+    // The scanlines of a RGB888 image with the odd width are padded.
+    QImage image(5, 3, QImage::Format_ARGB32);
+    image.fill(Qt::red);
+    image.setPixelColor(4, 2, QColor(Qt::blue));
+
+    QImage antiImage = DImageHandler::antiColorFilter(image);
+    ASSERT_EQ(antiImage.pixelColor(0, 1), QColor(Qt::cyan));
+    ASSERT_EQ(antiImage.pixelColor(4, 2), QColor(Qt::yellow));
+
+    QImage brightImage = DImageHandler::changeBrightness(image, -255);
+    ASSERT_EQ(brightImage.pixelColor(4, 2), QColor(Qt::black));
+
+    image.fill(Qt::white);
+    QImage edgeImage = DImageHandler::sobelEdgeDetector(image);
+    ASSERT_EQ(edgeImage.pixelColor(4, 2), QColor(Qt::white));
+}
+
 TEST_F(TDImageHandler, testBilateralFilter)
 {
     QImage image(300, 300, QImage::Format_ARGB32);
@@ -260,6 +358,86 @@ TEST_F(TDImageHandler, testBilateralFilter)
     ASSERT_NE(image.pixelColor(150, 155), QColor(Qt::black));
 }
 
+// The recursive bilateral filter in double precision, separated by the color channels and
+// without any scratch sharing, the image is filtered horizontally and then vertically.
+static QImage referenceBilateralFilter(const QImage &img, double spatialDecay, double photometricStandardDeviation)
+{
+    const QImage source = img.convertToFormat(QImage::Format_RGB888);
+    const int width = source.width();
+    const int height = source.height();
+    const double c = -0.5 / (photometricStandardDeviation * photometricStandardDeviation);
+    const double mu = spatialDecay / (2 - spatialDecay);
+    const double rho0 = 1.0 / (2 - spatialDecay);
+    auto weight = [&](double a, double b) {
+        const int diff = qMin(255, int(std::fabs(a - b)));
+        return (1 - spatialDecay) * std::exp(c * diff * diff);
+    };
+
+    QVector<double> data(width * height * 3);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width * 3; x++)
+            data[y * width * 3 + x] = source.constScanLine(y)[x];
+    }
+
+    // Filters the lines of count values, index() maps (line, position) to the data.
+    auto filter = [&](int lines, int count, const std::function<int(int, int)> &index) {
+        QVector<double> result(data.size());
+        QVector<double> p(count), r(count);
+        for (int line = 0; line < lines; line++) {
+            for (int i = 0; i < count; i++) {
+                const double value = data[index(line, i)];
+                p[i] = i == 0 ? value : p[i - 1] * weight(value, p[i - 1]) + value * (1 - weight(value, p[i - 1]));
+            }
+            for (int i = count - 1; i >= 0; i--) {
+                const double value = data[index(line, i)];
+                r[i] = i == count - 1 ? value : r[i + 1] * weight(value, r[i + 1]) + value * (1 - weight(value, r[i + 1]));
+            }
+            for (int i = 0; i < count; i++)
+                result[index(line, i)] = (r[i] + p[i]) * rho0 - data[index(line, i)] * mu;
+        }
+        data = result;
+    };
+
+    filter(height * 3, width, [width](int line, int x) { return (line / 3 * width + x) * 3 + line % 3; });
+    filter(width * 3, height, [width](int line, int y) { return (y * width + line / 3) * 3 + line % 3; });
+
+    QImage result(width, height, QImage::Format_RGB888);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width * 3; x++)
+            result.scanLine(y)[x] = static_cast<uchar>(qBound(0.0, std::floor(data[y * width * 3 + x] + 0.5), 255.0));
+    }
+    return result;
+}
+
+TEST_F(TDImageHandler, testBilateralFilterReference)
+{
+    // A checkerboard with noise, the odd width makes the scanlines padded.
+    QImage image(17, 13, QImage::Format_RGB888);
+    for (int y = 0; y < image.height(); y++) {
+        for (int x = 0; x < image.width(); x++) {
+            const int base = (x / 4 + y / 3) % 2 ? 200 : 30;
+            image.setPixelColor(x, y, QColor(base + (x * 7 + y * 3) % 20, base + 5 + (x * 5 + y) % 20, base + 10 + (x + y * 11) % 20));
+        }
+    }
+
+    const QList<QPair<double, double>> parameters {{0.02, 100}, {0.2, 50}, {0.5, 20}};
+    for (const auto &parameter : parameters) {
+        const QImage result = DImageHandler::bilateralFilter(image, parameter.first, parameter.second);
+        const QImage expected = referenceBilateralFilter(image, parameter.first, parameter.second);
+        ASSERT_EQ(result.size(), expected.size());
+
+        // The intermediate result between the passes is rounded to 8 bits.
+        int maxDiff = 0;
+        for (int y = 0; y < result.height(); y++) {
+            const uchar *line = result.constScanLine(y);
+            const uchar *expectedLine = expected.constScanLine(y);
+            for (int x = 0; x < result.width() * 3; x++)
+                maxDiff = qMax(maxDiff, qAbs(int(line[x]) - int(expectedLine[x])));
+        }
+        EXPECT_LE(maxDiff, 2) << "spatialDecay " << parameter.first;
+    }
+}
+
 TEST_F(TDImageHandler, testBinaryzation)
 {
     QImage image(300, 300, QImage::Format_ARGB32);
@@ -3,12 +3,15 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include "dsvgrenderer.h"
+#include "dcachestatistics.h"
+#include "dsvghrefrewriter_p.h"
 #include "test.h"
 #include <QDebug>
 #include <QFile>
 #include <QLibrary>
 #include <QPainter>
 #include <QPixmap>
+#include <QTemporaryDir>
 
 DGUI_USE_NAMESPACE
 
@@ -117,3 +120,142 @@ TEST_F(TDSvgRenderer, testRender)
     ASSERT_FALSE(renderer->toImage({TestPixmapSize, TestPixmapSize}).isNull());
     ASSERT_FALSE(renderer->toImage({TestPixmapSize, TestPixmapSize}, TestRenderID).isNull());
 }
+
+TEST_F(TDSvgRenderer, testImageCache)
+{
+    if (!canLoad)
+        return;
+
+    ASSERT_TRUE(renderer->load(QStringLiteral(":/images/logo_icon.svg")));
+
+    const auto hits = [] { return DCacheStatistics::cache(QStringLiteral("svgrenderer.image")).hits; };
+    const qint64 hitsBefore = hits();
+    const QImage image = renderer->toImage({32, 32});
+    ASSERT_FALSE(image.isNull());
+    ASSERT_EQ(hits(), hitsBefore);
+
+    // The images are cached from the second rendering of the document.
+    ASSERT_EQ(renderer->toImage({32, 32}), image);
+    ASSERT_EQ(hits(), hitsBefore);
+
+    // The same size, element and viewBox are rendered once after that.
+    ASSERT_EQ(renderer->toImage({32, 32}), image);
+    ASSERT_EQ(hits(), hitsBefore + 1);
+
+    // The viewBox is part of the key.
+    const QRectF viewBox = renderer->viewBoxF();
+    renderer->setViewBox(QRectF(viewBox.topLeft(), viewBox.size() / 2));
+    ASSERT_NE(renderer->toImage({32, 32}), image);
+    renderer->setViewBox(viewBox);
+    ASSERT_EQ(renderer->toImage({32, 32}), image);
+
+    // Loading a document drops the images of the previous one.
+    ASSERT_TRUE(renderer->load(QStringLiteral(":/images/logo_icon.svg")));
+    const qint64 hitsAfterLoad = hits();
+    ASSERT_EQ(renderer->toImage({32, 32}), image);
+    ASSERT_EQ(hits(), hitsAfterLoad);
+
+    // The renderers share one cache, the images are removed with their renderer.
+    const auto entries = [] { return DCacheStatistics::cache(QStringLiteral("svgrenderer.image")).entries; };
+    const qint64 entriesBefore = entries();
+    {
+        // A renderer used once doesn't fill the cache.
+        DSvgRenderer other(QStringLiteral(":/images/logo_icon.svg"));
+        ASSERT_EQ(other.toImage({32, 32}), image);
+        ASSERT_EQ(entries(), entriesBefore);
+        ASSERT_EQ(other.toImage({24, 24}).size(), QSize(24, 24));
+        ASSERT_EQ(other.toImage({32, 32}), image);
+        ASSERT_EQ(hits(), hitsAfterLoad);
+        ASSERT_EQ(entries(), entriesBefore + 2);
+    }
+    ASSERT_EQ(entries(), entriesBefore);
+}
+
+TEST_F(TDSvgRenderer, testToImages)
+{
+    if (!canLoad)
+        return;
+
+    ASSERT_TRUE(renderer->load(QStringLiteral(":/images/logo_icon.svg")));
+
+    const QList<QSize> sizes {{16, 16}, {24, 24}, {32, 32}, {48, 48}, {64, 64}, {96, 96}};
+    const QList<QImage> images = renderer->toImages(sizes);
+    ASSERT_EQ(images.size(), sizes.size());
+
+    // The images rendered in the workers match the ones rendered one by one.
+    DSvgRenderer serial(QStringLiteral(":/images/logo_icon.svg"));
+    for (int i = 0; i < sizes.size(); ++i) {
+        ASSERT_EQ(images.at(i).size(), sizes.at(i));
+        ASSERT_EQ(images.at(i), serial.toImage(sizes.at(i)));
+    }
+
+    const QList<QImage> elements = renderer->toImages(QSize(16, 16), {QString(), TestRenderID});
+    ASSERT_EQ(elements.size(), 2);
+    ASSERT_EQ(elements.at(0), images.at(0));
+    ASSERT_EQ(elements.at(1), serial.toImage({16, 16}, TestRenderID));
+}
+
+TEST_F(TDSvgRenderer, testLoadHref)
+{
+    if (!canLoad)
+        return;
+
+    // The href in the comment and the CDATA section are left unchanged.
+    const QByteArray svg = "<?xml version=\"1.0\"?>\n"
+                           "<!-- <use href=\"#none\"/> -->\n"
+                           "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\""
+                           " width=\"8\" height=\"8\">\n"
+                           "  <defs><rect id=\"r\" width=\"8\" height=\"8\" fill=\"#00ff00\"/></defs>\n"
+                           "  <style><![CDATA[ use[href] {} ]]></style>\n"
+                           "  <use href=\"#r\"/>\n"
+                           "</svg>\n";
+
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    QFile file(dir.filePath("href.svg"));
+    ASSERT_TRUE(file.open(QIODevice::WriteOnly));
+    file.write(svg);
+    file.close();
+
+    ASSERT_TRUE(renderer->load(file.fileName()));
+    const QImage image = renderer->toImage({8, 8});
+    ASSERT_EQ(image.pixelColor(4, 4), QColor(Qt::green));
+}
+
+TEST(ut_DSvgHrefRewriter, rewrite)
+{
+    // The documents without an unprefixed href are returned unchanged.
+    const QByteArray xlinkOnly = "<svg><use xlink:href=\"#r\"/></svg>";
+    EXPECT_EQ(DSvgHrefRewriter::rewrite(xlinkOnly), xlinkOnly);
+    EXPECT_EQ(DSvgHrefRewriter::rewrite("<svg><a data-href=\"#r\"/></svg>"), QByteArray("<svg><a data-href=\"#r\"/></svg>"));
+
+    // The self-closing and the open tags, with the quotes and the spaces around "=".
+    EXPECT_EQ(DSvgHrefRewriter::rewrite("<svg><use href=\"#r\"/><a\n href = '#l'>t</a><image href='i.png' /></svg>"),
+              QByteArray("<svg><use xlink:href=\"#r\"/><a\n xlink:href = '#l'>t</a><image xlink:href='i.png' /></svg>"));
+
+    // The attribute values aren't scanned, nor the end tags.
+    EXPECT_EQ(DSvgHrefRewriter::rewrite("<svg><text title=' href=\"x\" >'>href</text ></svg>"),
+              QByteArray("<svg><text title=' href=\"x\" >'>href</text ></svg>"));
+    EXPECT_EQ(DSvgHrefRewriter::rewrite("<svg><text title=' href=\"x\"'/><use href=\"#r\"/></svg>"),
+              QByteArray("<svg><text title=' href=\"x\"'/><use xlink:href=\"#r\"/></svg>"));
+
+    // The comments, CDATA sections and processing instructions are skipped.
+    EXPECT_EQ(DSvgHrefRewriter::rewrite("<?xml version=\"1.0\"?><!-- <use href=\"#c\"/> --><svg>"
+                                        "<style><![CDATA[ <use href=\"#d\"/> ]]></style>"
+                                        "<?pi <use href=\"#p\"/> ?><use href=\"#r\"/></svg>"),
+              QByteArray("<?xml version=\"1.0\"?><!-- <use href=\"#c\"/> --><svg>"
+                         "<style><![CDATA[ <use href=\"#d\"/> ]]></style>"
+                         "<?pi <use href=\"#p\"/> ?><use xlink:href=\"#r\"/></svg>"));
+
+    // The internal subset of DOCTYPE may contain '>' and the quoted tags.
+    EXPECT_EQ(DSvgHrefRewriter::rewrite("<!DOCTYPE svg [ <!ENTITY e \"<use href='#e'/>\"> ]><svg><use href=\"#r\"/></svg>"),
+              QByteArray("<!DOCTYPE svg [ <!ENTITY e \"<use href='#e'/>\"> ]><svg><use xlink:href=\"#r\"/></svg>"));
+
+    // A malformed document is left unchanged, like an unquoted attribute value or an unclosed tag.
+    const QByteArray unquoted = "<svg><use href=#r/><use href=\"#r\"/></svg>";
+    EXPECT_EQ(DSvgHrefRewriter::rewrite(unquoted), unquoted);
+    const QByteArray unclosed = "<svg><use href=\"#r\"";
+    EXPECT_EQ(DSvgHrefRewriter::rewrite(unclosed), unclosed);
+    const QByteArray unclosedComment = "<svg><use href=\"#r\"/><!-- </svg>";
+    EXPECT_EQ(DSvgHrefRewriter::rewrite(unclosedComment), unclosedComment);
+}
@@ -4,57 +4,13 @@
 
 #include "test.h"
 #include "dthumbnailprovider.h"
+#include "dthumbnailprovider_p.h"
 
-#include <DObjectPrivate>
 #include <QMimeDatabase>
-#include <QQueue>
-#include <QReadWriteLock>
-#include <QSet>
 #include <QSignalSpy>
-#include <QWaitCondition>
 #include <QDebug>
 #include <QImageReader>
 
-DGUI_BEGIN_NAMESPACE
-#ifndef UT_DThumbnailProviderPrivate
-#define UT_DThumbnailProviderPrivate
-class DThumbnailProviderPrivate : public DTK_CORE_NAMESPACE::DObjectPrivate
-{
-public:
-    DThumbnailProviderPrivate(DThumbnailProvider *qq);
-
-    void init();
-
-    QString sizeToFilePath(DThumbnailProvider::Size size) const;
-
-    QString errorString;
-    // MAX
-    qint64 defaultSizeLimit = INT64_MAX;
-    QHash<QMimeType, qint64> sizeLimitHash;
-    QMimeDatabase mimeDatabase;
-
-    static QSet<QString> hasThumbnailMimeHash;
-
-    struct ProduceInfo
-    {
-        QFileInfo fileInfo;
-        DThumbnailProvider::Size size;
-        DThumbnailProvider::CallBack callback;
-    };
-
-    QQueue<ProduceInfo> produceQueue;
-    QSet<QPair<QString, DThumbnailProvider::Size>> discardedProduceInfos;
-
-    bool running = true;
-
-    QWaitCondition waitCondition;
-    QReadWriteLock dataReadWriteLock;
-
-    D_DECLARE_PUBLIC(DThumbnailProvider)
-};
-#endif
-DGUI_END_NAMESPACE
-
 DGUI_USE_NAMESPACE
 
 class TDThumbnailProvider : public DTest
@@ -75,8 +31,6 @@ void TDThumbnailProvider::SetUp()
 
 void TDThumbnailProvider::TearDown()
 {
-    // gtest会释放静态部分数据 导致双重释放程序崩溃这里手动将数据清空防止崩溃事情发生
-    provider_d->hasThumbnailMimeHash.clear();
 }
 
 #define TESTRES_PATH ":/images/logo_icon.svg"
@@ -127,12 +81,24 @@ void testCallBack(const QString &)
 
 TEST_F(TDThumbnailProvider, TestProducrQueue)
 {
-    provider_d->running = true;
-    provider->appendToProduceQueue(QFileInfo(TESTRES_PATH), DThumbnailProvider::Small);
-    provider->appendToProduceQueue(QFileInfo(TESTRES_PATH), DThumbnailProvider::Large, &testCallBack);
-    ASSERT_FALSE(provider_d->produceQueue.isEmpty());
-
-    provider->removeInProduceQueue(QFileInfo(TESTRES_PATH), DThumbnailProvider::Small);
-    ASSERT_FALSE(provider_d->discardedProduceInfos.isEmpty());
+    // Don't start the workers, only check the queue.
     provider_d->running = false;
+    const QFileInfo fi(TESTRES_PATH);
+    provider->appendToProduceQueue(fi, DThumbnailProvider::Small);
+    provider->appendToProduceQueue(fi, DThumbnailProvider::Large, &testCallBack);
+    // The same request is merged, and the priority is raised.
+    provider->appendToProduceQueue(fi, DThumbnailProvider::Large, &testCallBack, 10);
+    ASSERT_EQ(provider_d->pendingProduceInfos.size(), 2);
+
+    auto largeInfo = provider_d->pendingProduceInfos.value(qMakePair(fi.absoluteFilePath(), DThumbnailProvider::Large));
+    ASSERT_TRUE(largeInfo);
+    ASSERT_EQ(largeInfo->callbacks.size(), 2);
+    ASSERT_EQ(largeInfo->priority, 10);
+
+    provider->removeInProduceQueue(fi, DThumbnailProvider::Small);
+    ASSERT_EQ(provider_d->pendingProduceInfos.size(), 1);
+
+    provider_d->pendingProduceInfos.clear();
+    provider_d->produceQueue = {};
+    provider_d->running = true;
 }
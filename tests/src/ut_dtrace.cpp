@@ -0,0 +1,97 @@
+// SPDX-FileCopyrightText: 2026 UnionTech Software Technology Co., Ltd.
+//
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "test.h"
+#include "dtrace_p.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QThread>
+
+DGUI_USE_NAMESPACE
+
+static QJsonArray traceEvents(const QString &name)
+{
+    QJsonArray result;
+    const QJsonArray events = QJsonDocument::fromJson(DTrace::toChromeTraceJson())
+            .object().value("traceEvents").toArray();
+    for (const QJsonValue &event : events) {
+        if (event.toObject().value("name").toString() == name)
+            result.append(event);
+    }
+    return result;
+}
+
+TEST(ut_DTrace, disabled)
+{
+    const bool enabled = DTrace::isEnabled();
+    DTrace::setEnabled(false);
+    DTrace::clear();
+
+    {
+        D_TRACE_SCOPE("ut_DTrace.disabled");
+    }
+    D_TRACE_COUNTER(counter, "ut_DTrace.disabledCounter");
+    counter.add();
+
+    EXPECT_TRUE(traceEvents("ut_DTrace.disabled").isEmpty());
+    EXPECT_TRUE(traceEvents("ut_DTrace.disabledCounter").isEmpty());
+
+    DTrace::setEnabled(enabled);
+}
+
+TEST(ut_DTrace, spansAndCounters)
+{
+    const bool enabled = DTrace::isEnabled();
+    DTrace::setEnabled(true);
+    DTrace::clear();
+
+    {
+        D_TRACE_SCOPE("ut_DTrace.span", "test", QStringLiteral("detail"));
+        QThread::msleep(2);
+    }
+
+    QThread *thread = QThread::create([] {
+        D_TRACE_SCOPE("ut_DTrace.threadSpan");
+    });
+    thread->start();
+    ASSERT_TRUE(thread->wait(5000));
+    delete thread;
+
+    D_TRACE_COUNTER(counter, "ut_DTrace.counter");
+    counter.add();
+    counter.add(2);
+
+    const QJsonArray spans = traceEvents("ut_DTrace.span");
+    ASSERT_EQ(spans.size(), 1);
+    const QJsonObject span = spans.first().toObject();
+    EXPECT_EQ(span.value("ph").toString(), QStringLiteral("X"));
+    EXPECT_EQ(span.value("cat").toString(), QStringLiteral("test"));
+    EXPECT_GE(span.value("dur").toDouble(), 2000);
+    EXPECT_EQ(span.value("args").toObject().value("detail").toString(), QStringLiteral("detail"));
+
+    // The events of the finished threads are kept.
+    const QJsonArray threadSpans = traceEvents("ut_DTrace.threadSpan");
+    ASSERT_EQ(threadSpans.size(), 1);
+    EXPECT_NE(threadSpans.first().toObject().value("tid"), span.value("tid"));
+
+    const QJsonArray counters = traceEvents("ut_DTrace.counter");
+    ASSERT_EQ(counters.size(), 2);
+    EXPECT_EQ(counters.at(0).toObject().value("ph").toString(), QStringLiteral("C"));
+    EXPECT_EQ(counters.at(0).toObject().value("args").toObject().value("value").toInt(), 1);
+    EXPECT_EQ(counters.at(1).toObject().value("args").toObject().value("value").toInt(), 3);
+
+    QTemporaryDir dir;
+    ASSERT_TRUE(dir.isValid());
+    const QString file = dir.filePath("trace.json");
+    ASSERT_TRUE(DTrace::writeChromeTrace(file));
+    EXPECT_TRUE(QFile::exists(file));
+
+    DTrace::clear();
+    EXPECT_TRUE(traceEvents("ut_DTrace.span").isEmpty());
+    DTrace::setEnabled(enabled);
+}
@@ -11,10 +11,12 @@
 
 #include <QtConcurrent/QtConcurrent>
 #include <DDciFile>
+#include <ddciiconthemeindex_p.h>
 #include <stdexcept>
 #include <atomic>
 
 DCORE_USE_NAMESPACE
+DGUI_USE_NAMESPACE
 
 // Custom exception for DCI processing errors
 class DciProcessingError : public std::runtime_error {
@@ -271,6 +273,10 @@ int main(int argc, char *argv[])
                                   ,
                                        "csv file");
     QCommandLineOption fixDarkTheme("fix-dark-theme", "Create symlinks from light theme for dark theme files.");
+    QCommandLineOption buildIndex("build-index", "Generate the lookup index for the given dci icon theme directories, "
+                                                 "it's used to find the dci icons without probing the files. "
+                                                 "The index is ignored once the directory is modified, "
+                                                 "so it needs to be regenerated after installing icons.");
     QCommandLineOption scaleQuality({"O","scale-quality"}, "Quility of dci scaled icon image\n"
                                                 "The value may like <scale size>=<quality value>  e.g. 2=98:3=95\n"
                                                 "The quality factor must be in the range 0 to 100 or -1.\n"
@@ -292,10 +298,11 @@ int main(int argc, char *argv[])
                                  "\t dci-icon-theme /usr/share/icons/hicolor/256x256/apps -o ~/Desktop/hicolor -O 3=95\n"
                                  "\t dci-icon-theme -m *.png /usr/share/icons/hicolor/256x256/apps -o ~/Desktop/hicolor -O 3=95\n"
                                  "\t dci-icon-theme --fix-dark-theme <input dci files directory> -o <output directory path> \n"
-                                 "\t dci-icon-theme <input file directory> -o <output directory path> -s <csv file> -O <qualities>\n"""
+                                 "\t dci-icon-theme <input file directory> -o <output directory path> -s <csv file> -O <qualities>\n"
+                                 "\t dci-icon-theme --build-index /usr/share/dsg/icons/bloom\n"
                                  );
 
-    cp.addOptions({fileFilter, outputDirectory, symlinkMap, fixDarkTheme, scaleQuality});
+    cp.addOptions({fileFilter, outputDirectory, symlinkMap, fixDarkTheme, buildIndex, scaleQuality});
     cp.addPositionalArgument("source", "Search the given directory and it's subdirectories, "
                                        "get the files conform to rules of --match.",
                              "~/dci-png-icons");
@@ -311,6 +318,20 @@ int main(int argc, char *argv[])
         cp.showHelp(-2);
     }
 
+    if (cp.isSet(buildIndex)) {
+        int ret = 0;
+        for (const auto &themeDir : cp.positionalArguments()) {
+            QString error;
+            if (!DDciIconThemeIndex::build(themeDir, &error)) {
+                qWarning() << "Failed on generating the index for" << themeDir << ":" << error;
+                ret = -8;
+                continue;
+            }
+            qInfo() << "Generated the index:" << DDciIconThemeIndex::indexFilePath(QDir(themeDir).absolutePath());
+        }
+        return ret;
+    }
+
     if (!cp.isSet(outputDirectory)) {
         qWarning() << "Not give -o argument";
         cp.showHelp(-4);
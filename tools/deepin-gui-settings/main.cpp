@@ -10,6 +10,10 @@
 #include <QDebug>
 #include <QColor>
 #include <QProcess>
+#include <QDBusInterface>
+#include <QDBusReply>
+
+#include <cstdio>
 
 DGUI_USE_NAMESPACE
 
@@ -31,6 +35,8 @@ int main(int argc, char *argv[])
     QCommandLineOption option_int({"i", "int"}, "set a int value of a settings item");
     QCommandLineOption option_color({"c", "color"}, "set a color value of a settings item");
     QCommandLineOption option_remove({"r", "remove"}, "remove a settings item");
+    QCommandLineOption option_cache_statistics("cache-statistics", "print the cache statistics of an application, "
+                                               "it must be started with D_DTK_CACHE_STATISTICS_DBUS=1");
 
     option_window.setValueName("id");
     option_window.setDefaultValue("0");
@@ -41,6 +47,7 @@ int main(int argc, char *argv[])
     option_int.setValueName("value");
     option_color.setValueName("value");
     option_remove.setValueName("key");
+    option_cache_statistics.setValueName("dbus service");
 
     parser.addOption(option_window);
     parser.addOption(option_window_leader);
@@ -51,11 +58,27 @@ int main(int argc, char *argv[])
     parser.addOption(option_int);
     parser.addOption(option_color);
     parser.addOption(option_remove);
+    parser.addOption(option_cache_statistics);
     parser.addPositionalArgument("keys", "key of get settings value", "[keys...]");
     parser.addHelpOption();
     parser.addVersionOption();
     parser.process(app);
 
+    if (parser.isSet(option_cache_statistics)) {
+        // 应用程序的 D-Bus 连接名, 如 ":1.42"
+        QDBusInterface statistics(parser.value(option_cache_statistics), "/org/deepin/dtk/gui/CacheStatistics",
+                                  "org.deepin.dtk.gui.CacheStatistics");
+        const QDBusReply<QString> reply = statistics.call("Dump");
+
+        if (!reply.isValid()) {
+            qWarning() << "Failed to get the cache statistics:" << reply.error().message();
+            return -1;
+        }
+
+        printf("%s\n", reply.value().toLocal8Bit().constData());
+        return 0;
+    }
+
     quint32 window_id = 0;
 
     if (parser.isSet(option_select_window)) {